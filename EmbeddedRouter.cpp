@@ -0,0 +1,73 @@
+#include "EmbeddedRouter.h"
+#ifdef SAMON_EMBEDDED_ROUTER
+#include "api.h"           // libi2pd: InitI2P/StartI2P/StopI2P
+#include "ClientContext.h" // libi2pd_client: SAM bridge lifecycle
+#endif
+
+namespace SAM {
+
+std::mutex EmbeddedRouter::mutex_;
+bool EmbeddedRouter::running_ = false;
+SamBridgeEndpoint EmbeddedRouter::endpoint_;
+
+bool EmbeddedRouter::start(const EmbeddedRouterConfig& config, std::string& error_message) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (running_) return true;
+#ifdef SAMON_EMBEDDED_ROUTER
+	std::vector<std::string> args = {
+		"samon",
+		"--sam.enabled=true",
+		"--sam.address=" + config.sam_address,
+		"--sam.port=" + std::to_string(config.sam_port)
+	};
+	if (!config.data_dir.empty()) args.push_back("--datadir=" + config.data_dir);
+	args.insert(args.end(), config.extra_args.begin(), config.extra_args.end());
+
+	std::vector<char*> argv;
+	for (auto& arg : args) argv.push_back(arg.data());
+	argv.push_back(nullptr);
+
+	try {
+		SPDLOG_INFO("Starting embedded i2pd router, SAM bridge on {}:{}", config.sam_address, config.sam_port);
+		i2p::api::InitI2P(static_cast<int>(args.size()), argv.data(), "samon");
+		i2p::api::StartI2P();
+		i2p::client::context.Start();
+	} catch (const std::exception& e) {
+		error_message = "Embedded router start failed: " + std::string(e.what());
+		SPDLOG_ERROR("{}", error_message);
+		return false;
+	}
+	endpoint_ = SamBridgeEndpoint::tcp(config.sam_address, config.sam_port);
+	running_ = true;
+	return true;
+#else
+	(void)config;
+	error_message = "samon was built without SAMON_EMBEDDED_ROUTER";
+	SPDLOG_ERROR("{}", error_message);
+	return false;
+#endif
+}
+
+void EmbeddedRouter::stop() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (!running_) return;
+#ifdef SAMON_EMBEDDED_ROUTER
+	SPDLOG_INFO("Stopping embedded i2pd router.");
+	i2p::client::context.Stop();
+	i2p::api::StopI2P();
+	i2p::api::TerminateI2P();
+#endif
+	running_ = false;
+}
+
+bool EmbeddedRouter::isRunning() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return running_;
+}
+
+SamBridgeEndpoint EmbeddedRouter::samEndpoint() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return endpoint_;
+}
+
+} // namespace SAM
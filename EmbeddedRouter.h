@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include "SamConnection.h" // For SamBridgeEndpoint
+
+namespace SAM {
+
+struct EmbeddedRouterConfig {
+	std::string data_dir;                 // i2pd data directory (router.info, netDb, ...); empty = i2pd default
+	std::string sam_address = "127.0.0.1";
+	uint16_t sam_port = 7656;
+	std::vector<std::string> extra_args;  // Passed to i2pd's option parser, e.g. "--bandwidth=P"
+};
+
+// Runs an i2pd router together with its SAM bridge inside this process (libi2pd + libi2pd_client),
+// so no external router is needed. SamService/SamConnection stay unchanged: a SamBridgeEndpoint
+// parsed from "embedded" is redirected to the in-process bridge once start() succeeded.
+// i2pd keeps its router state in process-wide globals, hence a static interface.
+// Requires building with -DSAMON_EMBEDDED_ROUTER=ON; otherwise start() fails with an error message.
+class EmbeddedRouter {
+public:
+	static bool start(const EmbeddedRouterConfig& config, std::string& error_message);
+	static void stop();
+	static bool isRunning();
+	static SamBridgeEndpoint samEndpoint();
+
+private:
+	static std::mutex mutex_;
+	static bool running_;
+	static SamBridgeEndpoint endpoint_;
+};
+
+} // namespace SAM
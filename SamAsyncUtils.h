@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <boost/asio.hpp>
+#include <boost/asio/experimental/awaitable_operators.hpp>
+
+namespace net = boost::asio;
+using SteadyClock = std::chrono::steady_clock;
+
+namespace SAM {
+
+// Condition-variable style wake-up for coroutines, built on a steady_timer that never expires
+// on its own: waiters park in async_wait and notifyAll() cancels the timer to resume all of them.
+// Waiters re-check their predicate after waking. Not thread-safe: use from a single-threaded
+// io_context (as the examples do) or from one strand.
+class AsyncCondition {
+public:
+	explicit AsyncCondition(const net::any_io_executor& ex)
+		: timer_(ex, SteadyClock::time_point::max()) {}
+
+	void notifyAll() { timer_.cancel(); }
+
+	net::awaitable<void> wait() {
+		boost::system::error_code ec;
+		co_await timer_.async_wait(net::redirect_error(net::use_awaitable, ec));
+	}
+
+	// Returns false if the deadline passed before a notification arrived.
+	net::awaitable<bool> waitUntil(SteadyClock::time_point deadline) {
+		if (deadline == SteadyClock::time_point::max()) {
+			co_await wait();
+			co_return true;
+		}
+		net::steady_timer deadline_timer(timer_.get_executor(), deadline);
+		boost::system::error_code ec;
+		using namespace net::experimental::awaitable_operators;
+		auto result = co_await (
+			wait() ||
+			deadline_timer.async_wait(net::redirect_error(net::use_awaitable, ec)));
+		co_return result.index() == 0;
+	}
+
+private:
+	net::steady_timer timer_;
+};
+
+// Counts outstanding coroutines spawned with co_spawn(..., detached) so the spawner can await them all.
+class AsyncWaitGroup {
+public:
+	explicit AsyncWaitGroup(const net::any_io_executor& ex) : cond_(ex) {}
+
+	void add(std::size_t n = 1) { pending_ += n; }
+	void done() {
+		if (pending_ > 0 && --pending_ == 0) cond_.notifyAll();
+	}
+	std::size_t pending() const { return pending_; }
+
+	net::awaitable<void> wait() {
+		while (pending_ > 0) co_await cond_.wait();
+	}
+
+private:
+	AsyncCondition cond_;
+	std::size_t pending_ = 0;
+};
+
+} // namespace SAM
@@ -0,0 +1,266 @@
+#include "SamBridgePool.h"
+#include <algorithm>
+
+namespace SAM {
+
+namespace {
+
+constexpr auto kMonitorInterval = std::chrono::seconds(5);
+
+} // namespace
+
+std::size_t BridgeMember::liveStreams() const {
+	std::size_t live = 0;
+	for (const auto& weak_conn : streams) {
+		auto conn = weak_conn.lock();
+		if (conn && conn->isOpen()) ++live;
+	}
+	return live;
+}
+
+std::size_t BridgeMember::inFlightBytes() const {
+	std::size_t bytes = 0;
+	for (const auto& weak_conn : streams) {
+		if (auto conn = weak_conn.lock()) bytes += conn->pendingWriteBytes();
+	}
+	return bytes;
+}
+
+SamBridgePool::SamBridgePool(net::io_context& io_ctx, std::vector<SamBridgeEndpoint> bridges)
+	: io_ctx_(io_ctx), name_cache_(std::make_shared<SamNameCache>(io_ctx.get_executor())),
+	  health_changed_(io_ctx.get_executor()) {
+	for (auto& endpoint : bridges) {
+		BridgeMember member;
+		member.endpoint = std::move(endpoint);
+		members_.push_back(std::move(member));
+	}
+}
+
+SamBridgePool::~SamBridgePool() {
+	shutdown();
+}
+
+bool SamBridgePool::parseList(const std::string& list, uint16_t default_port, std::vector<SamBridgeEndpoint>& bridges,
+	std::string& error_message) {
+	std::vector<SamBridgeEndpoint> parsed;
+	std::size_t start = 0;
+	while (start <= list.size()) {
+		std::size_t comma = list.find(',', start);
+		std::string item = list.substr(start, comma == std::string::npos ? std::string::npos : comma - start);
+		if (!item.empty()) {
+			SamBridgeEndpoint endpoint;
+			if (!SamBridgeEndpoint::parse(item, default_port, endpoint, error_message)) return false;
+			parsed.push_back(std::move(endpoint));
+		}
+		if (comma == std::string::npos) break;
+		start = comma + 1;
+	}
+	bridges = std::move(parsed);
+	return true;
+}
+
+void SamBridgePool::shutdown() {
+	running_ = false;
+	for (auto& m : members_) {
+		if (m.service) m.service->shutdown();
+		m.healthy = false;
+	}
+	health_changed_.notifyAll();
+}
+
+std::size_t SamBridgePool::healthyCount() const {
+	return std::count_if(members_.begin(), members_.end(), [](const BridgeMember& m) { return m.healthy; });
+}
+
+net::awaitable<bool> SamBridgePool::establishOn(std::size_t index) {
+	auto service = std::make_shared<SamService>(io_ctx_, members_[index].endpoint);
+	service->setNameCache(name_cache_);
+	EstablishSessionResult session;
+	try {
+		session = co_await service->establishControlSession(nickname_, private_key_, signature_type_, options_);
+	} catch (const std::exception& e) {
+		session.success = false;
+		session.error_message = e.what();
+	}
+	BridgeMember& m = members_[index];
+	if (!running_) {
+		service->shutdown();
+		co_return false;
+	}
+	if (!session.success) {
+		markFailed(index, session.error_message);
+		co_return false;
+	}
+	m.service = std::move(service);
+	m.session = std::move(session);
+	m.healthy = true;
+	m.consecutive_failures = 0;
+	m.sessions_established++;
+	SPDLOG_INFO("Bridge {} up: session '{}' as {}", m.endpoint.toString(), nickname_, m.session.local_b32_address);
+	health_changed_.notifyAll();
+	net::co_spawn(io_ctx_, watchMember(index, m.service), net::detached);
+	co_return true;
+}
+
+net::awaitable<void> SamBridgePool::watchMember(std::size_t index, std::shared_ptr<SamService> service) {
+	auto self = shared_from_this();
+	// A router that exits or restarts closes the control connection long before a connect notices.
+	co_await service->watchControlConnection();
+	if (running_ && members_[index].service == service && members_[index].healthy) {
+		markFailed(index, "control connection lost");
+	}
+}
+
+void SamBridgePool::markFailed(std::size_t index, const std::string& reason) {
+	BridgeMember& m = members_[index];
+	const bool was_healthy = m.healthy;
+	m.healthy = false;
+	m.consecutive_failures++;
+	// 2s, 4s, 8s ... capped at 2 minutes between attempts to bring the bridge back.
+	auto delay = std::chrono::seconds(std::min<long>(120, 1L << std::min<std::size_t>(m.consecutive_failures, 7)));
+	m.next_retry = SteadyClock::now() + delay;
+	if (m.service) m.service->shutdown();
+	if (was_healthy) SPDLOG_WARN("Bridge {} marked down: {}", m.endpoint.toString(), reason);
+	else SPDLOG_DEBUG("Bridge {} still down: {}", m.endpoint.toString(), reason);
+	health_changed_.notifyAll();
+}
+
+net::awaitable<std::size_t> SamBridgePool::establish(
+	const std::string& nickname,
+	const std::string& private_key_b64_or_transient,
+	const std::string& signature_type,
+	const std::map<std::string, std::string>& options) {
+
+	auto self = shared_from_this();
+	nickname_ = nickname;
+	private_key_ = private_key_b64_or_transient;
+	signature_type_ = signature_type;
+	options_ = options;
+	running_ = true;
+
+	// Owned by the workers too: they may outlive this frame if establish() is abandoned.
+	auto pending = std::make_shared<AsyncWaitGroup>(io_ctx_.get_executor());
+	for (std::size_t i = 0; i < members_.size(); ++i) {
+		pending->add();
+		net::co_spawn(io_ctx_, [this, self, i, pending]() -> net::awaitable<void> {
+			co_await establishOn(i);
+			pending->done();
+		}, net::detached);
+	}
+	co_await pending->wait();
+	net::co_spawn(io_ctx_, monitor(), net::detached);
+	SPDLOG_INFO("Bridge pool: session '{}' up on {}/{} bridges.", nickname_, healthyCount(), members_.size());
+	co_return healthyCount();
+}
+
+net::awaitable<void> SamBridgePool::monitor() {
+	auto self = shared_from_this();
+	net::steady_timer timer(io_ctx_);
+	while (running_) {
+		timer.expires_after(kMonitorInterval);
+		boost::system::error_code ec;
+		co_await timer.async_wait(net::redirect_error(net::use_awaitable, ec));
+		if (!running_) break;
+		for (std::size_t i = 0; i < members_.size(); ++i) {
+			BridgeMember& m = members_[i];
+			std::erase_if(m.streams, [](const std::weak_ptr<SamConnection>& w) { return w.expired(); });
+			if (m.healthy && (!m.service || !m.service->isOpen())) {
+				markFailed(i, "control connection lost");
+			}
+			if (!m.healthy && SteadyClock::now() >= m.next_retry) {
+				m.next_retry = SteadyClock::time_point::max(); // One re-establish at a time per bridge
+				net::co_spawn(io_ctx_, establishOn(i), net::detached);
+			}
+		}
+	}
+}
+
+std::size_t SamBridgePool::pickBridge(const std::vector<bool>& tried) {
+	std::size_t best = SIZE_MAX;
+	std::size_t best_load = SIZE_MAX;
+	for (std::size_t i = 0; i < members_.size(); ++i) {
+		const BridgeMember& m = members_[i];
+		if (!m.healthy || tried[i]) continue;
+		// Streams and setups dominate router CPU; unsent bytes break ties between equally busy bridges.
+		std::size_t load = (m.liveStreams() + m.pending_setups) * 1024 * 1024 + m.inFlightBytes();
+		if (load < best_load) {
+			best = i;
+			best_load = load;
+		}
+	}
+	return best;
+}
+
+net::awaitable<SetupStreamResult> SamBridgePool::connectToPeer(
+	const std::string& target_peer_i2p_address_b32,
+	const std::map<std::string, std::string>& stream_connect_options) {
+
+	auto self = shared_from_this();
+	std::vector<bool> tried(members_.size(), false);
+	SetupStreamResult result;
+	result.remote_peer_b32_address = target_peer_i2p_address_b32;
+	result.error_message = "No healthy SAM bridge.";
+
+	for (std::size_t attempt = 0; attempt < members_.size(); ++attempt) {
+		std::size_t index = pickBridge(tried);
+		if (index == SIZE_MAX) break;
+		tried[index] = true;
+		auto service = members_[index].service;
+		const std::string session_id = members_[index].session.created_session_id;
+
+		members_[index].pending_setups++;
+		result = co_await service->connectToPeerViaNewConnection(session_id, target_peer_i2p_address_b32, stream_connect_options);
+		members_[index].pending_setups--;
+
+		if (result.success && result.data_connection) {
+			members_[index].streams.push_back(result.data_connection);
+			members_[index].streams_opened++;
+			co_return result;
+		}
+		if (service->isOpen() && result.error_kind != SamErrorKind::BRIDGE) co_return result; // Another bridge would not help
+		if (members_[index].healthy && members_[index].service == service) {
+			members_[index].failovers++;
+			markFailed(index, result.error_message);
+		}
+		SPDLOG_WARN("Connect to {} via bridge {} failed, trying next bridge.", target_peer_i2p_address_b32,
+			members_[index].endpoint.toString());
+	}
+	co_return result;
+}
+
+void SamBridgePool::startAccepting(StreamHandler handler, std::size_t accepts_per_bridge) {
+	for (std::size_t i = 0; i < members_.size(); ++i) {
+		for (std::size_t n = 0; n < accepts_per_bridge; ++n) {
+			net::co_spawn(io_ctx_, acceptLoop(i, handler), net::detached);
+		}
+	}
+}
+
+net::awaitable<void> SamBridgePool::acceptLoop(std::size_t index, StreamHandler handler) {
+	auto self = shared_from_this();
+	while (running_) {
+		if (!members_[index].healthy) {
+			co_await health_changed_.wait(); // Resumes once the monitor re-established this bridge
+			continue;
+		}
+		auto service = members_[index].service;
+		const std::string session_id = members_[index].session.created_session_id;
+		SetupStreamResult accept_res = co_await service->acceptStreamViaNewConnection(session_id);
+		if (!running_) break;
+		if (!accept_res.success || !accept_res.data_connection) {
+			const bool bridge_down = !service->isOpen() || accept_res.error_kind == SamErrorKind::BRIDGE;
+			if (bridge_down && members_[index].service == service) {
+				// Wait for the monitor to bring the bridge back instead of retrying against it.
+				if (members_[index].healthy) markFailed(index, accept_res.error_message);
+				continue;
+			}
+			net::steady_timer backoff(io_ctx_, std::chrono::seconds(1));
+			co_await backoff.async_wait(net::use_awaitable);
+			continue;
+		}
+		members_[index].streams.push_back(accept_res.data_connection);
+		net::co_spawn(io_ctx_, handler(std::move(accept_res)), net::detached);
+	}
+}
+
+} // namespace SAM
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <map>
+#include <vector>
+#include <functional>
+#include <boost/asio.hpp>
+#include "SamService.h"
+#include "SamAsyncUtils.h"
+
+namespace net = boost::asio;
+
+namespace SAM {
+
+// One SAM bridge (router) of a SamBridgePool, with its session and health/load bookkeeping.
+struct BridgeMember {
+	SamBridgeEndpoint endpoint;
+	std::shared_ptr<SamService> service;
+	EstablishSessionResult session;
+	bool healthy = false;
+	std::size_t consecutive_failures = 0;
+	SteadyClock::time_point next_retry{};
+	std::vector<std::weak_ptr<SamConnection>> streams; // Live data connections through this bridge
+	std::size_t pending_setups = 0;                    // STREAM CONNECTs in progress
+	uint64_t streams_opened = 0;
+	uint64_t failovers = 0;                            // Connects moved away from this bridge after it failed
+	uint64_t sessions_established = 0;
+
+	std::size_t liveStreams() const;
+	std::size_t inFlightBytes() const;
+};
+
+// The same destination served through several SAM bridges (e.g. one i2pd per CPU group on the node).
+// establish() creates the session on every bridge in parallel; streams go to the healthy bridge with
+// the least load (live streams, connects in progress, unsent bytes); a connect whose bridge fails
+// (connection refused, HELLO or control session lost) is retried on the next bridge, and the failed
+// bridge is re-established in the background with exponential backoff. Accept loops run per bridge
+// and resume when their bridge comes back.
+// Not thread-safe: use from a single-threaded io_context (as the examples do) or from one strand.
+class SamBridgePool : public std::enable_shared_from_this<SamBridgePool> {
+public:
+	using StreamHandler = std::function<net::awaitable<void>(SetupStreamResult)>;
+
+	SamBridgePool(net::io_context& io_ctx, std::vector<SamBridgeEndpoint> bridges);
+	~SamBridgePool();
+
+	// Parses "host:port,unix:/path,..." into a bridge list; false (with error_message) if any entry is malformed.
+	static bool parseList(const std::string& list, uint16_t default_port, std::vector<SamBridgeEndpoint>& bridges,
+		std::string& error_message);
+
+	// Establishes the session on all bridges; returns how many came up. Bridges that failed keep
+	// being retried by the health monitor.
+	net::awaitable<std::size_t> establish(
+		const std::string& nickname,
+		const std::string& private_key_b64_or_transient,
+		const std::string& signature_type,
+		const std::map<std::string, std::string>& options = {
+			{"i2p.streaming.profile", "INTERACTIVE"}, 
+			{"inbound.length", "1"}, 
+			{"outbound.length", "1"}}
+	);
+
+	void startAccepting(StreamHandler handler, std::size_t accepts_per_bridge = 1);
+
+	net::awaitable<SetupStreamResult> connectToPeer(
+		const std::string& target_peer_i2p_address_b32,
+		const std::map<std::string, std::string>& stream_connect_options = {
+			{"i2p.streaming.profile", "INTERACTIVE"}, 
+			{"inbound.length", "1"}, 
+			{"outbound.length", "1"}}
+	);
+
+	std::size_t size() const { return members_.size(); }
+	std::size_t healthyCount() const;
+	const BridgeMember& member(std::size_t index) const { return members_.at(index); }
+
+	void shutdown();
+
+private:
+	net::awaitable<bool> establishOn(std::size_t index);
+	net::awaitable<void> monitor();
+	// Marks the bridge failed as soon as its control connection closes (router gone or restarted).
+	net::awaitable<void> watchMember(std::size_t index, std::shared_ptr<SamService> service);
+	net::awaitable<void> acceptLoop(std::size_t index, StreamHandler handler);
+	void markFailed(std::size_t index, const std::string& reason);
+	// Healthy bridge with the lowest load, skipping those in `tried`; SIZE_MAX if none.
+	std::size_t pickBridge(const std::vector<bool>& tried);
+
+	net::io_context& io_ctx_;
+	std::vector<BridgeMember> members_;
+	std::shared_ptr<SamNameCache> name_cache_;
+	std::string nickname_;
+	std::string private_key_;
+	std::string signature_type_;
+	std::map<std::string, std::string> options_;
+	AsyncCondition health_changed_;
+	bool running_ = false;
+};
+
+} // namespace SAM
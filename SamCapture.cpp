@@ -0,0 +1,196 @@
+#include "SamCapture.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace SAM {
+namespace Capture {
+
+std::atomic<bool> g_enabled{false};
+
+namespace {
+
+constexpr std::size_t kFlushThreshold = 64 * 1024;
+
+struct Writer {
+	std::ofstream out;
+	std::string pending;
+	std::chrono::steady_clock::time_point start;
+	uint64_t last_us = 0;
+	uint32_t next_connection = 0;
+	std::unordered_map<const void*, uint32_t> connections; // Open connections; a closed one's address may be reused
+};
+
+std::mutex g_mutex;
+Writer* g_writer = nullptr;
+
+void putVarint(std::string& out, uint64_t value) {
+	while (value >= 0x80) {
+		out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+		value >>= 7;
+	}
+	out.push_back(static_cast<char>(value));
+}
+
+bool getVarint(const std::string& in, std::size_t& pos, uint64_t& value) {
+	value = 0;
+	for (int shift = 0; shift < 64 && pos < in.size(); shift += 7) {
+		const auto byte = static_cast<uint8_t>(in[pos++]);
+		value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+		if (!(byte & 0x80)) return true;
+	}
+	return false;
+}
+
+// Keys must not end up in capture files: the value of PRIV= anywhere and of DESTINATION= in
+// SESSION lines (the private key in SESSION CREATE and in its reply).
+std::string redact(std::string_view line) {
+	std::string text(line);
+	if (!text.empty() && text.back() == '\n') text.pop_back();
+	auto blank = [&text](const std::string& key) {
+		for (std::size_t at = text.find(key); at != std::string::npos; at = text.find(key, at + 1)) {
+			if (at > 0 && text[at - 1] != ' ') continue;
+			const std::size_t value = at + key.size();
+			const std::size_t end = std::min(text.find(' ', value), text.size());
+			if (text.compare(value, end - value, "TRANSIENT") != 0) text.replace(value, end - value, "REDACTED");
+		}
+	};
+	blank("PRIV=");
+	if (text.starts_with("SESSION")) blank("DESTINATION=");
+	return text;
+}
+
+void appendRecord(Writer& writer, RecordType type, uint32_t connection, std::string_view text, uint64_t bytes) {
+	const uint64_t now_us = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - writer.start).count());
+	writer.pending.push_back(static_cast<char>(type));
+	putVarint(writer.pending, now_us - writer.last_us);
+	putVarint(writer.pending, connection);
+	writer.last_us = now_us;
+	if (type == RecordType::COMMAND || type == RecordType::REPLY) {
+		putVarint(writer.pending, text.size());
+		writer.pending.append(text);
+	} else if (type == RecordType::DATA_OUT || type == RecordType::DATA_IN) {
+		putVarint(writer.pending, bytes);
+	}
+}
+
+void flush(Writer& writer) {
+	writer.out.write(writer.pending.data(), static_cast<std::streamsize>(writer.pending.size()));
+	writer.pending.clear();
+}
+
+} // namespace
+
+bool start(const std::string& path) {
+	auto writer = std::make_unique<Writer>();
+	writer->out.open(path, std::ios::binary | std::ios::trunc);
+	if (!writer->out) return false;
+	writer->out.write(kFileMagic, sizeof(kFileMagic));
+	writer->start = std::chrono::steady_clock::now();
+	stop();
+	std::lock_guard<std::mutex> lock(g_mutex);
+	g_writer = writer.release();
+	g_enabled.store(true, std::memory_order_relaxed);
+	return true;
+}
+
+void stop() {
+	std::lock_guard<std::mutex> lock(g_mutex);
+	g_enabled.store(false, std::memory_order_relaxed);
+	if (!g_writer) return;
+	flush(*g_writer);
+	delete g_writer;
+	g_writer = nullptr;
+}
+
+void append(RecordType type, const void* connection, std::string_view text, uint64_t bytes) {
+	std::lock_guard<std::mutex> lock(g_mutex);
+	if (!g_writer) return;
+	Writer& writer = *g_writer;
+	if (type == RecordType::CLOSE && !writer.connections.contains(connection)) return; // Never captured
+	auto [it, inserted] = writer.connections.try_emplace(connection, writer.next_connection);
+	if (inserted) {
+		++writer.next_connection;
+		appendRecord(writer, RecordType::OPEN, it->second, {}, 0);
+	}
+	const uint32_t id = it->second;
+	if (type == RecordType::CLOSE) writer.connections.erase(it);
+	if (type == RecordType::COMMAND || type == RecordType::REPLY) appendRecord(writer, type, id, redact(text), bytes);
+	else if (type != RecordType::OPEN) appendRecord(writer, type, id, text, bytes);
+	if (writer.pending.size() >= kFlushThreshold) flush(writer);
+}
+
+bool readFile(const std::string& path, std::vector<Record>& records, std::string& error_message) {
+	std::ifstream in(path, std::ios::binary);
+	if (!in) {
+		error_message = "cannot open " + path;
+		return false;
+	}
+	std::string raw((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	if (raw.size() < sizeof(kFileMagic) || std::memcmp(raw.data(), kFileMagic, sizeof(kFileMagic)) != 0) {
+		error_message = path + " is not a SAM capture";
+		return false;
+	}
+	std::size_t pos = sizeof(kFileMagic);
+	uint64_t time_us = 0;
+	while (pos < raw.size()) {
+		Record record;
+		record.type = static_cast<RecordType>(raw[pos++]);
+		uint64_t delta = 0, connection = 0;
+		bool ok = getVarint(raw, pos, delta) && getVarint(raw, pos, connection);
+		time_us += delta;
+		record.time_us = time_us;
+		record.connection = static_cast<uint32_t>(connection);
+		switch (record.type) {
+		case RecordType::COMMAND:
+		case RecordType::REPLY: {
+			uint64_t length = 0;
+			ok = ok && getVarint(raw, pos, length) && length <= raw.size() - pos;
+			if (ok) {
+				record.text.assign(raw, pos, static_cast<std::size_t>(length));
+				pos += static_cast<std::size_t>(length);
+			}
+			break;
+		}
+		case RecordType::DATA_OUT:
+		case RecordType::DATA_IN:
+			ok = ok && getVarint(raw, pos, record.bytes);
+			break;
+		case RecordType::OPEN:
+		case RecordType::PEER_EOF:
+		case RecordType::CLOSE:
+			break;
+		default:
+			ok = false;
+		}
+		if (!ok) {
+			// A capture cut short (crash, kill) keeps every complete record before the damage.
+			error_message = "truncated or corrupt record at offset " + std::to_string(pos);
+			break;
+		}
+		records.push_back(std::move(record));
+	}
+	return true;
+}
+
+const char* recordTypeName(RecordType type) {
+	switch (type) {
+	case RecordType::OPEN: return "open";
+	case RecordType::COMMAND: return "command";
+	case RecordType::REPLY: return "reply";
+	case RecordType::DATA_OUT: return "data_out";
+	case RecordType::DATA_IN: return "data_in";
+	case RecordType::PEER_EOF: return "eof";
+	case RecordType::CLOSE: return "close";
+	}
+	return "unknown";
+}
+
+} // namespace Capture
+} // namespace SAM
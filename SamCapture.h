@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace SAM {
+namespace Capture {
+
+// Optional traffic capture for reproducing performance problems. While running it logs what crosses
+// every SamConnection: control lines (verbatim, except private keys), the size of each data chunk
+// and end-of-stream, each with a microsecond timestamp. Payload bytes are never written.
+// i2p_sam_replay plays a log back against a fake bridge at 1x or accelerated speed.
+//
+// File: magic(8), then records: type(1) delta_us(varint, since the previous record)
+// connection(varint, numbered by first appearance) and, per type, text (varint length + bytes)
+// or a byte count (varint). Records are buffered; stop() flushes them.
+
+enum class RecordType : uint8_t {
+	OPEN = 1,  // First record of a connection
+	COMMAND,   // Line sent to the bridge (text)
+	REPLY,     // Line received from the bridge (text)
+	DATA_OUT,  // Chunk written to the stream (bytes)
+	DATA_IN,   // Chunk read from the stream (bytes)
+	PEER_EOF,  // The bridge closed the stream
+	CLOSE,     // We closed (or handed off) the connection
+};
+
+constexpr char kFileMagic[8] = {'S', 'A', 'M', 'C', 'A', 'P', '0', '1'};
+
+struct Record {
+	RecordType type = RecordType::OPEN;
+	uint64_t time_us = 0; // Since the first record
+	uint32_t connection = 0;
+	uint64_t bytes = 0;
+	std::string text;
+};
+
+extern std::atomic<bool> g_enabled;
+
+bool start(const std::string& path); // Starts a new log; false if the file cannot be created
+void stop();
+
+void append(RecordType type, const void* connection, std::string_view text, uint64_t bytes);
+
+inline void line(RecordType type, const void* connection, std::string_view text) {
+	if (!g_enabled.load(std::memory_order_relaxed)) return;
+	append(type, connection, text, 0);
+}
+
+inline void data(RecordType type, const void* connection, uint64_t bytes) {
+	if (bytes == 0 || !g_enabled.load(std::memory_order_relaxed)) return;
+	append(type, connection, {}, bytes);
+}
+
+inline void event(RecordType type, const void* connection) {
+	if (!g_enabled.load(std::memory_order_relaxed)) return;
+	append(type, connection, {}, 0);
+}
+
+bool readFile(const std::string& path, std::vector<Record>& records, std::string& error_message);
+
+const char* recordTypeName(RecordType type);
+
+} // namespace Capture
+} // namespace SAM
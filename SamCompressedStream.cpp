@@ -0,0 +1,189 @@
+#include "SamCompressedStream.h"
+#include <zlib.h>
+#include <array>
+
+namespace SAM {
+
+namespace {
+
+// Per-thread free lists of initialised zlib states. Allocating a deflate state costs ~256 KB of
+// window/hash tables, so streams borrow one and hand it back reset when they end.
+struct ZStreamPool {
+	std::vector<z_stream*> deflaters;
+	std::vector<z_stream*> inflaters;
+	int deflate_level = -1;
+
+	~ZStreamPool() {
+		for (auto* z : deflaters) { deflateEnd(z); delete z; }
+		for (auto* z : inflaters) { inflateEnd(z); delete z; }
+	}
+};
+
+thread_local ZStreamPool t_zpool;
+constexpr std::size_t kPoolLimit = 16;
+constexpr char kHelloMagic[2] = {'S', 'Z'};
+constexpr char kHelloVersion = 1;
+constexpr char kFlagDeflate = 0x01;
+
+z_stream* acquireDeflater(int level) {
+	if (t_zpool.deflate_level == level && !t_zpool.deflaters.empty()) {
+		z_stream* z = t_zpool.deflaters.back();
+		t_zpool.deflaters.pop_back();
+		return z;
+	}
+	auto* z = new z_stream{};
+	if (deflateInit(z, level) != Z_OK) {
+		delete z;
+		throw std::runtime_error("SamCompressedStream: deflateInit failed");
+	}
+	return z;
+}
+
+void releaseDeflater(z_stream* z, int level) {
+	if (!z) return;
+	if (t_zpool.deflate_level != level) {
+		for (auto* old : t_zpool.deflaters) { deflateEnd(old); delete old; }
+		t_zpool.deflaters.clear();
+		t_zpool.deflate_level = level;
+	}
+	if (t_zpool.deflaters.size() < kPoolLimit && deflateReset(z) == Z_OK) {
+		t_zpool.deflaters.push_back(z);
+	} else {
+		deflateEnd(z);
+		delete z;
+	}
+}
+
+z_stream* acquireInflater() {
+	if (!t_zpool.inflaters.empty()) {
+		z_stream* z = t_zpool.inflaters.back();
+		t_zpool.inflaters.pop_back();
+		return z;
+	}
+	auto* z = new z_stream{};
+	if (inflateInit(z) != Z_OK) {
+		delete z;
+		throw std::runtime_error("SamCompressedStream: inflateInit failed");
+	}
+	return z;
+}
+
+void releaseInflater(z_stream* z) {
+	if (!z) return;
+	if (t_zpool.inflaters.size() < kPoolLimit && inflateReset(z) == Z_OK) {
+		t_zpool.inflaters.push_back(z);
+	} else {
+		inflateEnd(z);
+		delete z;
+	}
+}
+
+} // namespace
+
+SamCompressedStream::SamCompressedStream(std::shared_ptr<SamConnection> connection, int level)
+	: connection_(std::move(connection)), level_(level), in_buffer_(16 * 1024) {
+}
+
+SamCompressedStream::~SamCompressedStream() {
+	releaseDeflater(deflater_, level_);
+	releaseInflater(inflater_);
+}
+
+net::awaitable<bool> SamCompressedStream::negotiate(bool enable, SteadyClock::duration timeout) {
+	std::array<char, 4> hello = { kHelloMagic[0], kHelloMagic[1], kHelloVersion, enable ? kFlagDeflate : char(0) };
+	co_await connection_->streamWrite(net::buffer(hello), timeout);
+
+	std::array<char, 4> peer_hello{};
+	std::size_t got = 0;
+	while (got < peer_hello.size()) {
+		std::size_t n = co_await connection_->streamRead(net::buffer(peer_hello.data() + got, peer_hello.size() - got), timeout);
+		if (n == 0) throw boost::system::system_error(net::error::eof, "SamCompressedStream: peer closed during negotiation");
+		got += n;
+	}
+	if (peer_hello[0] != kHelloMagic[0] || peer_hello[1] != kHelloMagic[1]) {
+		throw boost::system::system_error(net::error::invalid_argument, "SamCompressedStream: peer did not negotiate compression");
+	}
+
+	active_ = enable && (peer_hello[3] & kFlagDeflate) && peer_hello[2] == kHelloVersion;
+	if (active_) {
+		deflater_ = acquireDeflater(level_);
+		inflater_ = acquireInflater();
+	}
+	SPDLOG_INFO("SamCompressedStream: compression {}", active_ ? "enabled" : "disabled");
+	co_return active_;
+}
+
+net::awaitable<void> SamCompressedStream::streamWrite(net::const_buffer buffer, SteadyClock::duration timeout) {
+	if (!active_) {
+		co_await connection_->streamWrite(buffer, timeout);
+		stats_.raw_bytes_out += buffer.size();
+		stats_.wire_bytes_out += buffer.size();
+		co_return;
+	}
+
+	auto started = SteadyClock::now();
+	deflater_->next_in = reinterpret_cast<Bytef*>(const_cast<void*>(buffer.data()));
+	deflater_->avail_in = static_cast<uInt>(buffer.size());
+	std::size_t produced = 0;
+	// deflateBound plus room for the sync-flush marker is normally enough for a single pass.
+	out_buffer_.resize(deflateBound(deflater_, static_cast<uLong>(buffer.size())) + 16);
+	do {
+		if (produced == out_buffer_.size()) out_buffer_.resize(out_buffer_.size() * 2);
+		deflater_->next_out = reinterpret_cast<Bytef*>(out_buffer_.data() + produced);
+		deflater_->avail_out = static_cast<uInt>(out_buffer_.size() - produced);
+		int rc = deflate(deflater_, Z_SYNC_FLUSH);
+		if (rc != Z_OK && rc != Z_BUF_ERROR) {
+			throw std::runtime_error("SamCompressedStream: deflate failed");
+		}
+		produced = out_buffer_.size() - deflater_->avail_out;
+	} while (deflater_->avail_out == 0);
+	stats_.deflate_time += SteadyClock::now() - started;
+
+	co_await connection_->streamWrite(net::buffer(out_buffer_.data(), produced), timeout);
+	stats_.raw_bytes_out += buffer.size();
+	stats_.wire_bytes_out += produced;
+}
+
+net::awaitable<std::size_t> SamCompressedStream::streamRead(net::mutable_buffer buffer, SteadyClock::duration timeout) {
+	if (!active_) {
+		std::size_t n = co_await connection_->streamRead(buffer, timeout);
+		stats_.raw_bytes_in += n;
+		stats_.wire_bytes_in += n;
+		co_return n;
+	}
+	if (inflate_finished_) {
+		throw boost::system::system_error(net::error::eof, "SamCompressedStream: compressed stream ended");
+	}
+
+	for (;;) {
+		if (in_offset_ < in_size_) {
+			auto started = SteadyClock::now();
+			inflater_->next_in = reinterpret_cast<Bytef*>(in_buffer_.data() + in_offset_);
+			inflater_->avail_in = static_cast<uInt>(in_size_ - in_offset_);
+			inflater_->next_out = static_cast<Bytef*>(buffer.data());
+			inflater_->avail_out = static_cast<uInt>(buffer.size());
+			int rc = inflate(inflater_, Z_SYNC_FLUSH);
+			stats_.inflate_time += SteadyClock::now() - started;
+			if (rc != Z_OK && rc != Z_BUF_ERROR && rc != Z_STREAM_END) {
+				throw std::runtime_error("SamCompressedStream: inflate failed (corrupt stream)");
+			}
+			in_offset_ = in_size_ - inflater_->avail_in;
+			if (rc == Z_STREAM_END) inflate_finished_ = true;
+			std::size_t produced = buffer.size() - inflater_->avail_out;
+			if (produced > 0) {
+				stats_.raw_bytes_in += produced;
+				co_return produced;
+			}
+			if (inflate_finished_) {
+				throw boost::system::system_error(net::error::eof, "SamCompressedStream: compressed stream ended");
+			}
+		}
+		// Need more compressed input.
+		in_size_ = co_await connection_->streamRead(net::buffer(in_buffer_), timeout);
+		in_offset_ = 0;
+		stats_.wire_bytes_in += in_size_;
+		if (in_size_ == 0) co_return 0;
+	}
+}
+
+} // namespace SAM
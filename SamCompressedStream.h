@@ -0,0 +1,70 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <vector>
+#include <chrono>
+#include <boost/asio.hpp>
+#include "SamConnection.h"
+
+namespace net = boost::asio;
+
+struct z_stream_s; // zlib's stream state; kept out of the public header
+
+namespace SAM {
+
+struct CompressionStats {
+	uint64_t raw_bytes_out = 0;   // Application bytes passed to streamWrite
+	uint64_t wire_bytes_out = 0;  // Bytes actually written to the I2P stream
+	uint64_t wire_bytes_in = 0;
+	uint64_t raw_bytes_in = 0;
+	std::chrono::nanoseconds deflate_time{0};
+	std::chrono::nanoseconds inflate_time{0};
+
+	double outboundRatio() const { return wire_bytes_out ? double(raw_bytes_out) / double(wire_bytes_out) : 1.0; }
+	// CPU spent compressing per MB of application data
+	double deflateMsPerMB() const {
+		return raw_bytes_out ? (deflate_time.count() / 1e6) / (double(raw_bytes_out) / (1024.0 * 1024.0)) : 0.0;
+	}
+};
+
+// Optional per-stream compression on a data-mode SamConnection. Both ends call negotiate() right after
+// the stream is set up; each sends a 4-byte hello and deflate is used in a direction only if both
+// sides asked for it, otherwise bytes pass through unchanged. Outbound data is one continuous deflate
+// stream flushed (Z_SYNC_FLUSH) at the end of every streamWrite, so each message can be decoded as soon
+// as it arrives while later messages still benefit from the shared dictionary. zlib states are taken
+// from and returned to a per-thread pool (deflateReset/inflateReset) instead of being reallocated.
+class SamCompressedStream {
+public:
+	explicit SamCompressedStream(std::shared_ptr<SamConnection> connection, int level = 6);
+	~SamCompressedStream();
+	SamCompressedStream(const SamCompressedStream&) = delete;
+	SamCompressedStream& operator=(const SamCompressedStream&) = delete;
+
+	// Returns true if compression is active (both peers enabled it).
+	net::awaitable<bool> negotiate(bool enable, SteadyClock::duration timeout = std::chrono::seconds(30));
+
+	net::awaitable<std::size_t> streamRead(net::mutable_buffer buffer, 
+		SteadyClock::duration timeout = std::chrono::minutes(5));
+	net::awaitable<void> streamWrite(net::const_buffer buffer, 
+		SteadyClock::duration timeout = std::chrono::seconds(30));
+
+	bool compressionActive() const { return active_; }
+	const CompressionStats& stats() const { return stats_; }
+	std::shared_ptr<SamConnection> connection() const { return connection_; }
+
+private:
+	std::shared_ptr<SamConnection> connection_;
+	int level_;
+	bool active_ = false;
+	z_stream_s* deflater_ = nullptr;
+	z_stream_s* inflater_ = nullptr;
+	std::string out_buffer_;      // Reused deflate output
+	std::vector<char> in_buffer_; // Compressed bytes read from the wire, not yet inflated
+	std::size_t in_offset_ = 0;
+	std::size_t in_size_ = 0;
+	bool inflate_finished_ = false;
+	CompressionStats stats_;
+};
+
+} // namespace SAM
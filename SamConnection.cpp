@@ -1,7 +1,19 @@
 #include "SamConnection.h"
+#include "EmbeddedRouter.h"
+#include "SamTrace.h"
+#include "SamCapture.h"
 #include <iostream>
+#include <array>
+#include <charconv>
 #include <boost/asio/experimental/awaitable_operators.hpp> // For operator||
 #include <boost/asio/post.hpp>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <sys/sendfile.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
 
 namespace SAM {
 
@@ -20,8 +32,8 @@ private:
 };
 
 SamConnection::SamConnection(net::io_context &io_ctx)
-	: io_ctx_(io_ctx), socket_(io_ctx), parser_(), cancel_timer_(io_ctx), 
-	  write_strand_(net::make_strand(io_ctx))
+	: io_ctx_(io_ctx), socket_(io_ctx), parser_(), control_slot_(io_ctx), read_slot_(io_ctx), write_slot_(io_ctx),
+	  control_idle_(io_ctx.get_executor()), write_strand_(net::make_strand(io_ctx))
 { 	// parser_ is default constructed
 	// std::cout << "[SamConnection:" << this << "] Created." << std::endl;
 }
@@ -33,6 +45,8 @@ SamConnection::~SamConnection()
 		// std::cerr << "[SamConnection:" << this << "] Destructor: Socket still open. Forcing close." << std::endl;
 		closeSocket();
 	}
+	if (egress_)
+		egress_->unregisterStream(this);
 	// std::cout << "[SamConnection:" << this << "] Destroyed." << std::endl;
 }
 
@@ -41,14 +55,56 @@ void SamConnection::setState(ConnectionState new_state)
 	// std::cout << "[SamConnection:" << this << " DEBUG] State: "
 	//           << static_cast<int>(current_state_) << " -> "
 	//           << static_cast<int>(new_state) << std::endl;
+	if (new_state != current_state_)
+	{
+		Trace::record(Trace::EventType::STATE_CHANGE, this,
+			(static_cast<uint64_t>(current_state_) << 8) | static_cast<uint64_t>(new_state));
+		if (new_state == ConnectionState::CLOSED)
+			Capture::event(Capture::RecordType::CLOSE, this);
+	}
 	current_state_ = new_state;
 }
 
+void SamConnection::OperationSlot::arm(SteadyClock::duration timeout)
+{
+	if (timeout <= SteadyClock::duration::zero() || timeout == SteadyClock::duration::max())
+		timer.expires_at(SteadyClock::time_point::max());
+	else
+		timer.expires_after(timeout);
+}
+
+void SamConnection::OperationSlot::cancel()
+{
+	timer.cancel();
+	signal.emit(net::cancellation_type::all);
+}
+
 void SamConnection::cancel_read_operations()
 {
-	SPDLOG_INFO("SamConnection: cancel_read_operations called, cancel the timer.");
-	//closeSocket();
-	cancel_timer_.cancel();
+	SPDLOG_DEBUG("SamConnection: cancel_read_operations called, cancel the read slots.");
+	read_slot_.cancel();
+	control_slot_.cancel();
+}
+
+void SamConnection::cancel_write_operations()
+{
+	SPDLOG_DEBUG("SamConnection: cancel_write_operations called, cancel the write slot.");
+	write_slot_.cancel();
+}
+
+const char *SamConnection::ioBackendName()
+{
+#if defined(BOOST_ASIO_HAS_IO_URING) && defined(BOOST_ASIO_DISABLE_EPOLL)
+	return "io_uring";
+#elif defined(BOOST_ASIO_HAS_EPOLL)
+	return "epoll";
+#elif defined(BOOST_ASIO_HAS_KQUEUE)
+	return "kqueue";
+#elif defined(BOOST_ASIO_HAS_IOCP)
+	return "iocp";
+#else
+	return "select";
+#endif
 }
 
 bool SamConnection::isOpen() const
@@ -59,9 +115,131 @@ bool SamConnection::isOpen() const
 		   (current_state_ != ConnectionState::ERROR_STATE);
 }
 
+SamBridgeEndpoint SamBridgeEndpoint::tcp(const std::string &host, uint16_t port)
+{
+	SamBridgeEndpoint ep;
+	ep.host = host;
+	ep.port = port;
+	return ep;
+}
+
+SamBridgeEndpoint SamBridgeEndpoint::local(const std::string &path)
+{
+	SamBridgeEndpoint ep;
+	ep.unix_path = path;
+	return ep;
+}
+
+SamBridgeEndpoint SamBridgeEndpoint::inProcess()
+{
+	SamBridgeEndpoint ep;
+	ep.embedded = true;
+	return ep;
+}
+
+bool SamBridgeEndpoint::parse(const std::string &spec, uint16_t default_port, SamBridgeEndpoint &endpoint,
+	std::string &error_message)
+{
+	if (spec == "embedded")
+	{
+		endpoint = inProcess();
+		return true;
+	}
+	static const std::string unix_prefix = "unix:";
+	if (spec.compare(0, unix_prefix.size(), unix_prefix) == 0)
+	{
+		if (spec.size() == unix_prefix.size())
+		{
+			error_message = "empty Unix socket path in '" + spec + "'";
+			return false;
+		}
+		endpoint = local(spec.substr(unix_prefix.size()));
+		return true;
+	}
+
+	std::string host = spec;
+	std::string port_text;
+	if (!spec.empty() && spec.front() == '[')
+	{ // "[v6]" or "[v6]:port"
+		const size_t close = spec.find(']');
+		if (close == std::string::npos || (close + 1 < spec.size() && spec[close + 1] != ':'))
+		{
+			error_message = "malformed bracketed address '" + spec + "'";
+			return false;
+		}
+		host = spec.substr(1, close - 1);
+		if (close + 1 < spec.size())
+		{
+			port_text = spec.substr(close + 2);
+			if (port_text.empty())
+			{
+				error_message = "missing port in '" + spec + "'";
+				return false;
+			}
+		}
+	}
+	else if (const size_t colon = spec.find(':'); colon != std::string::npos && spec.find(':', colon + 1) == std::string::npos)
+	{ // "host:port"; more than one colon is a bare IPv6 address without port
+		host = spec.substr(0, colon);
+		port_text = spec.substr(colon + 1);
+		if (port_text.empty())
+		{
+			error_message = "missing port in '" + spec + "'";
+			return false;
+		}
+	}
+	if (host.empty())
+	{
+		error_message = "missing host in '" + spec + "'";
+		return false;
+	}
+
+	uint16_t port = default_port;
+	if (!port_text.empty())
+	{
+		unsigned long value = 0;
+		const char *end = port_text.data() + port_text.size();
+		auto [ptr, ec] = std::from_chars(port_text.data(), end, value);
+		if (ec != std::errc() || ptr != end || value == 0 || value > 65535)
+		{
+			error_message = "invalid port '" + port_text + "' in '" + spec + "'";
+			return false;
+		}
+		port = static_cast<uint16_t>(value);
+	}
+	endpoint = tcp(host, port);
+	return true;
+}
+
+std::string SamBridgeEndpoint::toString() const
+{
+	if (embedded)
+		return "embedded";
+	if (isLocal())
+		return "unix:" + unix_path;
+	if (host.find(':') != std::string::npos)
+		return "[" + host + "]:" + std::to_string(port);
+	return host + ":" + std::to_string(port);
+}
+
 net::awaitable<bool> SamConnection::connect(
 	const std::string &host, uint16_t port, SteadyClock::duration timeout)
 {
+	co_return co_await connect(SamBridgeEndpoint::tcp(host, port), timeout);
+}
+
+net::awaitable<bool> SamConnection::connect(
+	const SamBridgeEndpoint &bridge, SteadyClock::duration timeout)
+{
+	if (bridge.embedded)
+	{
+		if (!EmbeddedRouter::isRunning())
+		{
+			SPDLOG_ERROR("Connect to embedded bridge requested, but EmbeddedRouter is not running.");
+			co_return false;
+		}
+		co_return co_await connect(EmbeddedRouter::samEndpoint(), timeout);
+	}
 	if (current_state_ != ConnectionState::DISCONNECTED && current_state_ != ConnectionState::CLOSED)
 	{
 		SPDLOG_ERROR("Connect called in invalid state: {}", static_cast<int>(current_state_));
@@ -70,10 +248,19 @@ net::awaitable<bool> SamConnection::connect(
 	setState(ConnectionState::CONNECTING);
 	try
 	{
-		net::ip::tcp::resolver resolver(io_ctx_);
-		// Use co_spawn for resolve if it needs to be explicitly on io_ctx for some reason,
-		// but async_resolve itself returns an awaitable when used with use_awaitable.
-		auto endpoints = co_await resolver.async_resolve(host, std::to_string(port), net::use_awaitable);
+		std::vector<net::generic::stream_protocol::endpoint> endpoints;
+		if (bridge.isLocal())
+		{
+			// Same-machine bridge: no resolver round-trip, no loopback TCP stack.
+			endpoints.emplace_back(net::local::stream_protocol::endpoint(bridge.unix_path));
+		}
+		else
+		{
+			net::ip::tcp::resolver resolver(io_ctx_);
+			auto resolved = co_await resolver.async_resolve(bridge.host, std::to_string(bridge.port), net::use_awaitable);
+			for (const auto &entry : resolved)
+				endpoints.emplace_back(entry.endpoint());
+		}
 
 		// std::cout << "[SamConnection:" << this << "] Connecting to " << host << ":" << port << "..." << std::endl;
 
@@ -87,7 +274,8 @@ net::awaitable<bool> SamConnection::connect(
 
 		if (result_variant.index() == 1)
 		{ // Timer expired
-			SPDLOG_ERROR("Timeout connecting to {}:{}", host, port);
+			SPDLOG_ERROR("Timeout connecting to {}", bridge.toString());
+			Trace::record(Trace::EventType::TIMEOUT, this, static_cast<uint64_t>(Trace::Op::CONNECT));
 			boost::system::error_code ec;
 			socket_.close(ec);                       // Ensure socket is closed
 			setState(ConnectionState::DISCONNECTED); // Or ERROR_STATE if timeout is considered an error
@@ -96,7 +284,7 @@ net::awaitable<bool> SamConnection::connect(
 		// If index is 0, connect succeeded. An exception would have been thrown for other connect errors.
 
 		setState(ConnectionState::CONNECTED_NO_HELLO);
-		SPDLOG_INFO("Connected to {}:{}", host, port);
+		SPDLOG_INFO("Connected to {}", bridge.toString());
 		co_return true;
 	}
 	catch (const boost::system::system_error &e)
@@ -113,6 +301,79 @@ net::awaitable<bool> SamConnection::connect(
 	}
 }
 
+bool SamConnection::adoptSocket(socket_type socket)
+{
+	if (current_state_ != ConnectionState::DISCONNECTED && current_state_ != ConnectionState::CLOSED)
+	{
+		SPDLOG_ERROR("adoptSocket called in invalid state: {}", static_cast<int>(current_state_));
+		return false;
+	}
+	if (!socket.is_open())
+		return false;
+	socket_ = std::move(socket);
+	read_streambuf_.consume(read_streambuf_.size());
+	setState(ConnectionState::CONNECTED_NO_HELLO);
+	return true;
+}
+
+bool SamConnection::adoptNativeHandle(int fd, ConnectionState state, const std::string &buffered)
+{
+	if (current_state_ != ConnectionState::DISCONNECTED && current_state_ != ConnectionState::CLOSED)
+	{
+		SPDLOG_ERROR("adoptNativeHandle called in invalid state: {}", static_cast<int>(current_state_));
+		return false;
+	}
+	sockaddr_storage addr{};
+	socklen_t addr_len = sizeof(addr);
+	if (fd < 0 || ::getsockname(fd, reinterpret_cast<sockaddr *>(&addr), &addr_len) != 0)
+	{
+		SPDLOG_ERROR("adoptNativeHandle: descriptor {} is not a socket", fd);
+		return false;
+	}
+	const int family = addr.ss_family;
+	boost::system::error_code ec;
+	socket_.assign(net::generic::stream_protocol(family, family == AF_UNIX ? 0 : IPPROTO_TCP), fd, ec);
+	if (ec)
+	{
+		SPDLOG_ERROR("adoptNativeHandle: assign failed: {}", ec.message());
+		return false;
+	}
+	read_streambuf_.consume(read_streambuf_.size());
+	if (!buffered.empty())
+	{
+		auto dest = read_streambuf_.prepare(buffered.size());
+		net::buffer_copy(dest, net::buffer(buffered));
+		read_streambuf_.commit(buffered.size());
+	}
+	setState(state);
+	return true;
+}
+
+std::string SamConnection::bufferedBytes() const
+{
+	auto data = read_streambuf_.data();
+	return std::string(net::buffers_begin(data), net::buffers_end(data));
+}
+
+int SamConnection::releaseNativeHandle()
+{
+	if (!socket_.is_open())
+		return -1;
+	control_slot_.cancel();
+	read_slot_.cancel();
+	write_slot_.cancel();
+	boost::system::error_code ec;
+	int fd = socket_.release(ec);
+	if (ec)
+	{
+		SPDLOG_ERROR("releaseNativeHandle failed: {}", ec.message());
+		return -1;
+	}
+	read_streambuf_.consume(read_streambuf_.size());
+	setState(ConnectionState::CLOSED);
+	return fd;
+}
+
 net::awaitable<SAM::ParsedMessage> SamConnection::performHello(SteadyClock::duration timeout)
 {
 	if (current_state_ != ConnectionState::CONNECTED_NO_HELLO)
@@ -125,6 +386,8 @@ net::awaitable<SAM::ParsedMessage> SamConnection::performHello(SteadyClock::dura
 	{
 		std::string hello_cmd = "HELLO VERSION MIN=3.1 MAX=3.2\n";
 		co_await net::async_write(socket_, net::buffer(hello_cmd), net::use_awaitable);
+		Trace::record(Trace::EventType::COMMAND_SENT, this, hello_cmd.size());
+		Capture::line(Capture::RecordType::COMMAND, this, hello_cmd);
 		// std::cout << "[SamConnection:" << this << " DEBUG] Sent: " << hello_cmd;
 		std::string reply_str = co_await readLine(timeout);
 		parsed_reply = parser_.parse(reply_str);
@@ -148,6 +411,8 @@ net::awaitable<SAM::ParsedMessage> SamConnection::performHello(SteadyClock::dura
 		setState(ConnectionState::ERROR_STATE);
 		parsed_reply.type = SAM::MessageType::UNKNOWN_OR_ERROR;
 		parsed_reply.message_text = e.what();
+		if (const auto *error = dynamic_cast<const boost::system::system_error *>(&e))
+			parsed_reply.error = error->code();
 	}
 	co_return parsed_reply;
 }
@@ -155,6 +420,24 @@ net::awaitable<SAM::ParsedMessage> SamConnection::performHello(SteadyClock::dura
 net::awaitable<SAM::ParsedMessage> SamConnection::sendCommandAndWaitReply(
 	const std::string &command, SteadyClock::duration reply_timeout)
 {
+	co_return co_await exchange(command, reply_timeout, false);
+}
+
+net::awaitable<SAM::ParsedMessage> SamConnection::namingLookup(
+	const std::string &name, SteadyClock::duration reply_timeout)
+{
+	co_return co_await exchange("NAMING LOOKUP NAME=" + name, reply_timeout, true);
+}
+
+net::awaitable<SAM::ParsedMessage> SamConnection::exchange(
+	const std::string &command, SteadyClock::duration reply_timeout, bool keep_open_on_timeout)
+{
+	// A command and its reply line form one exchange; concurrent callers take turns.
+	while (control_busy_)
+		co_await control_idle_.wait();
+	control_busy_ = true;
+	ControlTurn turn{*this};
+
 	// Prerequisite state for most commands after HELLO
 	if (current_state_ != ConnectionState::HELLO_OK)
 	{
@@ -171,26 +454,117 @@ net::awaitable<SAM::ParsedMessage> SamConnection::sendCommandAndWaitReply(
 		}
 		// std::cout << "[SamConnection:" << this << " DEBUG] Sending: " << command;
 		co_await net::async_write(socket_, net::buffer(full_command), net::use_awaitable);
-		std::string reply_str = co_await readLine(reply_timeout);
-		parsed_reply = parser_.parse(reply_str);
+		Trace::record(Trace::EventType::COMMAND_SENT, this, full_command.size());
+		Capture::line(Capture::RecordType::COMMAND, this, full_command);
+		for (;;)
+		{
+			std::string reply_str = co_await readLine(reply_timeout);
+			parsed_reply = parser_.parse(reply_str);
+			// The bridge answers in order, so replies to timed-out lookups arrive ahead of ours.
+			if (late_naming_replies_ > 0 && parsed_reply.type == SAM::MessageType::NAMING_REPLY)
+			{
+				--late_naming_replies_;
+				SPDLOG_DEBUG("Skipping late NAMING REPLY for {}", parsed_reply.name);
+				continue;
+			}
+			late_naming_replies_ = 0; // Any still missing will not come any more
+			break;
+		}
 	}
 	catch (const std::exception &e)
 	{
-		SPDLOG_ERROR("Exception during sendCommandAndWaitReply for '{}': {}", command, e.what());
-		closeSocket();
-		setState(ConnectionState::ERROR_STATE);
+		const auto *error = dynamic_cast<const boost::system::system_error *>(&e);
+		if (keep_open_on_timeout && error && error->code() == net::error::timed_out)
+		{
+			SPDLOG_WARN("No reply to '{}' in time; the connection stays open.", command);
+			++late_naming_replies_;
+		}
+		else
+		{
+			SPDLOG_ERROR("Exception during sendCommandAndWaitReply for '{}': {}", command, e.what());
+			closeSocket();
+			setState(ConnectionState::ERROR_STATE);
+		}
+		parsed_reply = SAM::ParsedMessage();
 		parsed_reply.type = SAM::MessageType::UNKNOWN_OR_ERROR;
 		parsed_reply.message_text = e.what();
+		if (error)
+			parsed_reply.error = error->code();
 	}
 	co_return parsed_reply;
 }
 
+net::awaitable<void> SamConnection::watchUntilClosed()
+{
+	while (isOpen())
+	{
+		if (control_busy_)
+		{
+			co_await control_idle_.wait();
+			continue;
+		}
+		if (read_streambuf_.size() == 0)
+		{
+			boost::system::error_code ec;
+			co_await socket_.async_wait(net::socket_base::wait_read, net::redirect_error(net::use_awaitable, ec));
+			if (ec == net::error::operation_aborted || !isOpen())
+				co_return; // Closed, released or cancelled
+			if (control_busy_)
+				continue; // The bytes are the reply an exchange is waiting for
+			char probe;
+			ssize_t n = ::recv(socket_.native_handle(), &probe, 1, MSG_PEEK | MSG_DONTWAIT);
+			if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+				continue;
+			if (n <= 0)
+			{
+				SPDLOG_WARN("SamConnection: control connection lost: {}", n == 0 ? "closed by the bridge" : std::strerror(errno));
+				if (n == 0)
+					Trace::record(Trace::EventType::PEER_EOF, this);
+				closeSocket();
+				setState(ConnectionState::ERROR_STATE);
+				co_return;
+			}
+		}
+
+		// A line nobody asked for: take the turn so no exchange reads it as its reply.
+		control_busy_ = true;
+		ControlTurn turn{*this};
+		try
+		{
+			std::string line = co_await readLine(std::chrono::seconds(10));
+			if (line.starts_with("PING"))
+			{
+				std::string pong = "PONG" + line.substr(4) + "\n";
+				co_await net::async_write(socket_, net::buffer(pong), net::use_awaitable);
+				Trace::record(Trace::EventType::COMMAND_SENT, this, pong.size());
+			}
+			else if (late_naming_replies_ > 0 && parser_.parse(line).type == SAM::MessageType::NAMING_REPLY)
+			{
+				--late_naming_replies_;
+				SPDLOG_DEBUG("Dropped late NAMING REPLY on control connection.");
+			}
+			else
+			{
+				SPDLOG_DEBUG("Unsolicited line on control connection: {}", line);
+			}
+		}
+		catch (const boost::system::system_error &e)
+		{
+			if (e.code() == net::error::operation_aborted)
+				co_return; // Cancelled; a partial line stays buffered
+			SPDLOG_WARN("SamConnection: control connection lost: {}", e.what());
+			closeSocket();
+			setState(ConnectionState::ERROR_STATE);
+			co_return;
+		}
+	}
+}
+
 net::awaitable<std::string> SamConnection::readLine(SteadyClock::duration timeout_duration)
 {
 	std::string line;
-	//net::steady_timer timer(io_ctx_); // Timer per readLine call
-	//timer.expires_after(timeout_duration);
-	cancel_timer_.expires_after(timeout_duration);
+	// SAM reply lines use the control slot, so a pending streamRead/streamWrite is never disturbed.
+	control_slot_.arm(timeout_duration);
 	using namespace net::experimental::awaitable_operators;
 
 	try
@@ -198,20 +572,24 @@ net::awaitable<std::string> SamConnection::readLine(SteadyClock::duration timeou
 		boost::system::error_code ec;
 		auto result_variant = co_await (
 			net::async_read_until(socket_, read_streambuf_, '\n', net::use_awaitable) ||
-			cancel_timer_.async_wait(net::redirect_error(net::use_awaitable, ec)));
+			control_slot_.timer.async_wait(net::redirect_error(net::use_awaitable, ec)));
 
 		if (result_variant.index() == 1)
 		{
 			if (ec == net::error::operation_aborted) {
-				SPDLOG_INFO("SamConnection: readLine was cancelled via timer.");
+				Trace::record(Trace::EventType::CANCELLED, this, static_cast<uint64_t>(Trace::Op::READ_LINE));
+				SPDLOG_DEBUG("SamConnection: readLine was cancelled via its slot.");
 				throw boost::system::system_error(ec, "readLine cancelled");
 			} else {
+				Trace::record(Trace::EventType::TIMEOUT, this, static_cast<uint64_t>(Trace::Op::READ_LINE));
 				SPDLOG_ERROR("Timeout waiting for reply in readLine.");
 				throw boost::system::system_error(net::error::timed_out, "SAM reply timeout in readLine");
 			}
 		}
 		std::istream is(&read_streambuf_);
 		std::getline(is, line);
+		Trace::record(Trace::EventType::REPLY_RECEIVED, this, line.size());
+		Capture::line(Capture::RecordType::REPLY, this, line);
 		// std::cout << "[SamConnection:" << this << " DEBUG] Raw line read: '" << line << "'" << std::endl;
 		co_return line;
 	}
@@ -232,6 +610,16 @@ net::awaitable<std::size_t> SamConnection::streamRead(
 		throw boost::system::system_error(net::error::not_connected, err_msg);
 	}
 
+	// readLine() may have pulled stream bytes that arrived right behind the last reply line
+	// (e.g. the response to early data). Hand those out before touching the socket again.
+	if (read_streambuf_.size() > 0) {
+		std::size_t buffered = net::buffer_copy(buffer, read_streambuf_.data());
+		read_streambuf_.consume(buffered);
+		Trace::record(Trace::EventType::BYTES_READ, this, buffered);
+		Capture::data(Capture::RecordType::DATA_IN, this, buffered);
+		co_return buffered;
+	}
+
 	// Handle "no timeout" or "infinite timeout" by directly awaiting read_some
 	// A very large duration can act as pseudo-infinite for practical purposes if timer must be used.
 	// Or, if timeout_duration is a special sentinel value like std::chrono::steady_clock::duration::max()
@@ -239,15 +627,26 @@ net::awaitable<std::size_t> SamConnection::streamRead(
 		timeout_duration == SteadyClock::duration::max()) { // Treat zero/negative/max as no specific timeout
 		try {
 			// std::cout << "[SamConnection:" << this << " DEBUG] streamRead (no explicit timeout) waiting..." << std::endl;
-			std::size_t bytes_transferred = co_await socket_.async_read_some(buffer, net::use_awaitable);
+			std::size_t bytes_transferred = co_await socket_.async_read_some(buffer,
+				net::bind_cancellation_slot(read_slot_.signal.slot(), net::use_awaitable));
 			// std::cout << "[SamConnection:" << this << " DEBUG] streamRead (no explicit timeout) got " << bytes_transferred << " bytes." << std::endl;
+			Trace::record(Trace::EventType::BYTES_READ, this, bytes_transferred);
+			Capture::data(Capture::RecordType::DATA_IN, this, bytes_transferred);
 			if (bytes_transferred == 0 && socket_.is_open() && current_state_ == ConnectionState::DATA_STREAM_MODE) {
-				SPDLOG_INFO("EOF indication from peer.");
+				Trace::record(Trace::EventType::PEER_EOF, this);
+				Capture::event(Capture::RecordType::PEER_EOF, this);
+				SPDLOG_DEBUG("EOF indication from peer.");
 				// This is an EOF indication from peer if socket is still open from our side.
 			}
 			co_return bytes_transferred;
 		} catch (const boost::system::system_error& e) {
-			if (e.code() != boost::asio::error::eof && e.code() != boost::asio::error::operation_aborted) {
+			if (e.code() == boost::asio::error::eof) {
+				Trace::record(Trace::EventType::PEER_EOF, this);
+				Capture::event(Capture::RecordType::PEER_EOF, this);
+			} else if (e.code() == boost::asio::error::operation_aborted) {
+				Trace::record(Trace::EventType::CANCELLED, this, static_cast<uint64_t>(Trace::Op::STREAM_READ));
+			} else {
+				Trace::record(Trace::EventType::IO_ERROR, this, static_cast<uint64_t>(e.code().value()));
 				SPDLOG_ERROR("System error in streamRead (no timeout path): {}", e.code().message());
 			}
 			if (!socket_.is_open()) setState(ConnectionState::CLOSED);
@@ -255,13 +654,10 @@ net::awaitable<std::size_t> SamConnection::streamRead(
 		}
 	}
 
-	// Proceed with timer for explicit timeout
-	//net::steady_timer timer(io_ctx_);
-	cancel_timer_.expires_after(timeout_duration);
-	
+	// Proceed with the read slot's timer for explicit timeout
 	// 在开始异步操作前检查socket状态
 	if (!socket_.is_open() || current_state_ != ConnectionState::DATA_STREAM_MODE) {
-		SPDLOG_INFO("SamConnection: streamRead - socket closed or invalid state, aborting");
+		SPDLOG_DEBUG("SamConnection: streamRead - socket closed or invalid state, aborting");
 		throw boost::system::system_error(net::error::operation_aborted, "Socket closed during streamRead");
 	}
 
@@ -270,48 +666,58 @@ net::awaitable<std::size_t> SamConnection::streamRead(
 		using namespace net::experimental::awaitable_operators;
 		
 		boost::system::error_code ec;	
-		cancel_timer_.expires_after(timeout_duration);
-		//SPDLOG_INFO("SamConnection: streamRead: cancel_timer_ expires after {}ms", std::chrono::duration_cast<std::chrono::milliseconds>(timeout_duration).count());
+		read_slot_.arm(timeout_duration);
 		auto result_variant = co_await (
 			socket_.async_read_some(buffer, net::use_awaitable) || 
-			cancel_timer_.async_wait(net::redirect_error(net::use_awaitable, ec))
+			read_slot_.timer.async_wait(net::redirect_error(net::use_awaitable, ec))
 		);
 
 		if (result_variant.index() == 1) { // Timer expired first
 			if (ec == net::error::operation_aborted)
 			{
 				// This is a cancellation, not a timeout.
-				SPDLOG_INFO("SamConnection: streamRead was cancelled via timer.");
+				SPDLOG_DEBUG("SamConnection: streamRead was cancelled via its slot.");
 				throw boost::system::system_error(ec, "Stream read cancelled");
 			}
 			else
 			{
 				// This is a real timeout.
-				SPDLOG_WARN("SamConnection: streamRead timeout.");
-				socket_.cancel(); // Best effort cancel of the read op
+				SPDLOG_DEBUG("SamConnection: streamRead timeout.");
+				// The || operator already cancelled the read; socket_.cancel() would also abort a concurrent write.
 				throw boost::system::system_error(net::error::timed_out, "Stream read timeout");
 			}
 		}
 		
 		// Read completed, get the number of bytes from the variant
 		std::size_t bytes_transferred = std::get<0>(result_variant);
+		Trace::record(Trace::EventType::BYTES_READ, this, bytes_transferred);
+		Capture::data(Capture::RecordType::DATA_IN, this, bytes_transferred);
 		// std::cout << "[SamConnection:" << this << " DEBUG] streamRead (with timeout) got " << bytes_transferred << " bytes." << std::endl;
 		if (bytes_transferred == 0 && socket_.is_open() && current_state_ == ConnectionState::DATA_STREAM_MODE) {
-			SPDLOG_INFO("EOF indication from peer, Maybe peer closed the connection.");
+			Trace::record(Trace::EventType::PEER_EOF, this);
+			Capture::event(Capture::RecordType::PEER_EOF, this);
+			SPDLOG_DEBUG("EOF indication from peer, Maybe peer closed the connection.");
 			// EOF
 		}
 		co_return bytes_transferred;
 
 	} catch (const boost::system::system_error& e) {
 		// This will catch the timed_out exception from above, or other system errors from async_read_some.
+		// Cancellation, timeout and EOF are routine on the data path: record them in the binary
+		// trace instead of formatting a log line for each one.
 		if (e.code() == net::error::operation_aborted) {
-			SPDLOG_INFO("SamConnection: streamRead was cancelled as expected. Error: {}", e.what());
-		} else if (e.code() != net::error::eof && 
-			e.code() != net::error::timed_out) { // Don't re-log timeout if already messaged
-			SPDLOG_ERROR("System error in streamRead (with timeout path): {}", e.code().message());
+			Trace::record(Trace::EventType::CANCELLED, this, static_cast<uint64_t>(Trace::Op::STREAM_READ));
+			SPDLOG_DEBUG("SamConnection: streamRead was cancelled as expected. Error: {}", e.what());
+		} else if (e.code() == net::error::timed_out) {
+			Trace::record(Trace::EventType::TIMEOUT, this, static_cast<uint64_t>(Trace::Op::STREAM_READ));
+			SPDLOG_DEBUG("SamConnection: streamRead finished with code: {}", e.code().message());
+		} else if (e.code() == net::error::eof) {
+			Trace::record(Trace::EventType::PEER_EOF, this);
+			Capture::event(Capture::RecordType::PEER_EOF, this);
+			SPDLOG_DEBUG("SamConnection: streamRead finished with code: {}", e.code().message());
 		} else {
-			// Log timeouts and EOF for debugging clarity, but maybe as INFO or WARN
-			SPDLOG_WARN("SamConnection: streamRead finished with code: {}", e.code().message());
+			Trace::record(Trace::EventType::IO_ERROR, this, static_cast<uint64_t>(e.code().value()));
+			SPDLOG_ERROR("System error in streamRead (with timeout path): {}", e.code().message());
 		}
 		if (!socket_.is_open()) setState(ConnectionState::CLOSED);
 		throw; // Re-throw for the caller (e.g., process_echo_stream_with_connection) to handle
@@ -320,6 +726,12 @@ net::awaitable<std::size_t> SamConnection::streamRead(
 
 net::awaitable<void> SamConnection::streamWrite(net::const_buffer buffer, 
 		SteadyClock::duration timeout)
+{
+	co_await streamWrite(std::span<const net::const_buffer>(&buffer, 1), timeout);
+}
+
+net::awaitable<void> SamConnection::streamWrite(std::span<const net::const_buffer> buffers, 
+		SteadyClock::duration timeout)
 {
 	if (current_state_ != ConnectionState::DATA_STREAM_MODE)
 	{
@@ -328,16 +740,118 @@ net::awaitable<void> SamConnection::streamWrite(net::const_buffer buffer,
 				"SamConnection::streamWrite - Not in DATA_STREAM_MODE. Current state: " + 
 				std::to_string(static_cast<int>(current_state_)));
 	}
-	
+
+	// Track bytes in flight until this write completes or fails (load metric for session groups).
+	struct PendingWriteGuard
+	{
+		std::atomic<std::size_t> &counter;
+		std::size_t bytes;
+		~PendingWriteGuard() { counter.fetch_sub(bytes, std::memory_order_relaxed); }
+	};
+	const std::size_t total_bytes = net::buffer_size(buffers);
+	pending_write_bytes_.fetch_add(total_bytes, std::memory_order_relaxed);
+	PendingWriteGuard pending_guard{pending_write_bytes_, total_bytes};
+
+	if (!egress_)
+	{
+		co_await writeGathered(buffers, total_bytes, timeout);
+		co_return;
+	}
+
+	// Metered: one scheduler grant per chunk, so other streams of the session can go in between.
+	// The timeout applies to each chunk's write, not to the wait for its grant.
+	auto scheduler = egress_;
+	const std::size_t chunk_size = scheduler->chunkSize();
+	std::vector<net::const_buffer> chunk;
+	std::size_t index = 0, offset = 0;
+	while (index < buffers.size())
+	{
+		chunk.clear();
+		std::size_t chunk_bytes = 0;
+		while (index < buffers.size() && chunk_bytes < chunk_size)
+		{
+			std::size_t take = std::min(buffers[index].size() - offset, chunk_size - chunk_bytes);
+			if (take > 0)
+				chunk.push_back(net::buffer(static_cast<const char *>(buffers[index].data()) + offset, take));
+			chunk_bytes += take;
+			offset += take;
+			if (offset == buffers[index].size())
+			{
+				++index;
+				offset = 0;
+			}
+		}
+		if (chunk_bytes == 0)
+			break;
+		co_await scheduler->acquire(this, chunk_bytes);
+		try
+		{
+			co_await writeGathered(chunk, chunk_bytes, timeout);
+		}
+		catch (...)
+		{
+			scheduler->release(this);
+			throw;
+		}
+		scheduler->release(this);
+	}
+}
+
+net::awaitable<std::size_t> SamConnection::streamWriteFrom(ChunkProducer producer, std::size_t chunk_size,
+		SteadyClock::duration timeout)
+{
+	std::array<std::vector<char>, 2> buffers;
+	buffers[0].resize(std::max<std::size_t>(1, chunk_size));
+	buffers[1].resize(buffers[0].size());
+
+	std::size_t total = 0;
+	std::size_t current = 0;
+	std::size_t filled = co_await producer(net::buffer(buffers[current]));
+	while (filled > 0)
+	{
+		std::vector<char> &next = buffers[current ^ 1];
+		// Write this chunk while the producer fills the other buffer; a failed write cancels the producer.
+		using namespace net::experimental::awaitable_operators;
+		std::size_t next_filled = co_await (
+			streamWrite(net::buffer(buffers[current].data(), filled), timeout) &&
+			producer(net::buffer(next)));
+		total += filled;
+		filled = next_filled;
+		current ^= 1;
+	}
+	co_return total;
+}
+
+void SamConnection::setEgressScheduler(std::shared_ptr<SamEgressScheduler> scheduler, const StreamEgressConfig &config)
+{
+	if (egress_)
+		egress_->unregisterStream(this);
+	egress_ = std::move(scheduler);
+	if (egress_)
+		egress_->registerStream(this, config);
+}
+
+net::awaitable<void> SamConnection::writeGathered(std::span<const net::const_buffer> buffers, std::size_t total_bytes,
+		SteadyClock::duration timeout)
+{
 	// Handle "no timeout" case
 	if (timeout <= SteadyClock::duration::zero() || 
 		timeout == SteadyClock::duration::max()) {
 		try {
-			// Use strand to serialize write operations even without timeout
-			co_await net::async_write(socket_, buffer, 
-				net::bind_executor(write_strand_, net::use_awaitable));
+			// Use strand to serialize write operations even without timeout;
+			// cancel_write_operations() aborts it through the write slot's signal.
+			co_await net::async_write(socket_, buffers, 
+				net::bind_cancellation_slot(write_slot_.signal.slot(),
+					net::bind_executor(write_strand_, net::use_awaitable)));
+			Trace::record(Trace::EventType::BYTES_WRITTEN, this, total_bytes);
+			Capture::data(Capture::RecordType::DATA_OUT, this, total_bytes);
 			co_return;
 		} catch (const boost::system::system_error &e) {
+			if (e.code() == boost::asio::error::operation_aborted) {
+				Trace::record(Trace::EventType::CANCELLED, this, static_cast<uint64_t>(Trace::Op::STREAM_WRITE));
+				throw;
+			}
+			Trace::record(Trace::EventType::IO_ERROR, this, static_cast<uint64_t>(e.code().value()));
 			SPDLOG_ERROR("Error in streamWrite (no timeout): {}", e.code().message());
 			if (!socket_.is_open())
 				setState(ConnectionState::CLOSED);
@@ -345,67 +859,328 @@ net::awaitable<void> SamConnection::streamWrite(net::const_buffer buffer,
 		}
 	}
 	
-	// 不可以使用cancel_timer_，
-	net::steady_timer write_timer(io_ctx_);
-	write_timer.expires_after(timeout);
+	// The write slot's timer is only shared with other writes, never with reads or control replies.
+	write_slot_.arm(timeout);
 	
 	try {
 		using namespace boost::asio::experimental::awaitable_operators;
 		
-		auto write_task = [&]() -> net::awaitable<void> {
-			// Use strand to serialize write operations
-			co_await net::async_write(socket_, buffer, 
-				net::bind_executor(write_strand_, net::use_awaitable));
-		};
-		
-		auto timeout_task = [&]() -> net::awaitable<void> {
-			co_await write_timer.async_wait(net::use_awaitable);
-			throw boost::system::system_error(boost::asio::error::timed_out, 
-				"SamConnection::streamWrite timeout");
-		};
-		
-		auto result = co_await (write_task() || timeout_task());
-		
-		// Cancel timer if write completed first
-		write_timer.cancel();
+		boost::system::error_code timer_ec;
+		auto result = co_await (
+			net::async_write(socket_, buffers, 
+				net::bind_executor(write_strand_, net::use_awaitable)) ||
+			write_slot_.timer.async_wait(net::redirect_error(net::use_awaitable, timer_ec)));
 		
 		if (result.index() == 1) {
-			// Timeout occurred
+			if (timer_ec == net::error::operation_aborted) {
+				// cancel_write_operations() fired the slot
+				throw boost::system::system_error(boost::asio::error::operation_aborted, 
+					"SamConnection::streamWrite cancelled");
+			}
 			throw boost::system::system_error(boost::asio::error::timed_out, 
 				"SamConnection::streamWrite timeout");
 		}
 		
 	} catch (const boost::system::system_error &e) {
-		SPDLOG_WARN("SamConnection: streamWrite finished with code: {}", e.code().message());
+		if (e.code() == boost::asio::error::timed_out || e.code() == boost::asio::error::operation_aborted) {
+			Trace::record(e.code() == boost::asio::error::timed_out ? Trace::EventType::TIMEOUT : Trace::EventType::CANCELLED,
+				this, static_cast<uint64_t>(Trace::Op::STREAM_WRITE));
+			SPDLOG_DEBUG("SamConnection: streamWrite finished with code: {}", e.code().message());
+		} else {
+			Trace::record(Trace::EventType::IO_ERROR, this, static_cast<uint64_t>(e.code().value()));
+			SPDLOG_WARN("SamConnection: streamWrite finished with code: {}", e.code().message());
+		}
 		if (!socket_.is_open() || e.code() == boost::asio::error::timed_out)
 			setState(ConnectionState::CLOSED);
 		throw;
 	}
+	Trace::record(Trace::EventType::BYTES_WRITTEN, this, total_bytes);
+	Capture::data(Capture::RecordType::DATA_OUT, this, total_bytes);
 	
 	co_return;
 }
 
+net::awaitable<void> SamConnection::waitReady(net::socket_base::wait_type what, OperationSlot &slot,
+		SteadyClock::duration timeout)
+{
+	const auto op = what == net::socket_base::wait_write ? Trace::Op::STREAM_WRITE : Trace::Op::STREAM_READ;
+	if (timeout <= SteadyClock::duration::zero() || timeout == SteadyClock::duration::max())
+	{
+		try
+		{
+			co_await socket_.async_wait(what, net::bind_cancellation_slot(slot.signal.slot(), net::use_awaitable));
+		}
+		catch (const boost::system::system_error &e)
+		{
+			if (e.code() == net::error::operation_aborted)
+				Trace::record(Trace::EventType::CANCELLED, this, static_cast<uint64_t>(op));
+			throw;
+		}
+		co_return;
+	}
+
+	slot.arm(timeout);
+	using namespace net::experimental::awaitable_operators;
+	boost::system::error_code timer_ec;
+	auto result = co_await (
+		socket_.async_wait(what, net::use_awaitable) ||
+		slot.timer.async_wait(net::redirect_error(net::use_awaitable, timer_ec)));
+	if (result.index() == 1)
+	{
+		const bool cancelled = timer_ec == net::error::operation_aborted;
+		Trace::record(cancelled ? Trace::EventType::CANCELLED : Trace::EventType::TIMEOUT, this, static_cast<uint64_t>(op));
+		throw boost::system::system_error(cancelled ? net::error::operation_aborted : net::error::timed_out,
+			"SamConnection: wait for socket readiness");
+	}
+}
+
+net::awaitable<std::size_t> SamConnection::streamSendFile(int file_fd, uint64_t offset, uint64_t length,
+		SteadyClock::duration timeout)
+{
+	if (current_state_ != ConnectionState::DATA_STREAM_MODE)
+	{
+		SPDLOG_ERROR("Not in DATA_STREAM_MODE. Current state: {}", static_cast<int>(current_state_));
+		throw boost::system::system_error(net::error::not_connected, "SamConnection::streamSendFile - Not in DATA_STREAM_MODE");
+	}
+	struct PendingWriteGuard
+	{
+		std::atomic<std::size_t> &counter;
+		std::size_t bytes;
+		~PendingWriteGuard() { counter.fetch_sub(bytes, std::memory_order_relaxed); }
+	};
+	pending_write_bytes_.fetch_add(length, std::memory_order_relaxed);
+	PendingWriteGuard pending_guard{pending_write_bytes_, static_cast<std::size_t>(length)};
+
+	socket_.native_non_blocking(true);
+	auto scheduler = egress_;
+	const std::size_t chunk_limit = scheduler ? scheduler->chunkSize() : 1024 * 1024;
+	off_t file_offset = static_cast<off_t>(offset);
+	uint64_t sent = 0;
+	bool use_sendfile = true; // Cleared when the file type does not support sendfile (e.g. a pipe)
+	std::vector<char> bounce;
+	bool file_eof = false;
+
+	while (sent < length && !file_eof)
+	{
+		const std::size_t chunk = static_cast<std::size_t>(std::min<uint64_t>(length - sent, chunk_limit));
+		if (scheduler)
+			co_await scheduler->acquire(this, chunk);
+		std::size_t chunk_done = 0;
+		try
+		{
+			while (chunk_done < chunk)
+			{
+				if (use_sendfile)
+				{
+					ssize_t n = ::sendfile(socket_.native_handle(), file_fd, &file_offset, chunk - chunk_done);
+					if (n > 0)
+					{
+						chunk_done += static_cast<std::size_t>(n);
+						continue;
+					}
+					if (n == 0)
+					{
+						file_eof = true; // File shorter than requested
+						break;
+					}
+					if (errno == EINTR)
+						continue;
+					if (errno == EAGAIN)
+					{
+						co_await waitReady(net::socket_base::wait_write, write_slot_, timeout);
+						continue;
+					}
+					if (errno != EINVAL && errno != ENOSYS)
+						throw boost::system::system_error(errno, boost::system::system_category(), "sendfile");
+					SPDLOG_DEBUG("sendfile unsupported for fd {}, falling back to buffered writes", file_fd);
+					use_sendfile = false;
+				}
+				bounce.resize(std::min<std::size_t>(chunk - chunk_done, 64 * 1024));
+				ssize_t r = ::pread(file_fd, bounce.data(), bounce.size(), file_offset);
+				if (r < 0 && errno == EINTR)
+					continue;
+				if (r < 0)
+					throw boost::system::system_error(errno, boost::system::system_category(), "pread");
+				if (r == 0)
+				{
+					file_eof = true;
+					break;
+				}
+				net::const_buffer part = net::buffer(bounce.data(), static_cast<std::size_t>(r));
+				co_await writeGathered(std::span<const net::const_buffer>(&part, 1), part.size(), timeout);
+				file_offset += r;
+				chunk_done += static_cast<std::size_t>(r);
+			}
+		}
+		catch (const boost::system::system_error &e)
+		{
+			if (scheduler)
+				scheduler->release(this);
+			if (e.code() != net::error::timed_out && e.code() != net::error::operation_aborted)
+			{
+				Trace::record(Trace::EventType::IO_ERROR, this, static_cast<uint64_t>(e.code().value()));
+				SPDLOG_WARN("SamConnection: streamSendFile failed: {}", e.code().message());
+			}
+			if (!socket_.is_open() || e.code() == net::error::timed_out)
+				setState(ConnectionState::CLOSED);
+			throw;
+		}
+		if (scheduler)
+			scheduler->release(this);
+		if (use_sendfile)
+		{ // writeGathered records its own
+			Trace::record(Trace::EventType::BYTES_WRITTEN, this, chunk_done);
+			Capture::data(Capture::RecordType::DATA_OUT, this, chunk_done);
+		}
+		sent += chunk_done;
+	}
+	co_return static_cast<std::size_t>(sent);
+}
+
+net::awaitable<std::size_t> SamConnection::streamReceiveToFile(int file_fd, uint64_t offset, uint64_t length,
+		SteadyClock::duration timeout)
+{
+	if (current_state_ != ConnectionState::DATA_STREAM_MODE)
+	{
+		SPDLOG_ERROR("Not in DATA_STREAM_MODE. Current state: {}", static_cast<int>(current_state_));
+		throw boost::system::system_error(net::error::not_connected, "SamConnection::streamReceiveToFile - Not in DATA_STREAM_MODE");
+	}
+	off_t file_offset = static_cast<off_t>(offset);
+	uint64_t received = 0;
+	auto write_file = [&file_offset, file_fd](const char *data, std::size_t len) {
+		while (len > 0)
+		{
+			ssize_t n = ::pwrite(file_fd, data, len, file_offset);
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n <= 0)
+				throw boost::system::system_error(errno, boost::system::system_category(), "pwrite");
+			data += n;
+			len -= static_cast<std::size_t>(n);
+			file_offset += n;
+		}
+	};
+
+	// Stream bytes readLine() already pulled in go first, exactly as streamRead hands them out.
+	if (read_streambuf_.size() > 0)
+	{
+		std::size_t take = static_cast<std::size_t>(std::min<uint64_t>(read_streambuf_.size(), length));
+		std::string buffered = bufferedBytes().substr(0, take);
+		write_file(buffered.data(), buffered.size());
+		read_streambuf_.consume(take);
+		Trace::record(Trace::EventType::BYTES_READ, this, take);
+		Capture::data(Capture::RecordType::DATA_IN, this, take);
+		received += take;
+	}
+
+	int pipe_fds[2] = {-1, -1};
+	if (::pipe2(pipe_fds, O_CLOEXEC | O_NONBLOCK) != 0)
+		throw boost::system::system_error(errno, boost::system::system_category(), "pipe2");
+	struct PipeCloser
+	{
+		int *fds;
+		~PipeCloser() { ::close(fds[0]); ::close(fds[1]); }
+	} pipe_closer{pipe_fds};
+
+	socket_.native_non_blocking(true);
+	bool use_splice = true; // Cleared when the target does not accept splice (e.g. O_APPEND files)
+	std::vector<char> bounce;
+	try
+	{
+		while (received < length)
+		{
+			const std::size_t want = static_cast<std::size_t>(std::min<uint64_t>(length - received, 64 * 1024));
+			ssize_t n;
+			if (use_splice)
+				n = ::splice(socket_.native_handle(), nullptr, pipe_fds[1], nullptr, want, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+			else
+			{
+				bounce.resize(want);
+				n = ::recv(socket_.native_handle(), bounce.data(), want, 0);
+			}
+			if (n == 0)
+			{
+				Trace::record(Trace::EventType::PEER_EOF, this);
+				Capture::event(Capture::RecordType::PEER_EOF, this);
+				break;
+			}
+			if (n < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				if (errno == EAGAIN)
+				{
+					co_await waitReady(net::socket_base::wait_read, read_slot_, timeout);
+					continue;
+				}
+				if (use_splice && errno == EINVAL)
+				{
+					SPDLOG_DEBUG("splice unsupported for fd {}, falling back to buffered reads", file_fd);
+					use_splice = false;
+					continue;
+				}
+				throw boost::system::system_error(errno, boost::system::system_category(), use_splice ? "splice" : "recv");
+			}
+
+			if (use_splice)
+			{
+				std::size_t in_pipe = static_cast<std::size_t>(n);
+				while (in_pipe > 0)
+				{
+					ssize_t m = ::splice(pipe_fds[0], nullptr, file_fd, &file_offset, in_pipe, SPLICE_F_MOVE);
+					if (m < 0 && errno == EINTR)
+						continue;
+					if (m <= 0)
+						throw boost::system::system_error(errno, boost::system::system_category(), "splice to file");
+					in_pipe -= static_cast<std::size_t>(m);
+				}
+			}
+			else
+			{
+				write_file(bounce.data(), static_cast<std::size_t>(n));
+			}
+			Trace::record(Trace::EventType::BYTES_READ, this, static_cast<uint64_t>(n));
+			Capture::data(Capture::RecordType::DATA_IN, this, static_cast<uint64_t>(n));
+			received += static_cast<uint64_t>(n);
+		}
+	}
+	catch (const boost::system::system_error &e)
+	{
+		if (e.code() != net::error::timed_out && e.code() != net::error::operation_aborted)
+		{
+			Trace::record(Trace::EventType::IO_ERROR, this, static_cast<uint64_t>(e.code().value()));
+			SPDLOG_WARN("SamConnection: streamReceiveToFile failed after {} bytes: {}", received, e.code().message());
+		}
+		if (!socket_.is_open())
+			setState(ConnectionState::CLOSED);
+		throw;
+	}
+	co_return static_cast<std::size_t>(received);
+}
+
 void SamConnection::closeSocket()
 {
 	// This state check must be synchronous to prevent race conditions.
 	if (current_state_ == ConnectionState::CLOSING ||
 		current_state_ == ConnectionState::CLOSED)
 	{
-		SPDLOG_INFO("SamConnection: closeSocket: socket already closed or closing");
+		SPDLOG_DEBUG("SamConnection: closeSocket: socket already closed or closing");
 		return;
 	}
 	// Set state immediately to prevent new operations from starting.
 	setState(ConnectionState::CLOSING);
-	SPDLOG_INFO("SamConnection: State set to CLOSING. Executing close logic.");
+	SPDLOG_DEBUG("SamConnection: State set to CLOSING. Executing close logic.");
 
-	// Emit signal to cancel coroutines bound to it.
-	cancel_timer_.cancel();
+	// Fire every operation slot to cancel coroutines bound to them.
+	control_slot_.cancel();
+	read_slot_.cancel();
+	write_slot_.cancel();
 
 	if (socket_.is_open()) {
 		boost::system::error_code ec;
 		// Gracefully shut down the socket. This will cancel pending reads.
-		SPDLOG_INFO("SamConnection: Executing socket shutdown and close.");
-		socket_.shutdown(net::ip::tcp::socket::shutdown_both, ec);
+		SPDLOG_DEBUG("SamConnection: Executing socket shutdown and close.");
+		socket_.shutdown(net::socket_base::shutdown_both, ec);
 		// Close the socket.
 		socket_.close(ec);
 	}
@@ -2,9 +2,15 @@
 
 #include <string>
 #include <memory>
+#include <atomic>
+#include <span>
+#include <vector>
+#include <functional>
 #include <boost/asio.hpp>
 #include <boost/asio/experimental/awaitable_operators.hpp>
 #include "SamMessageParser.h" // For ParsedMessage
+#include "SamAsyncUtils.h"    // For AsyncCondition
+#include "SamEgressScheduler.h"
 #include <spdlog/spdlog.h>
 
 namespace net = boost::asio;
@@ -12,6 +18,27 @@ using SteadyClock = std::chrono::steady_clock;
 using cancellation_signal_ptr = std::shared_ptr<net::cancellation_signal>;
 
 namespace SAM {
+
+// Address of a SAM bridge: either TCP host/port, or a Unix domain socket path for a bridge
+// running on the same machine (skips the resolver and the loopback TCP stack).
+struct SamBridgeEndpoint
+{
+	std::string host;
+	uint16_t port = 0;
+	std::string unix_path; // Non-empty selects the Unix domain socket transport
+	bool embedded = false; // Use the in-process router's bridge (see EmbeddedRouter)
+
+	static SamBridgeEndpoint tcp(const std::string &host, uint16_t port);
+	static SamBridgeEndpoint local(const std::string &path);
+	static SamBridgeEndpoint inProcess();
+	// Accepts "host:port", "host" (default_port), "[v6]:port", "[v6]" or a bare IPv6 address,
+	// "unix:/path/to/sam.sock" or "embedded". Returns false (with error_message) on malformed input.
+	static bool parse(const std::string &spec, uint16_t default_port, SamBridgeEndpoint &endpoint,
+		std::string &error_message);
+
+	bool isLocal() const { return !unix_path.empty(); }
+	std::string toString() const;
+};
 	
 class SamConnection : public std::enable_shared_from_this<SamConnection>
 {
@@ -28,16 +55,41 @@ public:
 		ERROR_STATE
 	};
 
+	// Protocol-agnostic stream socket, so the same connection type serves TCP and Unix domain sockets.
+	using socket_type = net::generic::stream_protocol::socket;
+
 	SamConnection(net::io_context &io_ctx);
 	~SamConnection();
 
 	net::awaitable<bool> connect(const std::string &host, uint16_t port, 
 		SteadyClock::duration timeout = std::chrono::seconds(10));
+	net::awaitable<bool> connect(const SamBridgeEndpoint &bridge,
+		SteadyClock::duration timeout = std::chrono::seconds(10));
+	// Takes over an already connected socket (e.g. one end of net::local::connect_pair),
+	// leaving the connection in CONNECTED_NO_HELLO.
+	bool adoptSocket(socket_type socket);
+	// Process handoff (see SamHandoff.h): adopts a raw descriptor received from a previous owner in the
+	// given protocol state, with the bytes that owner had already read but not consumed.
+	bool adoptNativeHandle(int fd, ConnectionState state, const std::string &buffered = {});
+	// Bytes read from the socket but not yet consumed (e.g. the start of a reply line).
+	std::string bufferedBytes() const;
+	// Gives up the descriptor without shutdown, so the SAM bridge does not notice; pending operations
+	// complete with operation_aborted and the connection ends up CLOSED. Returns -1 if not open.
+	int releaseNativeHandle();
 	net::awaitable<SAM::ParsedMessage> performHello(
 		SteadyClock::duration timeout = std::chrono::seconds(5));
 
 	net::awaitable<SAM::ParsedMessage> sendCommandAndWaitReply(const std::string &command, 
 		SteadyClock::duration reply_timeout = std::chrono::seconds(10));
+	// NAMING LOOKUP exchange that survives a reply timeout: the connection stays open and the late
+	// reply is skipped by a later exchange. For lookups on a control connection, whose loss would end
+	// the session. Other errors close the connection as in sendCommandAndWaitReply.
+	net::awaitable<SAM::ParsedMessage> namingLookup(const std::string &name, SteadyClock::duration reply_timeout);
+	// For a control connection: reads what the bridge sends between command exchanges (PING is answered
+	// with PONG, late NAMING REPLYs are dropped) and returns once the connection is closed. On EOF or an
+	// I/O error it closes the connection itself, so isOpen() turns false when the bridge goes away.
+	// Cancelling it (e.g. with operator||) leaves the connection as it is.
+	net::awaitable<void> watchUntilClosed();
 	net::awaitable<std::string> readLine(SteadyClock::duration timeout);
 
 	// For data transfer phase
@@ -45,23 +97,93 @@ public:
 			SteadyClock::duration timeout = std::chrono::minutes(5));
 	net::awaitable<void> streamWrite(net::const_buffer buffer, 
 			SteadyClock::duration timeout = std::chrono::seconds(30));
+	// Gathered write: all buffers leave in one async_write (one syscall when the socket accepts them).
+	net::awaitable<void> streamWrite(std::span<const net::const_buffer> buffers, 
+			SteadyClock::duration timeout = std::chrono::seconds(30));
+
+	// Streaming write from an async producer: the producer fills the buffer it is given and returns the
+	// byte count, 0 at end of data. Two chunk_size buffers are reused throughout (the next chunk is
+	// produced while the previous one is written), so memory does not grow with the payload; timeout
+	// is a progress deadline per chunk, not for the whole transfer. Returns bytes written.
+	using ChunkProducer = std::function<net::awaitable<std::size_t>(net::mutable_buffer)>;
+	net::awaitable<std::size_t> streamWriteFrom(ChunkProducer producer, std::size_t chunk_size = 64 * 1024,
+			SteadyClock::duration timeout = std::chrono::seconds(30));
+
+	// Zero-copy file transfer. streamSendFile sends [offset, offset + length) of a regular file with
+	// sendfile(2), chunk by chunk as the socket accepts data (and as the egress scheduler grants, if
+	// attached); timeout bounds each wait for socket space, not the whole transfer. Returns bytes sent.
+	// Do not overlap it with streamWrite on the same connection.
+	net::awaitable<std::size_t> streamSendFile(int file_fd, uint64_t offset, uint64_t length,
+			SteadyClock::duration timeout = std::chrono::seconds(30));
+	// Receives up to length bytes (until EOF for kUntilEof) into file_fd at offset, moving them
+	// socket -> pipe -> file with splice(2). Bytes already buffered by readLine are written first.
+	// timeout bounds each wait for data. Returns bytes written to the file.
+	static constexpr uint64_t kUntilEof = UINT64_MAX;
+	net::awaitable<std::size_t> streamReceiveToFile(int file_fd, uint64_t offset, uint64_t length = kUntilEof,
+			SteadyClock::duration timeout = std::chrono::minutes(5));
 
 	void closeSocket(); // Synchronous close
 	bool isOpen() const;
 	ConnectionState getState() const { return current_state_; }
 	void setState(ConnectionState new_state); // Allow external state setting if needed by manager
 
-	net::ip::tcp::socket &rawSocket() { return socket_; } // Expose socket if absolutely needed by higher level (use with care)
+	socket_type &rawSocket() { return socket_; } // Expose socket if absolutely needed by higher level (use with care)
 	net::any_io_executor get_executor() { return io_ctx_.get_executor(); }
-	void cancel_read_operations();
+	// Reactor Asio was built with for socket I/O ("io_uring" with -DSAMON_IO_URING=ON).
+	static const char *ioBackendName();
+	// Full duplex: one streamRead, one streamWrite and control command exchanges may be outstanding at
+	// the same time. Each has its own cancellation slot and deadline, so cancelling or timing out one
+	// direction never aborts the other. Call these from the connection's executor.
+	void cancel_read_operations();  // Pending streamRead and SAM reply reads (readLine)
+	void cancel_write_operations(); // Pending streamWrite
+	// Meters this connection's streamWrite calls through a shared (per-session) egress scheduler;
+	// pass nullptr to detach. Writes are then issued chunk by chunk as the scheduler grants them.
+	void setEgressScheduler(std::shared_ptr<SamEgressScheduler> scheduler, const StreamEgressConfig &config = {});
+	// Bytes passed to streamWrite that have not been fully written yet (queued in the socket send path).
+	std::size_t pendingWriteBytes() const { return pending_write_bytes_.load(std::memory_order_relaxed); }
 private:
 	net::io_context &io_ctx_;
-	net::ip::tcp::socket socket_;
+	socket_type socket_;
 	SAM::SamMessageParser parser_; // Each connection might parse its own replies
 	net::streambuf read_streambuf_;
 	ConnectionState current_state_ = ConnectionState::DISCONNECTED;
-	net::steady_timer cancel_timer_;
+	// Per-operation cancellation slot: the timer carries the deadline of a timed operation (cancelling
+	// it aborts that operation early), the signal aborts an operation awaited without deadline.
+	struct OperationSlot
+	{
+		explicit OperationSlot(net::io_context &io_ctx) : timer(io_ctx) {}
+		void arm(SteadyClock::duration timeout);
+		void cancel();
+		net::steady_timer timer;
+		net::cancellation_signal signal;
+	};
+	OperationSlot control_slot_; // readLine: SAM command replies
+	OperationSlot read_slot_;    // streamRead
+	OperationSlot write_slot_;   // streamWrite
+	bool control_busy_ = false;  // A command/reply exchange is in progress
+	AsyncCondition control_idle_;
+	// Holds the control connection for one exchange; releasing it wakes the callers waiting their turn.
+	struct ControlTurn
+	{
+		SamConnection &conn;
+		~ControlTurn()
+		{
+			conn.control_busy_ = false;
+			conn.control_idle_.notifyAll();
+		}
+	};
+	std::size_t late_naming_replies_ = 0; // Timed-out namingLookup replies still to come
 	net::strand<net::any_io_executor> write_strand_;
+	std::atomic<std::size_t> pending_write_bytes_{0};
+	std::shared_ptr<SamEgressScheduler> egress_;
+
+	// Waits until the socket is readable/writable, bounded by the slot's deadline (throws timed_out,
+	// or operation_aborted when the slot is cancelled).
+	net::awaitable<void> waitReady(net::socket_base::wait_type what, OperationSlot &slot, SteadyClock::duration timeout);
+	net::awaitable<SAM::ParsedMessage> exchange(const std::string &command, SteadyClock::duration reply_timeout,
+		bool keep_open_on_timeout);
+	net::awaitable<void> writeGathered(std::span<const net::const_buffer> buffers, std::size_t total_bytes,
+			SteadyClock::duration timeout);
 };	
 
 } // namespace SAM
\ No newline at end of file
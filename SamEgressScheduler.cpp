@@ -0,0 +1,191 @@
+#include "SamEgressScheduler.h"
+#include <algorithm>
+#include <bit>
+
+namespace SAM {
+
+uint64_t EgressWaitStats::percentileMicros(const std::array<uint64_t, kBuckets>& histogram, double percentile) {
+	uint64_t total = 0;
+	for (uint64_t n : histogram) total += n;
+	if (total == 0) return 0;
+	const double target = total * std::clamp(percentile, 0.0, 100.0) / 100.0;
+	uint64_t seen = 0;
+	for (std::size_t i = 0; i < kBuckets; ++i) {
+		seen += histogram[i];
+		if (seen >= target && histogram[i] > 0) return (uint64_t{1} << i);
+	}
+	return uint64_t{1} << (kBuckets - 1);
+}
+
+SamEgressScheduler::SamEgressScheduler(const net::any_io_executor& ex,
+	std::size_t chunk_size, std::size_t max_inflight_chunks)
+	: chunk_size_(std::max<std::size_t>(1, chunk_size)),
+	  max_inflight_(std::max<std::size_t>(1, max_inflight_chunks)),
+	  wake_(ex) {
+}
+
+void SamEgressScheduler::registerStream(const void* stream, const StreamEgressConfig& config) {
+	StreamState& s = streams_[stream];
+	s.config = config;
+	s.config.weight = std::max<uint32_t>(1, config.weight);
+	if (s.config.rate_bytes_per_sec > 0) s.config.burst_bytes = std::max<uint64_t>(s.config.burst_bytes, chunk_size_);
+	s.tokens = static_cast<double>(s.config.burst_bytes);
+	s.last_refill = SteadyClock::now();
+	s.unregistered = false;
+}
+
+void SamEgressScheduler::unregisterStream(const void* stream) {
+	auto it = streams_.find(stream);
+	if (it == streams_.end()) return;
+	it->second.unregistered = true;
+	maybeErase(stream);
+}
+
+void SamEgressScheduler::maybeErase(const void* stream) {
+	auto it = streams_.find(stream);
+	if (it != streams_.end() && it->second.unregistered &&
+		it->second.queue.empty() && it->second.granted_outstanding == 0) {
+		streams_.erase(it); // Stale entries in the active lists are dropped by dispatch()
+	}
+}
+
+net::awaitable<void> SamEgressScheduler::acquire(const void* stream, std::size_t bytes) {
+	auto it = streams_.find(stream);
+	if (it == streams_.end()) co_return; // Not metered
+	StreamState& s = it->second;
+	const bool strict = s.config.strict_priority;
+	const auto requested_at = SteadyClock::now();
+
+	Waiter waiter;
+	waiter.bytes = std::min(bytes, chunk_size_);
+	s.queue.push_back(&waiter);
+	if (!s.in_active_list) {
+		(strict ? strict_active_ : normal_active_).push_back(stream);
+		s.in_active_list = true;
+	}
+	// A writer cancelled or destroyed while waiting (e.g. the losing side of a || race) must not stay
+	// queued: grant() would write through a dangling pointer. One granted but never resumed hands its
+	// chunk back, since its caller will not release() it.
+	struct Abandon {
+		SamEgressScheduler& scheduler;
+		const void* stream;
+		Waiter& waiter;
+		bool armed = true;
+		~Abandon() {
+			if (!armed) return;
+			if (waiter.granted) {
+				scheduler.release(stream);
+				return;
+			}
+			auto it = scheduler.streams_.find(stream);
+			if (it == scheduler.streams_.end()) return;
+			auto& queue = it->second.queue;
+			queue.erase(std::remove(queue.begin(), queue.end(), &waiter), queue.end());
+			scheduler.maybeErase(stream);
+		}
+	} abandon{*this, stream, waiter};
+	while (!waiter.granted) {
+		auto next_refill = dispatch();
+		if (waiter.granted) break;
+		co_await wake_.waitUntil(next_refill);
+	}
+	abandon.armed = false;
+
+	auto waited = std::chrono::duration_cast<std::chrono::microseconds>(SteadyClock::now() - requested_at).count();
+	std::size_t bucket = std::min<std::size_t>(EgressWaitStats::kBuckets - 1,
+		std::bit_width(static_cast<uint64_t>(std::max<int64_t>(waited, 0))));
+	(strict ? stats_.strict : stats_.normal)[bucket]++;
+}
+
+void SamEgressScheduler::release(const void* stream) {
+	if (inflight_ > 0) inflight_--;
+	auto it = streams_.find(stream);
+	if (it != streams_.end()) {
+		if (it->second.granted_outstanding > 0) it->second.granted_outstanding--;
+		maybeErase(stream);
+	}
+	dispatch();
+}
+
+bool SamEgressScheduler::eligible(StreamState& s, SteadyClock::time_point now, SteadyClock::time_point& next_refill) {
+	if (s.config.rate_bytes_per_sec == 0) return true;
+	const double rate = static_cast<double>(s.config.rate_bytes_per_sec);
+	const double elapsed = std::chrono::duration<double>(now - s.last_refill).count();
+	s.tokens = std::min<double>(static_cast<double>(s.config.burst_bytes), s.tokens + elapsed * rate);
+	s.last_refill = now;
+	const double needed = static_cast<double>(s.queue.front()->bytes);
+	if (s.tokens >= needed) return true;
+	auto wait = std::chrono::duration_cast<SteadyClock::duration>(std::chrono::duration<double>((needed - s.tokens) / rate));
+	next_refill = std::min(next_refill, now + wait);
+	return false;
+}
+
+void SamEgressScheduler::grant(StreamState& s) {
+	Waiter* waiter = s.queue.front();
+	s.queue.pop_front();
+	waiter->granted = true;
+	inflight_++;
+	s.granted_outstanding++;
+	if (!s.config.strict_priority) s.deficit -= std::min(s.deficit, waiter->bytes);
+	if (s.config.rate_bytes_per_sec > 0) s.tokens -= static_cast<double>(waiter->bytes);
+	stats_.granted_chunks++;
+	stats_.granted_bytes += waiter->bytes;
+}
+
+SteadyClock::time_point SamEgressScheduler::dispatch() {
+	const auto now = SteadyClock::now();
+	auto next_refill = SteadyClock::time_point::max();
+	bool granted_any = false;
+
+	while (inflight_ < max_inflight_) {
+		StreamState* chosen = nullptr;
+
+		// Strict class: round robin among streams with data and tokens.
+		for (std::size_t n = strict_active_.size(); n > 0 && !chosen; --n) {
+			const void* key = strict_active_.front();
+			strict_active_.pop_front();
+			auto it = streams_.find(key);
+			if (it == streams_.end()) continue;
+			if (it->second.queue.empty()) {
+				it->second.in_active_list = false;
+				continue;
+			}
+			strict_active_.push_back(key);
+			if (eligible(it->second, now, next_refill)) chosen = &it->second;
+		}
+
+		// Normal class: deficit round robin. The head stream is served while its deficit covers the next
+		// chunk, otherwise it earns weight * chunk_size and moves to the tail. Two passes suffice to find
+		// any eligible stream, since one quantum always covers a chunk.
+		for (std::size_t visits = normal_active_.size() * 2; visits > 0 && !chosen && !normal_active_.empty(); --visits) {
+			const void* key = normal_active_.front();
+			auto it = streams_.find(key);
+			if (it == streams_.end() || it->second.queue.empty()) {
+				normal_active_.pop_front();
+				if (it != streams_.end()) {
+					it->second.in_active_list = false;
+					it->second.deficit = 0;
+				}
+				continue;
+			}
+			StreamState& s = it->second;
+			if (eligible(s, now, next_refill) && s.deficit >= s.queue.front()->bytes) {
+				chosen = &s;
+				break;
+			}
+			if (s.config.rate_bytes_per_sec == 0 || s.tokens >= static_cast<double>(s.queue.front()->bytes)) {
+				s.deficit += chunk_size_ * s.config.weight;
+			}
+			normal_active_.pop_front();
+			normal_active_.push_back(key);
+		}
+
+		if (!chosen) break;
+		grant(*chosen);
+		granted_any = true;
+	}
+	if (granted_any) wake_.notifyAll();
+	return next_refill;
+}
+
+} // namespace SAM
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <unordered_map>
+#include <boost/asio.hpp>
+#include "SamAsyncUtils.h"
+
+namespace net = boost::asio;
+
+namespace SAM {
+
+// Per-stream egress policy.
+struct StreamEgressConfig {
+	uint32_t weight = 1;              // DRR share relative to other normal-class streams (>= 1)
+	bool strict_priority = false;     // Served before every normal-class stream whenever it has data
+	uint64_t rate_bytes_per_sec = 0;  // Token bucket rate; 0 = unlimited
+	uint64_t burst_bytes = 0;         // Bucket depth; raised to at least one chunk
+};
+
+// Time from requesting a chunk grant to receiving it, per class, as a log2 histogram of microseconds.
+struct EgressWaitStats {
+	static constexpr std::size_t kBuckets = 32;
+	std::array<uint64_t, kBuckets> strict{};
+	std::array<uint64_t, kBuckets> normal{};
+	uint64_t granted_chunks = 0;
+	uint64_t granted_bytes = 0;
+
+	// Upper bound (microseconds) of the bucket holding the given percentile (0..100).
+	static uint64_t percentileMicros(const std::array<uint64_t, kBuckets>& histogram, double percentile);
+};
+
+// Optional per-session egress scheduler. Connections attached with SamConnection::setEgressScheduler
+// have every streamWrite cut into chunks of at most chunkSize() bytes, and each chunk waits for a grant.
+// At most max_inflight_chunks grants are outstanding at once (the shared tunnels are the bottleneck);
+// grants go first to strict-priority streams, then deficit round robin by weight over the rest, and
+// a stream whose token bucket is empty is skipped until it refills. A bulk transfer therefore yields
+// to small messages every chunk instead of holding the tunnels for the whole payload.
+// Not thread-safe: use from a single-threaded io_context (as the examples do) or from one strand.
+class SamEgressScheduler {
+public:
+	explicit SamEgressScheduler(const net::any_io_executor& ex,
+		std::size_t chunk_size = 16 * 1024, std::size_t max_inflight_chunks = 1);
+
+	void registerStream(const void* stream, const StreamEgressConfig& config);
+	void unregisterStream(const void* stream);
+
+	// Waits until `bytes` (<= chunkSize()) may be written for `stream`; pair with release().
+	net::awaitable<void> acquire(const void* stream, std::size_t bytes);
+	void release(const void* stream);
+
+	std::size_t chunkSize() const { return chunk_size_; }
+	const EgressWaitStats& stats() const { return stats_; }
+
+private:
+	struct Waiter {
+		std::size_t bytes = 0;
+		bool granted = false;
+	};
+	struct StreamState {
+		StreamEgressConfig config;
+		std::deque<Waiter*> queue;
+		std::size_t deficit = 0;
+		double tokens = 0;
+		SteadyClock::time_point last_refill;
+		bool in_active_list = false;
+		bool unregistered = false;
+		std::size_t granted_outstanding = 0;
+	};
+
+	// Grants as many chunks as the in-flight limit allows; returns when the earliest token-blocked
+	// stream can proceed (time_point::max() if none is blocked on tokens).
+	SteadyClock::time_point dispatch();
+	bool eligible(StreamState& s, SteadyClock::time_point now, SteadyClock::time_point& next_refill);
+	void grant(StreamState& s);
+	void maybeErase(const void* stream);
+
+	std::size_t chunk_size_;
+	std::size_t max_inflight_;
+	std::size_t inflight_ = 0;
+	std::unordered_map<const void*, StreamState> streams_;
+	std::deque<const void*> strict_active_;
+	std::deque<const void*> normal_active_;
+	AsyncCondition wake_;
+	EgressWaitStats stats_;
+};
+
+} // namespace SAM
@@ -0,0 +1,152 @@
+#include "SamFrameCodec.h"
+#include <cstring>
+
+namespace SAM {
+
+SamFrameCodec::SamFrameCodec(std::shared_ptr<SamConnection> connection, PrefixFormat format,
+	std::size_t receive_buffer_size, std::size_t max_frame_size)
+	: connection_(std::move(connection)), format_(format), max_frame_size_(max_frame_size),
+	  rx_(receive_buffer_size) {
+}
+
+bool SamFrameCodec::decodePrefix(std::size_t& prefix_len, std::size_t& frame_len) const {
+	const auto* p = reinterpret_cast<const unsigned char*>(rx_.data() + begin_);
+	const std::size_t available = end_ - begin_;
+	if (format_ == PrefixFormat::FIXED32) {
+		if (available < 4) return false;
+		frame_len = (std::size_t(p[0]) << 24) | (std::size_t(p[1]) << 16) | (std::size_t(p[2]) << 8) | std::size_t(p[3]);
+		prefix_len = 4;
+		return true;
+	}
+	std::size_t value = 0;
+	for (std::size_t i = 0; i < 5; ++i) {
+		if (i >= available) return false;
+		value |= std::size_t(p[i] & 0x7F) << (7 * i);
+		if ((p[i] & 0x80) == 0) {
+			frame_len = value;
+			prefix_len = i + 1;
+			return true;
+		}
+	}
+	throw boost::system::system_error(net::error::message_size, "SamFrameCodec: malformed varint prefix");
+}
+
+std::size_t SamFrameCodec::encodePrefix(std::size_t len, char* out) const {
+	if (format_ == PrefixFormat::FIXED32) {
+		out[0] = static_cast<char>((len >> 24) & 0xFF);
+		out[1] = static_cast<char>((len >> 16) & 0xFF);
+		out[2] = static_cast<char>((len >> 8) & 0xFF);
+		out[3] = static_cast<char>(len & 0xFF);
+		return 4;
+	}
+	std::size_t n = 0;
+	do {
+		char byte = static_cast<char>(len & 0x7F);
+		len >>= 7;
+		if (len) byte |= static_cast<char>(0x80);
+		out[n++] = byte;
+	} while (len);
+	return n;
+}
+
+std::optional<std::string_view> SamFrameCodec::tryReadFrame() {
+	std::size_t prefix_len = 0, frame_len = 0;
+	if (begin_ == end_ || !decodePrefix(prefix_len, frame_len)) return std::nullopt;
+	if (frame_len > max_frame_size_)
+		throw boost::system::system_error(net::error::message_size, "SamFrameCodec: frame exceeds max_frame_size");
+	if (end_ - begin_ < prefix_len + frame_len) return std::nullopt;
+	std::string_view frame(rx_.data() + begin_ + prefix_len, frame_len);
+	begin_ += prefix_len + frame_len;
+	return frame;
+}
+
+net::awaitable<void> SamFrameCodec::fill(SteadyClock::duration timeout) {
+	std::size_t n = co_await connection_->streamRead(net::buffer(rx_.data() + end_, rx_.size() - end_), timeout);
+	if (n == 0) throw boost::system::system_error(net::error::eof, "SamFrameCodec: stream closed");
+	end_ += n;
+}
+
+net::awaitable<std::string_view> SamFrameCodec::readFrame(SteadyClock::duration timeout) {
+	for (;;) {
+		if (auto frame = tryReadFrame()) co_return *frame;
+
+		if (begin_ == end_) {
+			begin_ = end_ = 0;
+		}
+		std::size_t prefix_len = 0, frame_len = 0;
+		bool have_prefix = decodePrefix(prefix_len, frame_len);
+		if (have_prefix && frame_len > max_frame_size_)
+			throw boost::system::system_error(net::error::message_size, "SamFrameCodec: frame exceeds max_frame_size");
+
+		if (have_prefix && prefix_len + frame_len > rx_.size()) {
+			// Larger than the whole receive buffer: assemble it separately and read the rest straight into it.
+			std::size_t have = end_ - begin_ - prefix_len;
+			large_frame_.resize(frame_len);
+			std::memcpy(large_frame_.data(), rx_.data() + begin_ + prefix_len, have);
+			begin_ = end_ = 0;
+			while (have < frame_len) {
+				std::size_t n = co_await connection_->streamRead(net::buffer(large_frame_.data() + have, frame_len - have), timeout);
+				if (n == 0) throw boost::system::system_error(net::error::eof, "SamFrameCodec: stream closed");
+				have += n;
+			}
+			co_return std::string_view(large_frame_.data(), frame_len);
+		}
+
+		if (end_ == rx_.size()) {
+			// The partial frame straddles the end of the buffer: move it to the front (the only copy).
+			std::memmove(rx_.data(), rx_.data() + begin_, end_ - begin_);
+			end_ -= begin_;
+			begin_ = 0;
+		}
+		co_await fill(timeout);
+	}
+}
+
+void SamFrameCodec::queueFrame(net::const_buffer payload) {
+	if (payload.size() > max_frame_size_)
+		throw boost::system::system_error(net::error::message_size, "SamFrameCodec: frame exceeds max_frame_size");
+
+	char prefix[5];
+	std::size_t prefix_len = encodePrefix(payload.size(), prefix);
+	auto append_inline = [this](const char* data, std::size_t len) {
+		std::size_t offset = batch_.size();
+		batch_.append(data, len);
+		if (!segments_.empty() && segments_.back().is_inline) {
+			segments_.back().length += len; // Extend the current contiguous run
+		} else {
+			segments_.push_back(Segment{true, offset, len, {}});
+		}
+	};
+
+	append_inline(prefix, prefix_len);
+	if (payload.size() <= kInlinePayloadLimit) {
+		append_inline(static_cast<const char*>(payload.data()), payload.size());
+	} else {
+		segments_.push_back(Segment{false, 0, payload.size(), payload});
+	}
+	queued_frames_++;
+	queued_bytes_ += prefix_len + payload.size();
+}
+
+net::awaitable<void> SamFrameCodec::flush(SteadyClock::duration timeout) {
+	if (segments_.empty()) co_return;
+	// Hand the batch over to the in-flight slot so frames queued while this write is pending
+	// cannot reallocate the bytes the socket is still sending.
+	std::swap(batch_, inflight_batch_);
+	batch_.clear();
+	gather_.clear();
+	for (const auto& seg : segments_) {
+		gather_.push_back(seg.is_inline ? net::buffer(inflight_batch_.data() + seg.offset, seg.length) : seg.external);
+	}
+	segments_.clear();
+	queued_frames_ = 0;
+	queued_bytes_ = 0;
+	co_await connection_->streamWrite(std::span<const net::const_buffer>(gather_), timeout);
+}
+
+net::awaitable<void> SamFrameCodec::writeFrame(net::const_buffer payload, SteadyClock::duration timeout) {
+	queueFrame(payload);
+	co_await flush(timeout);
+}
+
+} // namespace SAM
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <memory>
+#include <vector>
+#include <optional>
+#include <boost/asio.hpp>
+#include "SamConnection.h"
+
+namespace net = boost::asio;
+
+namespace SAM {
+
+// Length-prefixed message framing on a data-mode SamConnection.
+//
+// Receive side: bytes are read into one large buffer and complete frames are handed out as views
+// into it, without copying. A view stays valid until the next readFrame()/tryReadFrame() call.
+// Only a frame that straddles the end of the buffer is moved (or, if larger than the buffer,
+// assembled in a separate allocation).
+//
+// Send side: queueFrame() batches frames; flush() sends everything queued with one gathered write.
+// Small payloads are copied next to their prefix so a batch of tiny frames becomes a single
+// contiguous buffer; larger payloads are referenced and must stay alive until flush() completes.
+class SamFrameCodec {
+public:
+	enum class PrefixFormat {
+		VARINT,  // LEB128, 1-5 bytes
+		FIXED32  // 4-byte big-endian
+	};
+
+	explicit SamFrameCodec(std::shared_ptr<SamConnection> connection,
+		PrefixFormat format = PrefixFormat::VARINT,
+		std::size_t receive_buffer_size = 256 * 1024,
+		std::size_t max_frame_size = 16 * 1024 * 1024);
+
+	net::awaitable<std::string_view> readFrame(SteadyClock::duration timeout = std::chrono::minutes(5));
+	// Returns the next frame if it is already fully buffered, without touching the socket.
+	std::optional<std::string_view> tryReadFrame();
+
+	void queueFrame(net::const_buffer payload);
+	// Only one flush() may be outstanding at a time; frames may be queued while it runs.
+	net::awaitable<void> flush(SteadyClock::duration timeout = std::chrono::seconds(30));
+	net::awaitable<void> writeFrame(net::const_buffer payload, SteadyClock::duration timeout = std::chrono::seconds(30));
+
+	std::size_t queuedFrames() const { return queued_frames_; }
+	std::size_t queuedBytes() const { return queued_bytes_; }
+	std::shared_ptr<SamConnection> connection() const { return connection_; }
+
+	static constexpr std::size_t kInlinePayloadLimit = 512;
+
+private:
+	// Decodes the prefix at rx_[begin_]; false if more bytes are needed.
+	bool decodePrefix(std::size_t& prefix_len, std::size_t& frame_len) const;
+	std::size_t encodePrefix(std::size_t len, char* out) const;
+	net::awaitable<void> fill(SteadyClock::duration timeout);
+
+	struct Segment {
+		bool is_inline;
+		std::size_t offset; // Into batch_ when inline
+		std::size_t length;
+		net::const_buffer external;
+	};
+
+	std::shared_ptr<SamConnection> connection_;
+	PrefixFormat format_;
+	std::size_t max_frame_size_;
+
+	std::vector<char> rx_;
+	std::size_t begin_ = 0; // First unparsed byte
+	std::size_t end_ = 0;   // One past the last received byte
+	std::string large_frame_;
+
+	std::string batch_;
+	std::string inflight_batch_; // Batch currently being written by flush()
+	std::vector<Segment> segments_;
+	std::vector<net::const_buffer> gather_;
+	std::size_t queued_frames_ = 0;
+	std::size_t queued_bytes_ = 0;
+};
+
+} // namespace SAM
@@ -0,0 +1,267 @@
+#include "SamHandoff.h"
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <poll.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <sstream>
+
+namespace SAM {
+namespace Handoff {
+
+namespace {
+
+const char* kHeader = "SAMHANDOFF 1";
+
+std::string toHex(const std::string& bytes) {
+	static const char digits[] = "0123456789abcdef";
+	std::string out;
+	out.reserve(bytes.size() * 2);
+	for (unsigned char c : bytes) {
+		out += digits[c >> 4];
+		out += digits[c & 0x0F];
+	}
+	return out;
+}
+
+std::string fromHex(const std::string& hex) {
+	auto nibble = [](char c) -> int {
+		if (c >= '0' && c <= '9') return c - '0';
+		if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+		return 0;
+	};
+	std::string out;
+	for (std::size_t i = 0; i + 1 < hex.size(); i += 2) {
+		out += static_cast<char>((nibble(hex[i]) << 4) | nibble(hex[i + 1]));
+	}
+	return out;
+}
+
+using Deadline = std::chrono::steady_clock::time_point;
+
+// Waits for a non-blocking socket to become ready; false (errno = ETIMEDOUT) once the deadline passed.
+bool waitReady(int fd, short events, Deadline deadline) {
+	for (;;) {
+		int timeout_ms = -1;
+		if (deadline != Deadline::max()) {
+			auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+			timeout_ms = static_cast<int>(std::max<std::chrono::milliseconds::rep>(0, left.count()));
+		}
+		pollfd pfd{fd, events, 0};
+		int n = ::poll(&pfd, 1, timeout_ms);
+		if (n < 0 && errno == EINTR) continue;
+		if (n == 0) errno = ETIMEDOUT;
+		return n > 0;
+	}
+}
+
+bool writeAll(int fd, const char* data, std::size_t len, Deadline deadline) {
+	while (len > 0) {
+		ssize_t n = ::send(fd, data, len, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR) continue;
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			if (!waitReady(fd, POLLOUT, deadline)) return false;
+			continue;
+		}
+		if (n <= 0) return false;
+		data += n;
+		len -= static_cast<std::size_t>(n);
+	}
+	return true;
+}
+
+bool readAll(int fd, char* data, std::size_t len, Deadline deadline) {
+	while (len > 0) {
+		ssize_t n = ::recv(fd, data, len, 0);
+		if (n < 0 && errno == EINTR) continue;
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			if (!waitReady(fd, POLLIN, deadline)) return false;
+			continue;
+		}
+		if (n <= 0) return false;
+		data += n;
+		len -= static_cast<std::size_t>(n);
+	}
+	return true;
+}
+
+} // namespace
+
+bool send(int unix_socket_fd, const HandoffState& state, std::chrono::milliseconds timeout,
+	std::string& error_message) {
+	const Deadline deadline = std::chrono::steady_clock::now() + timeout;
+	std::vector<int> fds;
+	fds.push_back(state.control.fd);
+	for (const auto& parked : state.parked_accepts) fds.push_back(parked.fd);
+	if (fds.size() > kMaxSockets + 1) {
+		error_message = "Handoff: too many parked accept sockets";
+		return false;
+	}
+
+	// Descriptor order: control first, then parked accepts in the order listed in the payload.
+	std::ostringstream payload;
+	payload << kHeader << "\n"
+			<< "SESSION_ID=" << state.session_id << "\n"
+			<< "LOCAL_B32=" << state.local_b32_address << "\n"
+			<< "DESTINATION=" << state.raw_destination << "\n"
+			<< "CONTROL_BUFFERED=" << toHex(state.control.buffered) << "\n"
+			<< "ACCEPTS=" << state.parked_accepts.size() << "\n";
+	for (const auto& parked : state.parked_accepts) {
+		payload << "ACCEPT_BUFFERED=" << toHex(parked.buffered) << "\n";
+	}
+	std::string body = payload.str();
+	uint32_t body_len = static_cast<uint32_t>(body.size());
+
+	// The length prefix carries the SCM_RIGHTS message; the body follows as plain stream data.
+	std::vector<char> control_buf(CMSG_SPACE(sizeof(int) * fds.size()));
+	iovec iov{};
+	iov.iov_base = &body_len;
+	iov.iov_len = sizeof(body_len);
+	msghdr msg{};
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control_buf.data();
+	msg.msg_controllen = control_buf.size();
+	cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+	std::memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+
+	ssize_t sent;
+	for (;;) {
+		sent = ::sendmsg(unix_socket_fd, &msg, MSG_NOSIGNAL);
+		if (sent < 0 && errno == EINTR) continue;
+		if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && waitReady(unix_socket_fd, POLLOUT, deadline)) continue;
+		break;
+	}
+	if (sent != static_cast<ssize_t>(sizeof(body_len))) {
+		error_message = std::string("Handoff: sendmsg failed: ") + std::strerror(errno);
+		return false;
+	}
+	if (!writeAll(unix_socket_fd, body.data(), body.size(), deadline)) {
+		error_message = std::string("Handoff: payload write failed: ") + std::strerror(errno);
+		return false;
+	}
+	// Wait for the new owner's acknowledgement before the caller lets go of its descriptors.
+	char ack = 0;
+	if (!readAll(unix_socket_fd, &ack, 1, deadline) || ack != 'K') {
+		error_message = errno == ETIMEDOUT ? "Handoff: receiver did not acknowledge in time"
+			: "Handoff: receiver did not acknowledge";
+		return false;
+	}
+	return true;
+}
+
+bool receive(int unix_socket_fd, HandoffState& state, std::string& error_message) {
+	uint32_t body_len = 0;
+	std::vector<char> control_buf(CMSG_SPACE(sizeof(int) * (kMaxSockets + 1)));
+	iovec iov{};
+	iov.iov_base = &body_len;
+	iov.iov_len = sizeof(body_len);
+	msghdr msg{};
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control_buf.data();
+	msg.msg_controllen = control_buf.size();
+
+	ssize_t got;
+	do {
+		got = ::recvmsg(unix_socket_fd, &msg, MSG_CMSG_CLOEXEC | MSG_WAITALL);
+	} while (got < 0 && errno == EINTR);
+	if (got != static_cast<ssize_t>(sizeof(body_len))) {
+		error_message = "Handoff: no handoff message received";
+		return false;
+	}
+
+	std::vector<int> fds;
+	for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+			std::size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+			const int* data = reinterpret_cast<const int*>(CMSG_DATA(cmsg));
+			fds.insert(fds.end(), data, data + count);
+		}
+	}
+	auto close_all = [&fds]() { for (int fd : fds) ::close(fd); };
+	if (fds.empty() || (msg.msg_flags & MSG_CTRUNC)) {
+		close_all();
+		error_message = "Handoff: descriptors missing or truncated";
+		return false;
+	}
+
+	if (body_len > kMaxPayloadBytes) {
+		close_all();
+		error_message = "Handoff: payload of " + std::to_string(body_len) + " bytes is too large";
+		return false;
+	}
+	std::string body(body_len, '\0');
+	if (!readAll(unix_socket_fd, body.data(), body.size(), Deadline::max())) {
+		close_all();
+		error_message = "Handoff: payload truncated";
+		return false;
+	}
+
+	std::istringstream lines(body);
+	std::string line;
+	std::getline(lines, line);
+	if (line != kHeader) {
+		close_all();
+		error_message = "Handoff: unsupported payload version";
+		return false;
+	}
+	std::vector<std::string> accept_buffers;
+	std::size_t accepts = 0;
+	while (std::getline(lines, line)) {
+		auto eq = line.find('=');
+		if (eq == std::string::npos) continue;
+		std::string key = line.substr(0, eq);
+		std::string value = line.substr(eq + 1);
+		if (key == "SESSION_ID") state.session_id = value;
+		else if (key == "LOCAL_B32") state.local_b32_address = value;
+		else if (key == "DESTINATION") state.raw_destination = value;
+		else if (key == "CONTROL_BUFFERED") state.control.buffered = fromHex(value);
+		else if (key == "ACCEPTS") {
+			auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), accepts);
+			if (ec != std::errc() || end != value.data() + value.size() || accepts > kMaxSockets) {
+				close_all();
+				error_message = "Handoff: invalid ACCEPTS value '" + value + "'";
+				return false;
+			}
+		}
+		else if (key == "ACCEPT_BUFFERED") accept_buffers.push_back(fromHex(value));
+	}
+	if (fds.size() != accepts + 1 || accept_buffers.size() != accepts) {
+		close_all();
+		error_message = "Handoff: descriptor count does not match payload";
+		return false;
+	}
+
+	state.control.fd = fds[0];
+	state.parked_accepts.clear();
+	for (std::size_t i = 0; i < accepts; ++i) {
+		state.parked_accepts.push_back(HandoffSocket{fds[i + 1], accept_buffers[i]});
+	}
+	const char ack = 'K';
+	writeAll(unix_socket_fd, &ack, 1, Deadline::max());
+	return true;
+}
+
+bool peerIsSameUser(int unix_socket_fd, std::string& error_message) {
+	ucred credentials{};
+	socklen_t length = sizeof(credentials);
+	if (::getsockopt(unix_socket_fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) != 0) {
+		error_message = std::string("Handoff: SO_PEERCRED failed: ") + std::strerror(errno);
+		return false;
+	}
+	if (credentials.uid != ::geteuid()) {
+		error_message = "Handoff: peer runs as uid " + std::to_string(credentials.uid) + ", not ours";
+		return false;
+	}
+	return true;
+}
+
+} // namespace Handoff
+} // namespace SAM
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace SAM {
+
+// A socket passed between processes, plus bytes the old owner had already read but not consumed.
+struct HandoffSocket {
+	int fd = -1;
+	std::string buffered;
+};
+
+// Everything a new process needs to take over a live SAM session without SESSION CREATE.
+struct HandoffState {
+	std::string session_id;
+	std::string local_b32_address;
+	std::string raw_destination;               // DESTINATION= field of the original SESSION STATUS reply
+	HandoffSocket control;                     // HELLO'd connection that owns the SAM session
+	std::vector<HandoffSocket> parked_accepts; // STREAM ACCEPT issued, still waiting for FROM_DESTINATION
+};
+
+// Transfers HandoffState over a connected Unix domain socket: the descriptors travel as SCM_RIGHTS
+// ancillary data, the rest as a small length-prefixed text payload. They run once per restart.
+// send gives up once timeout has passed (also on a non-blocking socket), so a stalled peer cannot
+// hold the caller for longer; receive blocks. Received descriptors are close-on-exec, and every one
+// of them is closed again when receive fails.
+namespace Handoff {
+	constexpr std::size_t kMaxSockets = 250; // Below the kernel's SCM_MAX_FD (253)
+	constexpr std::size_t kMaxPayloadBytes = 16 * 1024 * 1024;
+
+	bool send(int unix_socket_fd, const HandoffState& state, std::chrono::milliseconds timeout,
+		std::string& error_message);
+	bool receive(int unix_socket_fd, HandoffState& state, std::string& error_message);
+	// True when the process at the other end of the Unix socket runs as our effective uid (SO_PEERCRED).
+	bool peerIsSameUser(int unix_socket_fd, std::string& error_message);
+} // namespace Handoff
+
+} // namespace SAM
@@ -0,0 +1,225 @@
+#include "SamHost.h"
+#include "SamAsyncUtils.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+namespace SAM {
+
+SamHost::SamHost(net::io_context& io_ctx, const SamBridgeEndpoint& bridge)
+	: io_ctx_(io_ctx), bridge_(bridge), name_cache_(std::make_shared<SamNameCache>(io_ctx.get_executor())) {
+}
+
+SamHost::~SamHost() {
+	shutdown();
+}
+
+void SamHost::addDestination(const HostedDestinationConfig& config) {
+	if (by_nickname_.count(config.nickname)) {
+		SPDLOG_WARN("SamHost: destination '{}' already added, ignoring.", config.nickname);
+		return;
+	}
+	HostedDestination dest;
+	dest.config = config;
+	by_nickname_[config.nickname] = destinations_.size();
+	destinations_.push_back(std::move(dest));
+}
+
+bool SamHost::loadConfig(const std::string& path, std::string& error_message) {
+	std::ifstream in(path);
+	if (!in) {
+		error_message = "Cannot open host config " + path;
+		return false;
+	}
+	std::vector<HostedDestinationConfig> configs;
+	std::string line;
+	std::size_t line_no = 0;
+	while (std::getline(in, line)) {
+		++line_no;
+		std::istringstream fields(line);
+		std::string field;
+		HostedDestinationConfig config;
+		bool any = false;
+		while (fields >> field) {
+			if (field[0] == '#') break;
+			auto eq = field.find('=');
+			if (eq == std::string::npos || eq == 0) {
+				error_message = path + ":" + std::to_string(line_no) + ": expected key=value, got '" + field + "'";
+				return false;
+			}
+			any = true;
+			std::string key = field.substr(0, eq);
+			std::string value = field.substr(eq + 1);
+			if (key == "nickname") {
+				config.nickname = value;
+			} else if (key == "key") {
+				if (!value.empty() && value[0] == '@') {
+					std::ifstream key_file(value.substr(1));
+					if (!(key_file >> config.private_key_b64)) {
+						error_message = path + ":" + std::to_string(line_no) + ": cannot read key file " + value.substr(1);
+						return false;
+					}
+				} else {
+					config.private_key_b64 = value;
+				}
+			} else if (key == "sigtype") {
+				config.signature_type = value;
+			} else if (key == "accepts") {
+				config.accepts = std::max<std::size_t>(1, std::strtoul(value.c_str(), nullptr, 10));
+			} else {
+				config.options[key] = value;
+			}
+		}
+		if (!any) continue;
+		if (config.nickname.empty()) {
+			error_message = path + ":" + std::to_string(line_no) + ": missing nickname=";
+			return false;
+		}
+		configs.push_back(std::move(config));
+	}
+	for (const auto& config : configs) addDestination(config);
+	SPDLOG_INFO("SamHost: loaded {} destination(s) from {}", configs.size(), path);
+	return true;
+}
+
+void SamHost::setHandler(const std::string& nickname, StreamHandler handler) {
+	handlers_[nickname] = std::move(handler);
+}
+
+void SamHost::setDefaultHandler(StreamHandler handler) {
+	default_handler_ = std::move(handler);
+}
+
+std::size_t SamHost::running() const {
+	std::size_t up = 0;
+	for (const auto& dest : destinations_) {
+		if (dest.session.success && dest.service && dest.service->isOpen()) ++up;
+	}
+	return up;
+}
+
+const HostedDestination* SamHost::destination(const std::string& nickname) const {
+	auto it = by_nickname_.find(nickname);
+	return it == by_nickname_.end() ? nullptr : &destinations_[it->second];
+}
+
+void SamHost::shutdown() {
+	running_ = false;
+	for (auto& dest : destinations_) {
+		if (dest.service) dest.service->shutdown();
+		dest.session.success = false;
+	}
+}
+
+net::awaitable<std::size_t> SamHost::start(std::size_t max_parallel_startups) {
+	auto self = shared_from_this();
+	running_ = true;
+	auto queue = std::make_shared<std::vector<std::size_t>>();
+	for (std::size_t i = destinations_.size(); i-- > 0;) { // Popped from the back: start in config order
+		if (!destinations_[i].session.success) queue->push_back(i);
+	}
+	const std::vector<std::size_t> starting = *queue; // Already-up destinations keep their accept loops
+
+	auto start_time = std::chrono::steady_clock::now();
+	std::size_t workers = std::min(std::max<std::size_t>(1, max_parallel_startups), queue->size());
+	// Shared with the workers, which may outlive this frame if start() is abandoned.
+	auto pending = std::make_shared<AsyncWaitGroup>(io_ctx_.get_executor());
+	// Each worker takes the next destination as soon as its previous one is up (or failed), so a
+	// slow tunnel build only holds up its own slot.
+	for (std::size_t w = 0; w < workers; ++w) {
+		pending->add();
+		net::co_spawn(io_ctx_,
+			[this, self, queue, pending]() -> net::awaitable<void> {
+				co_await startupWorker(queue);
+				pending->done();
+			},
+			net::detached);
+	}
+	co_await pending->wait();
+
+	for (std::size_t i : starting) {
+		if (!destinations_[i].session.success) continue;
+		for (std::size_t n = 0; n < destinations_[i].config.accepts; ++n) {
+			net::co_spawn(io_ctx_, acceptLoop(i), net::detached);
+		}
+	}
+	std::size_t up = 0;
+	for (const auto& dest : destinations_) {
+		if (dest.session.success) ++up;
+	}
+	auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time);
+	SPDLOG_INFO("SamHost: {}/{} destination(s) up in {} ms ({} parallel startups).",
+		up, destinations_.size(), elapsed.count(), workers);
+	co_return up;
+}
+
+net::awaitable<void> SamHost::startupWorker(std::shared_ptr<std::vector<std::size_t>> queue) {
+	while (running_ && !queue->empty()) {
+		std::size_t index = queue->back();
+		queue->pop_back();
+		auto& dest = destinations_[index];
+		dest.service = std::make_shared<SamService>(io_ctx_, bridge_);
+		dest.service->setNameCache(name_cache_);
+		try {
+			dest.session = co_await dest.service->establishControlSession(
+				dest.config.nickname, dest.config.private_key_b64, dest.config.signature_type, dest.config.options);
+		} catch (const std::exception& e) {
+			dest.session.success = false;
+			dest.session.error_message = e.what();
+		}
+		if (dest.session.success) {
+			SPDLOG_INFO("SamHost: '{}' up as {} in {} ms.", dest.config.nickname, dest.session.local_b32_address,
+				dest.session.session_creation_duration.count());
+		} else {
+			SPDLOG_ERROR("SamHost: '{}' failed to start: {}", dest.config.nickname, dest.session.error_message);
+		}
+	}
+}
+
+net::awaitable<void> SamHost::acceptLoop(std::size_t index) {
+	auto self = shared_from_this();
+	while (running_ && destinations_[index].session.success) {
+		auto service = destinations_[index].service;
+		const std::string nickname = destinations_[index].config.nickname;
+		SetupStreamResult accept_res = co_await service->acceptStreamViaNewConnection(nickname);
+		if (!running_) break;
+		if (!accept_res.success || !accept_res.data_connection) {
+			if (!service->isOpen()) {
+				SPDLOG_ERROR("SamHost: control session of '{}' lost, accept loop stopped.", nickname);
+				destinations_[index].session.success = false;
+				break;
+			}
+			SPDLOG_WARN("SamHost: accept on '{}' failed: {}", nickname, accept_res.error_message);
+			net::steady_timer backoff(io_ctx_, std::chrono::seconds(1));
+			co_await backoff.async_wait(net::use_awaitable);
+			continue;
+		}
+		destinations_[index].streams_accepted++;
+		auto handler = handlers_.find(nickname);
+		const StreamHandler& route = handler != handlers_.end() ? handler->second : default_handler_;
+		if (!route) {
+			SPDLOG_WARN("SamHost: no handler for '{}', closing stream from {}.", nickname, accept_res.remote_peer_b32_address);
+			accept_res.data_connection->closeSocket();
+			continue;
+		}
+		net::co_spawn(io_ctx_, route(nickname, std::move(accept_res)), net::detached);
+	}
+}
+
+net::awaitable<SetupStreamResult> SamHost::connectFrom(
+	const std::string& nickname,
+	const std::string& target_peer_i2p_address_b32,
+	const std::map<std::string, std::string>& stream_connect_options) {
+
+	auto it = by_nickname_.find(nickname);
+	if (it == by_nickname_.end() || !destinations_[it->second].session.success) {
+		SetupStreamResult result;
+		result.remote_peer_b32_address = target_peer_i2p_address_b32;
+		result.error_message = "SamHost: destination '" + nickname + "' is not up.";
+		co_return result;
+	}
+	auto service = destinations_[it->second].service;
+	co_return co_await service->connectToPeerViaNewConnection(nickname, target_peer_i2p_address_b32, stream_connect_options);
+}
+
+} // namespace SAM
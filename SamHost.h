@@ -0,0 +1,93 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <map>
+#include <vector>
+#include <functional>
+#include <boost/asio.hpp>
+#include "SamService.h"
+
+namespace net = boost::asio;
+
+namespace SAM {
+
+// One destination hosted by a SamHost.
+struct HostedDestinationConfig {
+	std::string nickname;                            // SAM session ID, also the routing key
+	std::string private_key_b64 = "TRANSIENT";
+	std::string signature_type;                      // Empty for TRANSIENT
+	std::map<std::string, std::string> options = {
+		{"i2p.streaming.profile", "INTERACTIVE"}, 
+		{"inbound.length", "1"}, 
+		{"outbound.length", "1"}};
+	std::size_t accepts = 1;                         // STREAM ACCEPTs kept armed
+};
+
+struct HostedDestination {
+	HostedDestinationConfig config;
+	std::shared_ptr<SamService> service;
+	EstablishSessionResult session;                  // success == false if startup failed
+	std::size_t streams_accepted = 0;
+};
+
+// Multi-tenant host: many SAM sessions (one per destination) in one process, sharing the io_context
+// and a name cache. start() brings sessions up in parallel, at most max_parallel_startups at a time,
+// so total startup approaches the slowest single session rather than the sum. Accepted streams are
+// routed to the handler registered for their destination, or the default handler.
+// Not thread-safe: drive from a single-threaded io_context (as the examples do) or from one strand.
+class SamHost : public std::enable_shared_from_this<SamHost> {
+public:
+	using StreamHandler = std::function<net::awaitable<void>(std::string nickname, SetupStreamResult)>;
+
+	SamHost(net::io_context& io_ctx, const SamBridgeEndpoint& bridge);
+	~SamHost();
+
+	// Add destinations before start(); they are not to be added while a start() is running.
+	void addDestination(const HostedDestinationConfig& config);
+	// One destination per non-empty, non-# line of whitespace separated key=value fields:
+	//   nickname=web key=TRANSIENT accepts=4 inbound.length=2
+	//   nickname=mail key=@/etc/samon/mail.key sigtype=7
+	// key=@path reads the base64 private key from a file; other keys are SAM session options.
+	// Returns false (with error_message) on the first malformed line; nothing is added then.
+	bool loadConfig(const std::string& path, std::string& error_message);
+
+	void setHandler(const std::string& nickname, StreamHandler handler);
+	void setDefaultHandler(StreamHandler handler);
+
+	// Establishes all added destinations that are not yet up and arms their accepts.
+	// Returns the number of destinations up afterwards.
+	net::awaitable<std::size_t> start(std::size_t max_parallel_startups = 8);
+
+	// Outbound stream from one of the hosted destinations.
+	net::awaitable<SetupStreamResult> connectFrom(
+		const std::string& nickname,
+		const std::string& target_peer_i2p_address_b32,
+		const std::map<std::string, std::string>& stream_connect_options = {
+			{"i2p.streaming.profile", "INTERACTIVE"}, 
+			{"inbound.length", "1"}, 
+			{"outbound.length", "1"}}
+	);
+
+	const HostedDestination* destination(const std::string& nickname) const;
+	std::size_t size() const { return destinations_.size(); }
+	std::size_t running() const;
+	SamNameCache& nameCache() { return *name_cache_; }
+
+	void shutdown();
+
+private:
+	net::awaitable<void> startupWorker(std::shared_ptr<std::vector<std::size_t>> queue);
+	net::awaitable<void> acceptLoop(std::size_t index);
+
+	net::io_context& io_ctx_;
+	SamBridgeEndpoint bridge_;
+	std::shared_ptr<SamNameCache> name_cache_;
+	std::vector<HostedDestination> destinations_;
+	std::map<std::string, std::size_t> by_nickname_;
+	std::map<std::string, StreamHandler> handlers_;
+	StreamHandler default_handler_;
+	bool running_ = false;
+};
+
+} // namespace SAM
@@ -3,6 +3,7 @@
 #include <string>
 #include <vector>
 #include <map> // Included for completeness, though not heavily used in current simple parser
+#include <boost/system/error_code.hpp>
 
 namespace SAM {
 
@@ -37,6 +38,8 @@ namespace SAM {
 		std::string original_message; 
 
 		std::string message_text; 
+		// Set when no reply line arrived because of a local I/O error (e.g. timed_out)
+		boost::system::error_code error;
 
 		// NAMING_REPLY specific
 		std::string name;
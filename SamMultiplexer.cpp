@@ -0,0 +1,309 @@
+#include "SamMultiplexer.h"
+#include <algorithm>
+
+namespace SAM {
+
+namespace {
+
+void putU32(char* out, uint32_t v) {
+	out[0] = static_cast<char>((v >> 24) & 0xFF);
+	out[1] = static_cast<char>((v >> 16) & 0xFF);
+	out[2] = static_cast<char>((v >> 8) & 0xFF);
+	out[3] = static_cast<char>(v & 0xFF);
+}
+
+uint32_t getU32(const char* in) {
+	const auto* p = reinterpret_cast<const unsigned char*>(in);
+	return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+SteadyClock::time_point deadlineAfter(SteadyClock::duration timeout) {
+	if (timeout <= SteadyClock::duration::zero() || timeout == SteadyClock::duration::max())
+		return SteadyClock::time_point::max();
+	return SteadyClock::now() + timeout;
+}
+
+} // namespace
+
+// ---------------------------------------------------------------------------
+// SamSubstream
+
+SamSubstream::SamSubstream(std::shared_ptr<SamMultiplexer> mux, uint32_t id, uint8_t priority, uint32_t initial_window)
+	: mux_(mux), id_(id), priority_(priority), initial_window_(initial_window), send_window_(initial_window),
+	  recv_window_(initial_window),
+	  readable_(mux->connection()->get_executor()), writable_(mux->connection()->get_executor()) {
+}
+
+net::awaitable<std::size_t> SamSubstream::streamRead(net::mutable_buffer buffer, SteadyClock::duration timeout) {
+	const auto deadline = deadlineAfter(timeout);
+	while (recv_buffer_.empty()) {
+		if (reset_) throw boost::system::system_error(net::error::connection_reset, "Substream reset");
+		if (remote_fin_) throw boost::system::system_error(net::error::eof, "Substream finished");
+		if (!co_await readable_.waitUntil(deadline))
+			throw boost::system::system_error(net::error::timed_out, "Substream read timeout");
+	}
+
+	std::size_t n = std::min(buffer.size(), recv_buffer_.size());
+	std::copy_n(recv_buffer_.begin(), n, static_cast<char*>(buffer.data()));
+	recv_buffer_.erase(recv_buffer_.begin(), recv_buffer_.begin() + static_cast<std::ptrdiff_t>(n));
+
+	// Return credit in batches of half a window so WINDOW_UPDATE traffic stays small.
+	consumed_since_update_ += static_cast<uint32_t>(n);
+	auto mux = mux_.lock();
+	if (mux && !remote_fin_ && !reset_ && consumed_since_update_ >= initial_window_ / 2) {
+		mux->enqueueFrame(SamMultiplexer::FrameType::WINDOW_UPDATE, id_, priority_, consumed_since_update_);
+		recv_window_ += consumed_since_update_;
+		consumed_since_update_ = 0;
+	}
+	co_return n;
+}
+
+net::awaitable<void> SamSubstream::streamWrite(net::const_buffer buffer, SteadyClock::duration timeout) {
+	const auto deadline = deadlineAfter(timeout);
+	const char* data = static_cast<const char*>(buffer.data());
+	std::size_t remaining = buffer.size();
+	while (remaining > 0) {
+		if (reset_) throw boost::system::system_error(net::error::connection_reset, "Substream reset");
+		if (local_fin_) throw boost::system::system_error(net::error::shut_down, "Substream write side closed");
+		auto mux = mux_.lock();
+		if (!mux || !mux->isOpen()) throw boost::system::system_error(net::error::not_connected, "Multiplexer closed");
+
+		if (send_window_ == 0) {
+			if (!co_await writable_.waitUntil(deadline))
+				throw boost::system::system_error(net::error::timed_out, "Substream write timeout (no window)");
+			continue;
+		}
+		std::size_t chunk = std::min<std::size_t>({remaining, send_window_, SamMultiplexer::kMaxFramePayload});
+		mux->enqueueFrame(SamMultiplexer::FrameType::DATA, id_, priority_,
+			static_cast<uint32_t>(chunk), std::string(data, chunk));
+		send_window_ -= static_cast<uint32_t>(chunk);
+		data += chunk;
+		remaining -= chunk;
+	}
+}
+
+void SamSubstream::shutdownWrite() {
+	if (local_fin_ || reset_) return;
+	local_fin_ = true;
+	if (auto mux = mux_.lock()) {
+		mux->enqueueFrame(SamMultiplexer::FrameType::FIN, id_, priority_, 0);
+		mux->releaseIfDone(shared_from_this());
+	}
+}
+
+void SamSubstream::reset() {
+	if (reset_) return;
+	auto mux = mux_.lock();
+	if (mux) mux->enqueueFrame(SamMultiplexer::FrameType::RST, id_, priority_, 0);
+	onReset();
+	if (mux) mux->releaseIfDone(shared_from_this());
+}
+
+void SamSubstream::onData(const char* data, std::size_t len) {
+	if (reset_ || remote_fin_) return;
+	if (len > recv_window_) { // The peer ignored flow control; buffering it would be unbounded
+		SPDLOG_WARN("SamMultiplexer: substream {} received {} bytes with a window of {}, resetting.", id_, len, recv_window_);
+		reset();
+		return;
+	}
+	recv_window_ -= static_cast<uint32_t>(len);
+	recv_buffer_.insert(recv_buffer_.end(), data, data + len);
+	readable_.notifyAll();
+}
+
+void SamSubstream::onWindowUpdate(uint32_t increment) {
+	send_window_ += increment;
+	writable_.notifyAll();
+}
+
+void SamSubstream::onFin() {
+	remote_fin_ = true;
+	readable_.notifyAll();
+}
+
+void SamSubstream::onReset() {
+	reset_ = true;
+	readable_.notifyAll();
+	writable_.notifyAll();
+}
+
+// ---------------------------------------------------------------------------
+// SamMultiplexer
+
+SamMultiplexer::SamMultiplexer(std::shared_ptr<SamConnection> connection, Role role, uint32_t initial_window)
+	: connection_(std::move(connection)), role_(role), initial_window_(initial_window),
+	  next_stream_id_(role == Role::INITIATOR ? 1 : 2),
+	  send_ready_(connection_->get_executor()), accept_ready_(connection_->get_executor()) {
+}
+
+SamMultiplexer::~SamMultiplexer() {
+	running_ = false;
+}
+
+void SamMultiplexer::start() {
+	if (running_) return;
+	running_ = true;
+	auto self = shared_from_this();
+	net::co_spawn(connection_->get_executor(), [self]() { return self->readerLoop(); }, net::detached);
+	net::co_spawn(connection_->get_executor(), [self]() { return self->writerLoop(); }, net::detached);
+}
+
+void SamMultiplexer::close() {
+	if (!running_) return;
+	running_ = false;
+	failAll();
+	if (connection_ && connection_->isOpen()) connection_->closeSocket();
+}
+
+std::shared_ptr<SamSubstream> SamMultiplexer::openSubstream(uint8_t priority) {
+	uint32_t id = next_stream_id_;
+	next_stream_id_ += 2;
+	auto substream = std::make_shared<SamSubstream>(shared_from_this(), id, priority, initial_window_);
+	substreams_[id] = substream;
+	if (running_) open_queue_.push_back(makeFrame(FrameType::DATA, id, priority, 0, {}));
+	send_ready_.notifyAll();
+	return substream;
+}
+
+net::awaitable<std::shared_ptr<SamSubstream>> SamMultiplexer::acceptSubstream() {
+	while (pending_accepts_.empty()) {
+		if (!running_) co_return nullptr;
+		co_await accept_ready_.wait();
+	}
+	auto substream = pending_accepts_.front();
+	pending_accepts_.pop_front();
+	co_return substream;
+}
+
+SamMultiplexer::OutFrame SamMultiplexer::makeFrame(
+	FrameType type, uint32_t stream_id, uint8_t priority, uint32_t length_field, std::string payload) {
+	OutFrame frame;
+	frame.header[0] = static_cast<char>(type);
+	frame.header[1] = 0;
+	frame.header[2] = static_cast<char>(priority);
+	frame.header[3] = 0;
+	putU32(frame.header.data() + 4, stream_id);
+	putU32(frame.header.data() + 8, length_field);
+	frame.payload = std::move(payload);
+	return frame;
+}
+
+void SamMultiplexer::enqueueFrame(FrameType type, uint32_t stream_id, uint8_t priority, uint32_t length_field, std::string payload) {
+	if (!running_) return;
+	send_queues_[priority].push_back(makeFrame(type, stream_id, priority, length_field, std::move(payload)));
+	send_ready_.notifyAll();
+}
+
+net::awaitable<void> SamMultiplexer::writerLoop() {
+	auto self = shared_from_this();
+	std::vector<OutFrame> batch;
+	std::vector<net::const_buffer> buffers;
+	try {
+		while (running_) {
+			auto it = std::find_if(send_queues_.begin(), send_queues_.end(),
+				[](const auto& entry) { return !entry.second.empty(); });
+			if (open_queue_.empty() && it == send_queues_.end()) {
+				co_await send_ready_.wait();
+				continue;
+			}
+			// Coalesce pending opens, or else frames of the most urgent non-empty priority, into a
+			// single gathered write.
+			batch.clear();
+			buffers.clear();
+			std::size_t batch_bytes = 0;
+			auto& queue = open_queue_.empty() ? it->second : open_queue_;
+			while (!queue.empty() && batch_bytes < 4 * kMaxFramePayload) {
+				batch_bytes += kHeaderSize + queue.front().payload.size();
+				batch.push_back(std::move(queue.front()));
+				queue.pop_front();
+			}
+			for (const auto& frame : batch) {
+				buffers.push_back(net::buffer(frame.header));
+				if (!frame.payload.empty()) buffers.push_back(net::buffer(frame.payload));
+			}
+			co_await connection_->streamWrite(std::span<const net::const_buffer>(buffers), SteadyClock::duration::max());
+		}
+	} catch (const std::exception& e) {
+		SPDLOG_WARN("SamMultiplexer: writer stopped: {}", e.what());
+	}
+	close();
+}
+
+net::awaitable<void> SamMultiplexer::readerLoop() {
+	auto self = shared_from_this();
+	std::string pending;
+	std::array<char, 64 * 1024> chunk;
+	try {
+		while (running_) {
+			std::size_t n = co_await connection_->streamRead(net::buffer(chunk), SteadyClock::duration::max());
+			if (n == 0) break;
+			pending.append(chunk.data(), n);
+
+			std::size_t offset = 0;
+			while (pending.size() - offset >= kHeaderSize) {
+				const char* header = pending.data() + offset;
+				auto type = static_cast<FrameType>(header[0]);
+				auto priority = static_cast<uint8_t>(header[2]);
+				uint32_t stream_id = getU32(header + 4);
+				uint32_t length = getU32(header + 8);
+				std::size_t payload_len = (type == FrameType::DATA) ? length : 0;
+				if (payload_len > kMaxFramePayload)
+					throw std::runtime_error("SamMultiplexer: oversized frame");
+				if (pending.size() - offset < kHeaderSize + payload_len) break;
+				dispatchFrame(type, priority, stream_id, header + kHeaderSize, length);
+				offset += kHeaderSize + payload_len;
+			}
+			pending.erase(0, offset);
+		}
+	} catch (const std::exception& e) {
+		SPDLOG_INFO("SamMultiplexer: reader stopped: {}", e.what());
+	}
+	close();
+}
+
+void SamMultiplexer::dispatchFrame(FrameType type, uint8_t priority, uint32_t stream_id, const char* payload, uint32_t length) {
+	std::shared_ptr<SamSubstream> substream;
+	auto it = substreams_.find(stream_id);
+	if (it != substreams_.end()) {
+		substream = it->second;
+	} else {
+		// A frame for an unknown id the peer is allowed to open opens it (zero round-trips). The peer
+		// sends opens in id order ahead of everything else, so lower unknown ids are already closed.
+		bool peer_parity = (role_ == Role::INITIATOR) ? (stream_id % 2 == 0) : (stream_id % 2 == 1);
+		if (!peer_parity || stream_id <= last_remote_id_ || type == FrameType::RST || type == FrameType::WINDOW_UPDATE)
+			return; // Stale frame for a substream that is already gone
+		last_remote_id_ = stream_id;
+		substream = std::make_shared<SamSubstream>(shared_from_this(), stream_id, priority, initial_window_);
+		substreams_[stream_id] = substream;
+		pending_accepts_.push_back(substream);
+		accept_ready_.notifyAll();
+	}
+
+	switch (type) {
+	case FrameType::DATA: substream->onData(payload, length); break;
+	case FrameType::WINDOW_UPDATE: substream->onWindowUpdate(length); break;
+	case FrameType::FIN: substream->onFin(); break;
+	case FrameType::RST: substream->onReset(); break;
+	default:
+		SPDLOG_WARN("SamMultiplexer: unknown frame type {}", static_cast<int>(type));
+		return;
+	}
+	releaseIfDone(substream);
+}
+
+void SamMultiplexer::releaseIfDone(const std::shared_ptr<SamSubstream>& substream) {
+	// The application keeps its own reference; the multiplexer only forgets ids that can see no more frames.
+	if (substream->reset_ || (substream->local_fin_ && substream->remote_fin_))
+		substreams_.erase(substream->id_);
+}
+
+void SamMultiplexer::failAll() {
+	for (auto& entry : substreams_) entry.second->onReset();
+	substreams_.clear();
+	open_queue_.clear();
+	send_queues_.clear();
+	send_ready_.notifyAll();
+	accept_ready_.notifyAll();
+}
+
+} // namespace SAM
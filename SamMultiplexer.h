@@ -0,0 +1,121 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <map>
+#include <deque>
+#include <array>
+#include <boost/asio.hpp>
+#include "SamConnection.h"
+#include "SamAsyncUtils.h"
+
+namespace net = boost::asio;
+
+namespace SAM {
+
+class SamMultiplexer;
+
+// Logical stream carried inside one I2P stream. Mirrors SamConnection's data-mode API:
+// streamRead throws net::error::eof once the peer finished sending and the buffer is drained.
+class SamSubstream : public std::enable_shared_from_this<SamSubstream> {
+public:
+	SamSubstream(std::shared_ptr<SamMultiplexer> mux, uint32_t id, uint8_t priority, uint32_t initial_window);
+
+	net::awaitable<std::size_t> streamRead(net::mutable_buffer buffer, 
+		SteadyClock::duration timeout = std::chrono::minutes(5));
+	net::awaitable<void> streamWrite(net::const_buffer buffer, 
+		SteadyClock::duration timeout = std::chrono::seconds(30));
+	void shutdownWrite(); // Sends FIN; the peer reads EOF after the queued data
+	void reset();         // Aborts both directions (RST)
+
+	uint32_t id() const { return id_; }
+	uint8_t priority() const { return priority_; }
+	bool isOpen() const { return !reset_ && !(local_fin_ && remote_fin_ && recv_buffer_.empty()); }
+
+private:
+	friend class SamMultiplexer;
+	void onData(const char* data, std::size_t len);
+	void onWindowUpdate(uint32_t increment);
+	void onFin();
+	void onReset();
+
+	std::weak_ptr<SamMultiplexer> mux_;
+	uint32_t id_;
+	uint8_t priority_; // 0 = most urgent
+	uint32_t initial_window_;
+
+	std::deque<char> recv_buffer_;
+	uint32_t send_window_;         // Bytes we may still send before the peer grants more
+	uint32_t recv_window_;         // Bytes the peer may still send before we grant more
+	uint32_t consumed_since_update_ = 0;
+	bool local_fin_ = false;
+	bool remote_fin_ = false;
+	bool reset_ = false;
+	AsyncCondition readable_;
+	AsyncCondition writable_;
+};
+
+// Framed substreams over a single SetupStreamResult::data_connection. Both sides wrap their end of the
+// I2P stream in a multiplexer (INITIATOR on the connecting side, ACCEPTOR on the accepting side).
+// Opening a substream costs no round-trip: it sends an empty DATA frame that opens it on the peer.
+// Open frames go out in id order ahead of all other frames, so the peer sees ids in increasing order
+// and can tell a stale frame (id at or below the highest it has seen) from a new substream. Each
+// substream has a credit window (WINDOW_UPDATE frames) so a slow reader only stalls its own substream;
+// a peer sending past its window gets the substream reset. Other outbound frames are sent strictly by
+// substream priority, FIFO within a priority.
+// Everything runs on the connection's executor; use from a single-threaded io_context.
+//
+// Frame: type(1) flags(1) priority(1) reserved(1) stream_id(4, BE) length(4, BE) payload(length)
+// For WINDOW_UPDATE, length carries the credit increment and there is no payload.
+class SamMultiplexer : public std::enable_shared_from_this<SamMultiplexer> {
+public:
+	enum class Role { INITIATOR, ACCEPTOR }; // Initiator opens odd ids, acceptor even ids
+	enum class FrameType : uint8_t { DATA = 0, WINDOW_UPDATE = 1, FIN = 2, RST = 3 };
+	static constexpr std::size_t kHeaderSize = 12;
+	static constexpr std::size_t kMaxFramePayload = 16 * 1024;
+
+	SamMultiplexer(std::shared_ptr<SamConnection> connection, Role role,
+		uint32_t initial_window = 256 * 1024);
+	~SamMultiplexer();
+
+	void start(); // Spawns the reader and writer loops
+	void close();
+	bool isOpen() const { return running_ && connection_ && connection_->isOpen(); }
+
+	std::shared_ptr<SamSubstream> openSubstream(uint8_t priority = 0);
+	// Waits for the next substream opened by the peer; returns nullptr once the multiplexer closed.
+	net::awaitable<std::shared_ptr<SamSubstream>> acceptSubstream();
+
+	std::shared_ptr<SamConnection> connection() const { return connection_; }
+
+private:
+	friend class SamSubstream;
+	struct OutFrame {
+		std::array<char, kHeaderSize> header;
+		std::string payload;
+	};
+
+	static OutFrame makeFrame(FrameType type, uint32_t stream_id, uint8_t priority, uint32_t length_field, std::string payload);
+	void enqueueFrame(FrameType type, uint32_t stream_id, uint8_t priority, uint32_t length_field, std::string payload = {});
+	net::awaitable<void> readerLoop();
+	net::awaitable<void> writerLoop();
+	void dispatchFrame(FrameType type, uint8_t priority, uint32_t stream_id, const char* payload, uint32_t length);
+	void failAll();
+	void releaseIfDone(const std::shared_ptr<SamSubstream>& substream);
+
+	std::shared_ptr<SamConnection> connection_;
+	Role role_;
+	uint32_t initial_window_;
+	uint32_t next_stream_id_;
+	uint32_t last_remote_id_ = 0; // Highest id opened by the peer; lower unknown ids are stale frames
+	bool running_ = false;
+
+	std::map<uint32_t, std::shared_ptr<SamSubstream>> substreams_;
+	std::deque<std::shared_ptr<SamSubstream>> pending_accepts_;
+	std::deque<OutFrame> open_queue_; // Open frames, in id order; sent before every priority queue
+	std::map<uint8_t, std::deque<OutFrame>> send_queues_; // Keyed by priority, lowest value first
+	AsyncCondition send_ready_;
+	AsyncCondition accept_ready_;
+};
+
+} // namespace SAM
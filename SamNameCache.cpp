@@ -0,0 +1,176 @@
+#include "SamNameCache.h"
+#include <spdlog/spdlog.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#include <fstream>
+
+namespace SAM {
+
+namespace {
+
+bool isNegativeAnswer(SAM::ResultCode result) {
+	return result == SAM::ResultCode::KEY_NOT_FOUND || result == SAM::ResultCode::INVALID_KEY;
+}
+
+} // namespace
+
+SamNameCache::SamNameCache(const net::any_io_executor& ex,
+	SteadyClock::duration positive_ttl, SteadyClock::duration negative_ttl)
+	: executor_(ex), positive_ttl_(positive_ttl), negative_ttl_(negative_ttl) {
+}
+
+net::awaitable<NamingLookupResult> SamNameCache::resolve(const std::string& name, const Fetcher& fetcher) {
+	auto it = entries_.find(name);
+	if (it != entries_.end()) {
+		if (it->second.expires > SteadyClock::now()) {
+			NamingLookupResult cached;
+			cached.name = name;
+			cached.from_cache = true;
+			cached.result = it->second.result;
+			cached.success = it->second.result == SAM::ResultCode::OK;
+			cached.destination = it->second.destination;
+			if (!cached.success) {
+				cached.error_message = "NAMING LOOKUP " + name + " failed (cached)";
+				stats_.negative_hits++;
+			} else {
+				stats_.hits++;
+			}
+			co_return cached;
+		}
+		entries_.erase(it);
+	}
+
+	if (auto pending = pending_.find(name); pending != pending_.end()) {
+		auto lookup = pending->second; // Keep alive: the owner erases it from pending_ when done
+		stats_.coalesced++;
+		while (!lookup->finished) co_await lookup->done.wait();
+		NamingLookupResult shared = lookup->result;
+		shared.from_cache = true;
+		co_return shared;
+	}
+
+	auto lookup = std::make_shared<PendingLookup>(executor_);
+	pending_.emplace(name, lookup);
+	stats_.misses++;
+	try {
+		lookup->result = co_await fetcher(name);
+	} catch (const std::exception& e) {
+		lookup->result = NamingLookupResult{};
+		lookup->result.name = name;
+		lookup->result.error_message = std::string("NAMING LOOKUP exception: ") + e.what();
+	}
+	lookup->result.name = name;
+	store(lookup->result);
+	lookup->finished = true;
+	pending_.erase(name);
+	lookup->done.notifyAll();
+	co_return lookup->result;
+}
+
+void SamNameCache::store(const NamingLookupResult& result) {
+	if (result.success && !result.destination.empty()) {
+		entries_[result.name] = Entry{result.destination, SAM::ResultCode::OK, SteadyClock::now() + positive_ttl_};
+	} else if (isNegativeAnswer(result.result)) {
+		entries_[result.name] = Entry{{}, result.result, SteadyClock::now() + negative_ttl_};
+	}
+}
+
+std::string SamNameCache::peek(const std::string& name) const {
+	auto it = entries_.find(name);
+	if (it == entries_.end() || it->second.destination.empty() || it->second.expires <= SteadyClock::now()) {
+		return {};
+	}
+	return it->second.destination;
+}
+
+void SamNameCache::insert(const std::string& name, const std::string& destination) {
+	entries_[name] = Entry{destination, SAM::ResultCode::OK, SteadyClock::now() + positive_ttl_};
+}
+
+void SamNameCache::erase(const std::string& name) {
+	entries_.erase(name);
+}
+
+void SamNameCache::clear() {
+	entries_.clear();
+}
+
+std::size_t SamNameCache::loadSnapshot(const std::string& path) {
+	int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		SPDLOG_DEBUG("No name cache snapshot at {}", path);
+		return 0;
+	}
+	struct stat st{};
+	if (::fstat(fd, &st) != 0 || st.st_size == 0) {
+		::close(fd);
+		return 0;
+	}
+	void* mapped = ::mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (mapped == MAP_FAILED) {
+		SPDLOG_WARN("Failed to map name cache snapshot {}", path);
+		return 0;
+	}
+
+	// Parsed in place; only the strings that end up in the cache are copied.
+	std::string_view data(static_cast<const char*>(mapped), static_cast<std::size_t>(st.st_size));
+	const auto wall_now = std::chrono::system_clock::now();
+	const auto steady_now = SteadyClock::now();
+	std::size_t loaded = 0;
+	while (!data.empty()) {
+		std::size_t eol = data.find('\n');
+		std::string_view line = data.substr(0, eol);
+		data.remove_prefix(eol == std::string_view::npos ? data.size() : eol + 1);
+
+		std::size_t tab1 = line.find('\t');
+		std::size_t tab2 = tab1 == std::string_view::npos ? tab1 : line.find('\t', tab1 + 1);
+		if (tab2 == std::string_view::npos) continue;
+		std::string_view name = line.substr(0, tab1);
+		std::string_view destination = line.substr(tab1 + 1, tab2 - tab1 - 1);
+		long long expiry_seconds = 0;
+		for (char c : line.substr(tab2 + 1)) {
+			if (c < '0' || c > '9') break;
+			expiry_seconds = expiry_seconds * 10 + (c - '0');
+		}
+		auto expiry = std::chrono::system_clock::time_point(std::chrono::seconds(expiry_seconds));
+		if (name.empty() || destination.empty() || expiry <= wall_now) continue;
+
+		auto remaining = std::chrono::duration_cast<SteadyClock::duration>(expiry - wall_now);
+		entries_[std::string(name)] = Entry{std::string(destination), SAM::ResultCode::OK, steady_now + remaining};
+		loaded++;
+	}
+	::munmap(mapped, static_cast<std::size_t>(st.st_size));
+	stats_.snapshot_loaded += loaded;
+	SPDLOG_INFO("Loaded {} name cache entries from {}", loaded, path);
+	return loaded;
+}
+
+bool SamNameCache::saveSnapshot(const std::string& path) const {
+	// Written to a temporary file and renamed, so a concurrent loader never maps a partial snapshot.
+	const std::string tmp_path = path + ".tmp";
+	std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+	if (!out) {
+		SPDLOG_ERROR("Cannot write name cache snapshot {}", tmp_path);
+		return false;
+	}
+	const auto wall_now = std::chrono::system_clock::now();
+	const auto steady_now = SteadyClock::now();
+	for (const auto& [name, entry] : entries_) {
+		if (entry.destination.empty() || entry.expires <= steady_now) continue;
+		auto expiry = wall_now + std::chrono::duration_cast<std::chrono::system_clock::duration>(entry.expires - steady_now);
+		out << name << '\t' << entry.destination << '\t'
+			<< std::chrono::duration_cast<std::chrono::seconds>(expiry.time_since_epoch()).count() << '\n';
+	}
+	out.close();
+	if (!out || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+		SPDLOG_ERROR("Failed to save name cache snapshot {}", path);
+		return false;
+	}
+	return true;
+}
+
+} // namespace SAM
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <memory>
+#include <unordered_map>
+#include <functional>
+#include <boost/asio.hpp>
+#include "SamAsyncUtils.h"
+#include "SamMessageParser.h"
+
+namespace net = boost::asio;
+
+namespace SAM {
+
+// Result of resolving a name (hostname.i2p, b32 address or "ME") through NAMING LOOKUP.
+struct NamingLookupResult {
+	bool success = false;
+	std::string name;
+	std::string destination;        // Full base64 destination (VALUE= of NAMING REPLY)
+	SAM::ResultCode result = SAM::ResultCode::UNKNOWN; // KEY_NOT_FOUND / INVALID_KEY on negative answers
+	std::string error_message;
+	bool from_cache = false;
+};
+
+struct NameCacheStats {
+	std::size_t hits = 0;
+	std::size_t negative_hits = 0;
+	std::size_t misses = 0;          // Lookups that went to the bridge
+	std::size_t coalesced = 0;       // Callers that joined a lookup already in flight
+	std::size_t snapshot_loaded = 0; // Entries taken from the on-disk snapshot
+};
+
+// In-memory NAMING LOOKUP cache with per-entry TTL, negative caching (KEY_NOT_FOUND / INVALID_KEY are
+// remembered for a shorter time) and request coalescing: concurrent resolves of the same name share one
+// bridge round-trip. Positive entries can be persisted to a snapshot file that is memory-mapped and
+// loaded at startup, so the first connects after a restart skip the lookup.
+// Not thread-safe: use from a single-threaded io_context (as the examples do) or from one strand.
+class SamNameCache {
+public:
+	using Fetcher = std::function<net::awaitable<NamingLookupResult>(const std::string& name)>;
+
+	explicit SamNameCache(const net::any_io_executor& ex,
+		SteadyClock::duration positive_ttl = std::chrono::hours(6),
+		SteadyClock::duration negative_ttl = std::chrono::minutes(2));
+
+	// Returns a fresh cached answer or runs fetcher (at most once per name at a time).
+	// Transport errors (no NAMING REPLY at all) are returned but not cached.
+	net::awaitable<NamingLookupResult> resolve(const std::string& name, const Fetcher& fetcher);
+
+	// Cached positive answer without a lookup; empty if unknown or expired.
+	std::string peek(const std::string& name) const;
+	void insert(const std::string& name, const std::string& destination);
+	void erase(const std::string& name);
+	void clear();
+
+	// Snapshot format: one "name<TAB>destination<TAB>expiry_unix_seconds" line per positive entry.
+	// load returns the number of unexpired entries taken over; a missing file is not an error.
+	std::size_t loadSnapshot(const std::string& path);
+	bool saveSnapshot(const std::string& path) const;
+
+	const NameCacheStats& stats() const { return stats_; }
+	std::size_t size() const { return entries_.size(); }
+
+private:
+	struct Entry {
+		std::string destination; // Empty for negative entries
+		SAM::ResultCode result = SAM::ResultCode::OK;
+		SteadyClock::time_point expires;
+	};
+	struct PendingLookup {
+		explicit PendingLookup(const net::any_io_executor& ex) : done(ex) {}
+		AsyncCondition done;
+		bool finished = false;
+		NamingLookupResult result;
+	};
+
+	void store(const NamingLookupResult& result);
+
+	net::any_io_executor executor_;
+	SteadyClock::duration positive_ttl_;
+	SteadyClock::duration negative_ttl_;
+	std::unordered_map<std::string, Entry> entries_;
+	std::unordered_map<std::string, std::shared_ptr<PendingLookup>> pending_;
+	NameCacheStats stats_;
+};
+
+} // namespace SAM
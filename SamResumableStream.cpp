@@ -0,0 +1,473 @@
+#include "SamResumableStream.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <random>
+#include <openssl/rand.h>
+#include <spdlog/spdlog.h>
+
+namespace SAM {
+
+namespace {
+
+constexpr char kMagic[4] = {'S', 'R', 'S', '1'};
+constexpr std::size_t kTokenSize = 16;
+constexpr std::size_t kHelloSize = 4 + 1 + kTokenSize + 8;
+constexpr std::size_t kFrameHeaderSize = 5;
+constexpr std::size_t kMaxFramePayload = 16 * 1024;
+constexpr std::size_t kMaxBatch = 4 * kMaxFramePayload;
+
+enum class HelloKind : uint8_t { NEW = 0, RESUME = 1 };          // Client hello
+enum class HelloStatus : uint8_t { CREATED = 0, RESUMED = 1, UNKNOWN = 2 }; // Server reply
+enum class FrameType : uint8_t { DATA = 0, ACK = 1, FIN = 2 };
+
+using HelloBytes = std::array<char, kHelloSize>;
+
+struct Hello {
+	uint8_t code = 0;
+	std::string token;
+	uint64_t received = 0;
+};
+
+void putU32(char* out, uint32_t v) {
+	for (int i = 3; i >= 0; --i, v >>= 8) out[i] = static_cast<char>(v & 0xff);
+}
+
+void putU64(char* out, uint64_t v) {
+	for (int i = 7; i >= 0; --i, v >>= 8) out[i] = static_cast<char>(v & 0xff);
+}
+
+uint32_t getU32(const char* in) {
+	uint32_t v = 0;
+	for (int i = 0; i < 4; ++i) v = (v << 8) | static_cast<uint8_t>(in[i]);
+	return v;
+}
+
+uint64_t getU64(const char* in) {
+	uint64_t v = 0;
+	for (int i = 0; i < 8; ++i) v = (v << 8) | static_cast<uint8_t>(in[i]);
+	return v;
+}
+
+HelloBytes encodeHello(uint8_t code, const std::string& token, uint64_t received) {
+	HelloBytes out{};
+	std::memcpy(out.data(), kMagic, 4);
+	out[4] = static_cast<char>(code);
+	std::memcpy(out.data() + 5, token.data(), std::min(token.size(), kTokenSize));
+	putU64(out.data() + 5 + kTokenSize, received);
+	return out;
+}
+
+net::awaitable<Hello> readHello(SamConnection& connection, SteadyClock::duration timeout) {
+	HelloBytes raw;
+	std::size_t have = 0;
+	while (have < raw.size()) { // Exactly the hello: frames may follow right behind it
+		std::size_t n = co_await connection.streamRead(net::buffer(raw.data() + have, raw.size() - have), timeout);
+		if (n == 0) throw boost::system::system_error(net::error::eof);
+		have += n;
+	}
+	if (std::memcmp(raw.data(), kMagic, 4) != 0) throw std::runtime_error("peer does not speak the resumable stream protocol");
+	Hello hello;
+	hello.code = static_cast<uint8_t>(raw[4]);
+	hello.token.assign(raw.data() + 5, kTokenSize);
+	hello.received = getU64(raw.data() + 5 + kTokenSize);
+	co_return hello;
+}
+
+std::string randomToken() {
+	std::string token(kTokenSize, '\0');
+	if (RAND_bytes(reinterpret_cast<unsigned char*>(token.data()), static_cast<int>(token.size())) != 1) {
+		std::random_device rd;
+		for (char& c : token) c = static_cast<char>(rd());
+	}
+	return token;
+}
+
+void appendFrame(std::string& batch, FrameType type, const char* payload, std::size_t length) {
+	char header[kFrameHeaderSize];
+	header[0] = static_cast<char>(type);
+	putU32(header + 1, static_cast<uint32_t>(length));
+	batch.append(header, sizeof(header));
+	if (length > 0) batch.append(payload, length);
+}
+
+} // namespace
+
+SamResumableStream::SamResumableStream(net::any_io_executor executor, Role role, std::string peer,
+	std::string token, ResumableConfig config)
+	: executor_(executor), role_(role), peer_(std::move(peer)), token_(std::move(token)),
+	  config_(config), changed_(executor) {
+	config_.max_unacked_bytes = std::max<std::size_t>(config_.max_unacked_bytes, kMaxFramePayload);
+	config_.ack_interval = std::clamp<std::size_t>(config_.ack_interval, 1, config_.max_unacked_bytes / 2);
+}
+
+SamResumableStream::~SamResumableStream() {
+	if (connection_ && connection_->isOpen()) connection_->closeSocket();
+}
+
+std::string SamResumableStream::tokenHex() const {
+	static const char* hex = "0123456789abcdef";
+	std::string out;
+	for (unsigned char c : token_) {
+		out += hex[c >> 4];
+		out += hex[c & 0x0f];
+	}
+	return out;
+}
+
+net::awaitable<ResumableConnectResult> SamResumableStream::connect(
+	std::shared_ptr<SamService> service,
+	const std::string& control_session_id,
+	const std::string& peer_b32,
+	ResumableConfig config) {
+
+	ResumableConnectResult result;
+	// The hello rides behind STREAM CONNECT as early data.
+	const HelloBytes hello = encodeHello(static_cast<uint8_t>(HelloKind::NEW), std::string(kTokenSize, '\0'), 0);
+	SetupStreamResult stream = co_await service->connectToPeerViaNewConnection(control_session_id, peer_b32, net::buffer(hello));
+	if (!stream.success || !stream.data_connection) {
+		result.error_message = stream.error_message;
+		co_return result;
+	}
+	try {
+		Hello reply = co_await readHello(*stream.data_connection, std::chrono::seconds(90));
+		if (reply.code != static_cast<uint8_t>(HelloStatus::CREATED)) throw std::runtime_error("peer refused the stream");
+		std::shared_ptr<SamResumableStream> resumable(new SamResumableStream(
+			stream.data_connection->get_executor(), Role::CLIENT, peer_b32, reply.token, config));
+		resumable->service_ = std::move(service);
+		resumable->control_session_id_ = control_session_id;
+		resumable->attach(stream.data_connection, 0);
+		result.stream = std::move(resumable);
+		result.success = true;
+	} catch (const std::exception& e) {
+		result.error_message = "Resumable stream handshake with " + peer_b32 + " failed: " + e.what();
+		SPDLOG_ERROR("{}", result.error_message);
+		if (stream.data_connection->isOpen()) stream.data_connection->closeSocket();
+	}
+	co_return result;
+}
+
+net::awaitable<std::size_t> SamResumableStream::read(net::mutable_buffer buffer, SteadyClock::duration timeout) {
+	auto self = shared_from_this();
+	const auto deadline = timeout == SteadyClock::duration::max() ? SteadyClock::time_point::max() : SteadyClock::now() + timeout;
+	while (recv_buffer_.empty()) {
+		if (peer_fin_) throw boost::system::system_error(net::error::eof);
+		if (failed_) throw boost::system::system_error(net::error::connection_aborted, failure_reason_);
+		if (closed_) throw boost::system::system_error(net::error::operation_aborted);
+		if (!co_await changed_.waitUntil(deadline)) throw boost::system::system_error(net::error::timed_out);
+	}
+	const std::size_t n = std::min(buffer.size(), recv_buffer_.size());
+	std::copy_n(recv_buffer_.begin(), n, static_cast<char*>(buffer.data()));
+	recv_buffer_.erase(recv_buffer_.begin(), recv_buffer_.begin() + n);
+	changed_.notifyAll(); // The reader loop may be waiting for room
+	co_return n;
+}
+
+net::awaitable<void> SamResumableStream::write(net::const_buffer buffer, SteadyClock::duration timeout) {
+	auto self = shared_from_this();
+	if (fin_pending_ || closed_) throw boost::system::system_error(net::error::broken_pipe);
+	const auto deadline = timeout == SteadyClock::duration::max() ? SteadyClock::time_point::max() : SteadyClock::now() + timeout;
+	const char* data = static_cast<const char*>(buffer.data());
+	std::size_t remaining = buffer.size();
+	while (remaining > 0) {
+		while (!failed_ && sent_ - acked_ >= config_.max_unacked_bytes) {
+			if (!co_await changed_.waitUntil(deadline)) throw boost::system::system_error(net::error::timed_out);
+		}
+		if (failed_) throw boost::system::system_error(net::error::connection_aborted, failure_reason_);
+		const std::size_t n = std::min<std::size_t>(remaining, config_.max_unacked_bytes - (sent_ - acked_));
+		replay_.append(data, n);
+		sent_ += n;
+		data += n;
+		remaining -= n;
+		changed_.notifyAll(); // Wakes the writer loop
+	}
+}
+
+net::awaitable<void> SamResumableStream::close(SteadyClock::duration timeout) {
+	auto self = shared_from_this();
+	if (closed_) co_return;
+	fin_pending_ = true;
+	changed_.notifyAll();
+	const auto deadline = SteadyClock::now() + timeout;
+	while (!failed_ && !(fin_sent_ && acked_ == sent_)) {
+		if (!co_await changed_.waitUntil(deadline)) break;
+	}
+	closed_ = true;
+	dropConnection();
+	changed_.notifyAll();
+}
+
+void SamResumableStream::attach(std::shared_ptr<SamConnection> connection, uint64_t peer_received) {
+	if (peer_received < replay_start_ || peer_received > sent_) {
+		connection->closeSocket();
+		fail("peer resumed at an offset outside the replay buffer");
+		return;
+	}
+	dropConnection();
+	connection_ = std::move(connection);
+	const uint64_t generation = generation_;
+	if (resumes_ > 0) resent_ += sent_ - peer_received;
+	onAcknowledged(peer_received);
+	transmitted_ = peer_received;
+	fin_sent_ = false;
+	ack_pending_ = true; // Tell the peer where we are right away
+	auto self = shared_from_this();
+	auto connection_ref = connection_;
+	net::co_spawn(executor_, [self, connection_ref, generation]() { return self->readerLoop(connection_ref, generation); }, net::detached);
+	net::co_spawn(executor_, [self, connection_ref, generation]() { return self->writerLoop(connection_ref, generation); }, net::detached);
+	changed_.notifyAll();
+}
+
+void SamResumableStream::dropConnection() {
+	++generation_;
+	if (connection_ && connection_->isOpen()) connection_->closeSocket();
+	connection_ = nullptr;
+}
+
+void SamResumableStream::detach(uint64_t generation, const std::string& reason) {
+	if (generation != generation_ || !connection_) return; // Already replaced or dropped
+	dropConnection();
+	changed_.notifyAll();
+	if (closed_ || failed_) return;
+	if (peer_fin_ && fin_sent_ && acked_ == sent_) return; // Both directions finished
+	SPDLOG_INFO("Resumable stream {} with {} dropped ({}); {}.", tokenHex(), peer_, reason,
+		role_ == Role::CLIENT ? "reconnecting" : "waiting for the peer to resume");
+	auto self = shared_from_this();
+	if (role_ == Role::CLIENT) {
+		net::co_spawn(executor_, [self]() { return self->reconnectLoop(); }, net::detached);
+	} else {
+		const uint64_t detached_generation = generation_;
+		net::co_spawn(executor_, [self, detached_generation]() { return self->expireUnlessResumed(detached_generation); }, net::detached);
+	}
+}
+
+void SamResumableStream::fail(const std::string& reason) {
+	if (failed_) return;
+	failed_ = true;
+	failure_reason_ = reason;
+	SPDLOG_WARN("Resumable stream {} with {} failed: {}", tokenHex(), peer_, reason);
+	dropConnection();
+	changed_.notifyAll();
+}
+
+void SamResumableStream::onAcknowledged(uint64_t peer_received) {
+	if (peer_received <= acked_ || peer_received > sent_) return;
+	acked_ = peer_received;
+	// Trimming only once half the buffer is acknowledged keeps the erase cost amortised O(1) per byte.
+	const uint64_t droppable = acked_ - replay_start_;
+	if (droppable * 2 >= replay_.size()) {
+		replay_.erase(0, static_cast<std::size_t>(droppable));
+		replay_start_ = acked_;
+	}
+	changed_.notifyAll();
+}
+
+net::awaitable<void> SamResumableStream::readerLoop(std::shared_ptr<SamConnection> connection, uint64_t generation) {
+	auto self = shared_from_this();
+	std::string pending;
+	std::array<char, 64 * 1024> chunk;
+	std::string reason = "closed";
+	try {
+		while (generation == generation_) {
+			if (recv_buffer_.size() >= config_.max_unacked_bytes) { // Application is behind; stop acknowledging
+				co_await changed_.wait();
+				continue;
+			}
+			std::size_t n = co_await connection->streamRead(net::buffer(chunk), config_.idle_timeout);
+			if (generation != generation_) co_return; // Replaced meanwhile; the peer resends from our count
+			if (n == 0) throw boost::system::system_error(net::error::eof);
+			pending.append(chunk.data(), n);
+
+			std::size_t offset = 0;
+			while (pending.size() - offset >= kFrameHeaderSize) {
+				const char* header = pending.data() + offset;
+				const auto type = static_cast<FrameType>(header[0]);
+				const uint32_t length = getU32(header + 1);
+				if (length > kMaxFramePayload) throw std::runtime_error("oversized frame");
+				if (pending.size() - offset < kFrameHeaderSize + length) break;
+				const char* payload = header + kFrameHeaderSize;
+				switch (type) {
+				case FrameType::DATA:
+					recv_buffer_.insert(recv_buffer_.end(), payload, payload + length);
+					received_ += length;
+					if (received_ - ack_sent_ >= config_.ack_interval) ack_pending_ = true;
+					break;
+				case FrameType::ACK:
+					if (length != 8) throw std::runtime_error("malformed ACK");
+					onAcknowledged(getU64(payload));
+					break;
+				case FrameType::FIN:
+					peer_fin_ = true;
+					ack_pending_ = true;
+					break;
+				default:
+					throw std::runtime_error("unknown frame type " + std::to_string(static_cast<int>(type)));
+				}
+				offset += kFrameHeaderSize + length;
+			}
+			pending.erase(0, offset);
+			changed_.notifyAll();
+		}
+	} catch (const boost::system::system_error& e) {
+		reason = e.code().message();
+	} catch (const std::exception& e) {
+		reason = e.what();
+	}
+	detach(generation, reason);
+}
+
+net::awaitable<void> SamResumableStream::writerLoop(std::shared_ptr<SamConnection> connection, uint64_t generation) {
+	auto self = shared_from_this();
+	const auto keepalive = std::max<SteadyClock::duration>(config_.idle_timeout / 3, std::chrono::seconds(1));
+	std::string batch;
+	std::string reason = "closed";
+	try {
+		while (generation == generation_) {
+			batch.clear();
+			if (ack_pending_) {
+				char count[8];
+				putU64(count, received_);
+				appendFrame(batch, FrameType::ACK, count, sizeof(count));
+				ack_sent_ = received_;
+				ack_pending_ = false;
+			}
+			transmitted_ = std::max(transmitted_, acked_);
+			while (transmitted_ < sent_ && batch.size() < kMaxBatch) {
+				const std::size_t length = static_cast<std::size_t>(std::min<uint64_t>(sent_ - transmitted_, kMaxFramePayload));
+				appendFrame(batch, FrameType::DATA, replay_.data() + (transmitted_ - replay_start_), length);
+				transmitted_ += length;
+			}
+			if (fin_pending_ && !fin_sent_ && transmitted_ == sent_) {
+				appendFrame(batch, FrameType::FIN, nullptr, 0);
+				fin_sent_ = true;
+			}
+			if (batch.empty()) {
+				if (!co_await changed_.waitUntil(SteadyClock::now() + keepalive)) ack_pending_ = true; // Keep-alive
+				continue;
+			}
+			co_await connection->streamWrite(net::buffer(batch), config_.idle_timeout);
+		}
+	} catch (const boost::system::system_error& e) {
+		reason = e.code().message();
+	} catch (const std::exception& e) {
+		reason = e.what();
+	}
+	detach(generation, reason);
+}
+
+net::awaitable<void> SamResumableStream::reconnectLoop() {
+	auto self = shared_from_this();
+	if (reconnecting_) co_return;
+	reconnecting_ = true;
+	const auto deadline = SteadyClock::now() + config_.resume_timeout;
+	auto backoff = std::chrono::seconds(1);
+	std::string last_error;
+	while (!closed_ && !failed_ && SteadyClock::now() < deadline) {
+		// received_ cannot change while detached, so the count in the hello stays exact.
+		const HelloBytes hello = encodeHello(static_cast<uint8_t>(HelloKind::RESUME), token_, received_);
+		SetupStreamResult stream = co_await service_->connectToPeerViaNewConnection(control_session_id_, peer_, net::buffer(hello));
+		if (stream.success && stream.data_connection) {
+			try {
+				Hello reply = co_await readHello(*stream.data_connection, std::chrono::seconds(90));
+				if (closed_ || failed_) {
+					stream.data_connection->closeSocket();
+					break;
+				}
+				if (reply.code == static_cast<uint8_t>(HelloStatus::RESUMED)) {
+					++resumes_;
+					reconnecting_ = false;
+					SPDLOG_INFO("Resumable stream {} resumed with {}: resending {} bytes, skipping {} already delivered.",
+						tokenHex(), peer_, sent_ - std::min(sent_, reply.received), std::min(sent_, reply.received));
+					attach(stream.data_connection, reply.received);
+					co_return;
+				}
+				stream.data_connection->closeSocket();
+				reconnecting_ = false;
+				fail("peer no longer has the stream");
+				co_return;
+			} catch (const std::exception& e) {
+				last_error = e.what();
+				if (stream.data_connection->isOpen()) stream.data_connection->closeSocket();
+			}
+		} else {
+			last_error = stream.error_message;
+		}
+		net::steady_timer wait_timer(executor_, std::min<SteadyClock::duration>(backoff, deadline - SteadyClock::now()));
+		boost::system::error_code ec;
+		co_await wait_timer.async_wait(net::redirect_error(net::use_awaitable, ec));
+		backoff = std::min(backoff * 2, std::chrono::seconds(16));
+	}
+	reconnecting_ = false;
+	if (!closed_ && !failed_) fail("could not resume: " + last_error);
+}
+
+net::awaitable<void> SamResumableStream::expireUnlessResumed(uint64_t generation) {
+	auto self = shared_from_this();
+	net::steady_timer timer(executor_, config_.resume_timeout);
+	boost::system::error_code ec;
+	co_await timer.async_wait(net::redirect_error(net::use_awaitable, ec));
+	if (generation == generation_ && !connection_ && !closed_) fail("not resumed in time");
+}
+
+// --- SamResumableListener ---
+
+net::awaitable<std::shared_ptr<SamResumableStream>> SamResumableListener::accept(
+	SetupStreamResult accepted, SteadyClock::duration timeout) {
+
+	std::shared_ptr<SamConnection> connection = accepted.data_connection;
+	if (!accepted.success || !connection) co_return nullptr;
+	const std::string& peer = accepted.remote_peer_b32_address;
+	try {
+		Hello hello = co_await readHello(*connection, timeout);
+		purge();
+		if (hello.code == static_cast<uint8_t>(HelloKind::NEW)) {
+			std::string token = randomToken();
+			std::shared_ptr<SamResumableStream> stream(new SamResumableStream(
+				connection->get_executor(), SamResumableStream::Role::SERVER, peer, token, config_));
+			streams_[token] = Entry{stream, peer};
+			const HelloBytes reply = encodeHello(static_cast<uint8_t>(HelloStatus::CREATED), token, 0);
+			co_await connection->streamWrite(net::buffer(reply), timeout);
+			stream->attach(connection, 0);
+			co_return stream;
+		}
+		if (hello.code == static_cast<uint8_t>(HelloKind::RESUME)) {
+			auto it = streams_.find(hello.token);
+			std::shared_ptr<SamResumableStream> stream = it != streams_.end() ? it->second.stream.lock() : nullptr;
+			// Only the destination that opened the stream may resume it.
+			if (stream && stream->isOpen() && it->second.peer == peer) {
+				// We may not have noticed the drop yet: stop the old connection first so the count we
+				// report cannot grow afterwards. Going through detach() arms the resume expiry, so the
+				// stream still fails in time if this reply cannot be written.
+				stream->detach(stream->generation_, "peer resumed on a new connection");
+				const HelloBytes reply = encodeHello(static_cast<uint8_t>(HelloStatus::RESUMED), hello.token, stream->received_);
+				co_await connection->streamWrite(net::buffer(reply), timeout);
+				++stream->resumes_;
+				SPDLOG_INFO("Resumable stream {} resumed by {}: resending {} bytes.", stream->tokenHex(), peer,
+					stream->sent_ - std::min(stream->sent_, hello.received));
+				stream->attach(connection, hello.received);
+				co_return nullptr;
+			}
+		}
+		const HelloBytes reply = encodeHello(static_cast<uint8_t>(HelloStatus::UNKNOWN), hello.token, 0);
+		co_await connection->streamWrite(net::buffer(reply), timeout);
+	} catch (const std::exception& e) {
+		SPDLOG_WARN("Resumable stream handshake from {} failed: {}", peer, e.what());
+	}
+	if (connection->isOpen()) connection->closeSocket();
+	co_return nullptr;
+}
+
+std::size_t SamResumableListener::activeStreams() {
+	purge();
+	return streams_.size();
+}
+
+void SamResumableListener::purge() {
+	for (auto it = streams_.begin(); it != streams_.end();) {
+		auto stream = it->second.stream.lock();
+		if (!stream || !stream->isOpen()) it = streams_.erase(it);
+		else ++it;
+	}
+}
+
+} // namespace SAM
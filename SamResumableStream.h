@@ -0,0 +1,146 @@
+#pragma once
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <boost/asio.hpp>
+#include "SamService.h"
+#include "SamConnection.h"
+#include "SamAsyncUtils.h"
+
+namespace net = boost::asio;
+
+namespace SAM {
+
+struct ResumableConfig {
+	std::size_t max_unacked_bytes = 4 * 1024 * 1024; // Replay buffer; write() waits while it is full
+	std::size_t ack_interval = 64 * 1024;             // Received bytes between ACKs
+	// Silence after which the I2P stream counts as dropped; keep-alives go out at a third of it.
+	SteadyClock::duration idle_timeout = std::chrono::minutes(2);
+	// How long a dropped stream may take to resume before it fails for good.
+	SteadyClock::duration resume_timeout = std::chrono::minutes(3);
+};
+
+class SamResumableStream;
+
+struct ResumableConnectResult {
+	bool success = false;
+	std::shared_ptr<SamResumableStream> stream;
+	std::string error_message;
+};
+
+// Byte stream that outlives the I2P stream carrying it. Every byte has a sequence number (its offset
+// in the stream); written bytes stay in a bounded replay buffer until the peer acknowledges them.
+// When the I2P stream drops, the client reconnects with its resume token and both sides exchange how
+// much they have received, then resend only the unacknowledged tail. read() and write() simply wait
+// during a resume; they fail once resume_timeout passes without one.
+//
+// On each (re)connect the client sends a 29-byte hello as SAM early data and the server answers:
+// "SRS1" kind/status(1) token(16) received(8, BE). Then frames: type(1) length(4, BE) payload, where
+// DATA carries stream bytes, ACK an 8-byte received count and FIN ends the sender's direction.
+// The reader and writer loops keep the stream alive: call close() when done. Use from a
+// single-threaded io_context, like the rest of the library.
+class SamResumableStream : public std::enable_shared_from_this<SamResumableStream> {
+public:
+	static net::awaitable<ResumableConnectResult> connect(
+		std::shared_ptr<SamService> service,
+		const std::string& control_session_id,
+		const std::string& peer_b32,
+		ResumableConfig config = {});
+	~SamResumableStream();
+
+	// Throws boost::system::system_error: eof after the peer's FIN, timed_out, or connection_aborted
+	// when the stream could not be resumed.
+	net::awaitable<std::size_t> read(net::mutable_buffer buffer, SteadyClock::duration timeout = std::chrono::minutes(5));
+	// Returns once the data is in the replay buffer (it is sent, and resent after a drop, from there).
+	net::awaitable<void> write(net::const_buffer buffer, SteadyClock::duration timeout = std::chrono::seconds(30));
+	// Sends FIN after the buffered data, waits up to timeout for the peer to acknowledge it all, then
+	// releases the I2P stream for good.
+	net::awaitable<void> close(SteadyClock::duration timeout = std::chrono::seconds(30));
+
+	bool isOpen() const { return !closed_ && !failed_; }
+	bool isConnected() const { return connection_ != nullptr; } // False while a resume is pending
+	const std::string& peer() const { return peer_; }
+	std::string tokenHex() const;
+	uint64_t bytesWritten() const { return sent_; }
+	uint64_t bytesAcknowledged() const { return acked_; }
+	uint64_t bytesReceived() const { return received_; }
+	uint64_t resumes() const { return resumes_; }
+	uint64_t bytesResent() const { return resent_; } // Replayed after resumes
+
+private:
+	friend class SamResumableListener;
+	enum class Role { CLIENT, SERVER };
+
+	SamResumableStream(net::any_io_executor executor, Role role, std::string peer, std::string token, ResumableConfig config);
+
+	void attach(std::shared_ptr<SamConnection> connection, uint64_t peer_received);
+	void dropConnection(); // Closes the current I2P stream; its loops stop
+	void detach(uint64_t generation, const std::string& reason);
+	void fail(const std::string& reason);
+	void onAcknowledged(uint64_t peer_received);
+	net::awaitable<void> readerLoop(std::shared_ptr<SamConnection> connection, uint64_t generation);
+	net::awaitable<void> writerLoop(std::shared_ptr<SamConnection> connection, uint64_t generation);
+	net::awaitable<void> reconnectLoop();
+	net::awaitable<void> expireUnlessResumed(uint64_t generation);
+
+	net::any_io_executor executor_;
+	Role role_;
+	std::string peer_;
+	std::string token_; // 16 random bytes chosen by the server
+	ResumableConfig config_;
+	std::shared_ptr<SamService> service_; // Client: reconnects go through the same session
+	std::string control_session_id_;
+
+	std::shared_ptr<SamConnection> connection_;
+	uint64_t generation_ = 0; // Bumped whenever the connection is replaced or dropped
+
+	std::string replay_;       // Stream bytes [replay_start_, sent_)
+	uint64_t replay_start_ = 0;
+	uint64_t sent_ = 0;        // Bytes accepted by write()
+	uint64_t acked_ = 0;       // Bytes the peer confirmed receiving
+	uint64_t transmitted_ = 0; // Offset up to which the current connection was given data
+
+	std::deque<char> recv_buffer_;
+	uint64_t received_ = 0;
+	uint64_t ack_sent_ = 0;
+	bool ack_pending_ = false;
+
+	bool fin_pending_ = false; // close() called
+	bool fin_sent_ = false;    // On the current connection
+	bool peer_fin_ = false;
+	bool closed_ = false;
+	bool failed_ = false;
+	std::string failure_reason_;
+	bool reconnecting_ = false;
+	uint64_t resumes_ = 0;
+	uint64_t resent_ = 0;
+	AsyncCondition changed_; // Data, acks, attach/detach: waiters re-check their condition
+};
+
+// Server side: runs the hello on each accepted I2P stream. New streams are returned to the caller;
+// a resume is matched by token (and must come from the destination that opened the stream) and
+// re-attached to the SamResumableStream the application already holds.
+class SamResumableListener {
+public:
+	explicit SamResumableListener(ResumableConfig config = {}) : config_(config) {}
+
+	// Returns the new stream, or nullptr when the connection resumed an existing one or was refused.
+	net::awaitable<std::shared_ptr<SamResumableStream>> accept(
+		SetupStreamResult accepted, SteadyClock::duration timeout = std::chrono::seconds(30));
+
+	std::size_t activeStreams(); // Streams that can still be resumed
+
+private:
+	struct Entry {
+		std::weak_ptr<SamResumableStream> stream;
+		std::string peer;
+	};
+	void purge();
+
+	ResumableConfig config_;
+	std::map<std::string, Entry> streams_; // By token
+};
+
+} // namespace SAM
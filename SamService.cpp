@@ -1,12 +1,92 @@
 #include "SamService.h"
+#include "SamTrace.h"
+#include "SamCapture.h"
+#include "SamHandoff.h"
+#include "SamTransientPool.h"
+#include "SamAsyncUtils.h"
+#include <boost/asio/experimental/awaitable_operators.hpp>
 #include <iostream>
+#include <array>
+#include <algorithm>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstring>
 
 namespace SAM {
 
+namespace {
+
+// Bridges may drop connections that sit idle after HELLO; spares older than this are not trusted.
+constexpr auto kSpareMaxAge = std::chrono::seconds(60);
+// Routers keep a fetched LeaseSet until it expires, at most ten minutes after it was published.
+constexpr auto kWarmLifetime = std::chrono::minutes(8);
+constexpr std::size_t kWarmTrackedMax = 4096; // Expired entries are pruned beyond this
+constexpr std::size_t kLookupConnectionsIdleMax = 4;
+// Longest a warm-up lookup holds the control connection.
+constexpr SteadyClock::duration kWarmLookupTimeout = std::chrono::seconds(10);
+// serveHandoff sends synchronously on the io thread; a peer that stops reading costs at most this.
+constexpr auto kHandoffSendTimeout = std::chrono::seconds(5);
+
+double percentileOfSorted(const std::vector<double>& sorted, double percentile) {
+	if (sorted.empty()) return 0.0;
+	const std::size_t index = static_cast<std::size_t>(percentile / 100.0 * sorted.size());
+	return sorted[std::min(index, sorted.size() - 1)];
+}
+
+// A spare the bridge dropped while idle fails on its first write or read, well before any reply
+// timeout; a timeout means the bridge took the command and another connection would not help.
+bool isReplyTimeout(const std::exception& e) {
+	const auto* error = dynamic_cast<const boost::system::system_error*>(&e);
+	return error && error->code() == net::error::timed_out;
+}
+
+// Sorts a failed setup into SamErrorKind. Until HELLO completed, and on an I/O error before any
+// reply line, the bridge is at fault; after a reply or a reply timeout it is the command.
+SamErrorKind classifyFailure(const std::exception& e, bool hello_done, bool reply_received) {
+	if (!hello_done) return SamErrorKind::BRIDGE;
+	if (reply_received) return SamErrorKind::COMMAND;
+	if (isReplyTimeout(e)) return SamErrorKind::TIMEOUT;
+	return dynamic_cast<const boost::system::system_error*>(&e) ? SamErrorKind::BRIDGE : SamErrorKind::COMMAND;
+}
+
+// Rethrows the local failure behind an exchange that got no reply line, keeping its error code.
+[[noreturn]] void throwExchangeFailure(const ParsedMessage& reply) {
+	if (reply.error) throw boost::system::system_error(reply.error, reply.message_text);
+	throw std::runtime_error(reply.message_text);
+}
+
+} // namespace
+
+struct SamService::FanOutRound {
+	std::string control_session_id;
+	std::vector<std::string> destinations;
+	FanOutResultHandler on_result;
+	FanOutConfig config;
+	SteadyClock::time_point start;
+	SteadyClock::time_point deadline;
+	std::size_t next = 0; // Next destination to start
+	FanOutStats stats;
+	std::vector<double> completion_ms;
+};
+
+struct SamService::WarmUpRound {
+	std::string control_session_id;
+	std::vector<std::string> destinations; // Those not already warm
+	WarmUpConfig config;
+	SteadyClock::time_point start;
+	std::size_t next = 0;
+	WarmUpStats stats;
+	std::vector<double> warm_ms;
+};
+
 SamService::SamService(net::io_context& io_ctx, 
 					   const std::string& sam_host, uint16_t sam_port)
-	: io_ctx_(io_ctx), sam_host_(sam_host), sam_port_(sam_port) {
-	// std::cout << "[SamService] Created for SAM bridge at " << sam_host_ << ":" << sam_port_ << std::endl;
+	: SamService(io_ctx, SamBridgeEndpoint::tcp(sam_host, sam_port)) {
+}
+
+SamService::SamService(net::io_context& io_ctx, const SamBridgeEndpoint& bridge)
+	: io_ctx_(io_ctx), bridge_(bridge), name_cache_(std::make_shared<SamNameCache>(io_ctx.get_executor())) {
+	// std::cout << "[SamService] Created for SAM bridge at " << bridge_.toString() << std::endl;
 }
 
 SamService::~SamService() {
@@ -20,12 +100,26 @@ void SamService::shutdown() {
 		m_controlConnection->closeSocket();
 	}
 	m_controlConnection = nullptr;
+	m_spareTarget = 0;
+	for (auto& spare : m_spareConnections) {
+		if (spare.first->isOpen()) spare.first->closeSocket();
+	}
+	m_spareConnections.clear();
+	for (auto& idle : m_lookupConnections) {
+		if (idle.first->isOpen()) idle.first->closeSocket();
+	}
+	m_lookupConnections.clear();
 }
 
 bool SamService::isOpen() {
 	return m_controlConnection && m_controlConnection->isOpen();
 }
 
+net::awaitable<void> SamService::watchControlConnection() {
+	std::shared_ptr<SamConnection> control = m_controlConnection;
+	if (control) co_await control->watchUntilClosed();
+}
+
 net::any_io_executor SamService::get_executor() {
 	return io_ctx_.get_executor();
 }
@@ -45,9 +139,11 @@ net::awaitable<EstablishSessionResult> SamService::establishControlSession(
 		m_controlConnection->closeSocket();
 	}
 	m_controlConnection = std::make_shared<SamConnection>(io_ctx_);
+	bool hello_done = false;
+	bool reply_received = false;
 	
 	try {
-		bool connected = co_await m_controlConnection->connect(sam_host_, sam_port_, std::chrono::seconds(10));
+		bool connected = co_await m_controlConnection->connect(bridge_, std::chrono::seconds(10));
 		if (!connected) {
 			result.error_message = "P1: Failed to connect to SAM bridge.";
 			throw std::runtime_error(result.error_message);
@@ -59,6 +155,7 @@ net::awaitable<EstablishSessionResult> SamService::establishControlSession(
 			result.error_message = "P1: HELLO failed: " + hello_reply.original_message;
 			throw std::runtime_error(result.error_message);
 		}
+		hello_done = true;
 
 		std::string session_cmd = "SESSION CREATE STYLE=STREAM ID=" + nickname +
 								  " DESTINATION=" + private_key_b64_or_transient;
@@ -70,6 +167,8 @@ net::awaitable<EstablishSessionResult> SamService::establishControlSession(
 		//SPDLOG_INFO("Sending SESSION CREATE command, name = {}", nickname);
 		auto send_time = std::chrono::steady_clock::now();
 		SAM::ParsedMessage session_status = co_await m_controlConnection->sendCommandAndWaitReply(session_cmd, std::chrono::seconds(3*60)); // Longer timeout
+		if (session_status.error) throwExchangeFailure(session_status);
+		reply_received = true;
 		//SPDLOG_INFO("Received SESSION STATUS reply, msg = {}", session_status.original_message);
 		auto recv_time = std::chrono::steady_clock::now();
 		result.session_creation_duration = std::chrono::duration_cast<std::chrono::milliseconds>(recv_time - send_time);
@@ -108,12 +207,15 @@ net::awaitable<EstablishSessionResult> SamService::establishControlSession(
 		}
 		
 		m_establishedControlSessionId = nickname; // Store the successfully created session ID
+		m_localB32Address = result.local_b32_address;
+		m_rawDestination = result.raw_sam_destination_reply;
 		result.success = true;
 		SPDLOG_INFO("Control SAM session '{}' established. Local Address: {}", m_establishedControlSessionId, result.local_b32_address);
 		
 		// The m_controlConnection is kept alive.
 	} catch (const std::exception& e) {
 		if (result.error_message.empty()) result.error_message = "P1 Exception: " + std::string(e.what());
+		result.error_kind = classifyFailure(e, hello_done, reply_received);
 		SPDLOG_ERROR("Exception: {}", result.error_message);
 		if (m_controlConnection && m_controlConnection->isOpen()) m_controlConnection->closeSocket();
 		m_controlConnection = nullptr; 
@@ -124,26 +226,41 @@ net::awaitable<EstablishSessionResult> SamService::establishControlSession(
 
 net::awaitable<SetupStreamResult> SamService::acceptStreamViaNewConnection(
 	const std::string& control_session_id) {
+	co_return co_await acceptStream(control_session_id, true);
+}
+
+net::awaitable<SetupStreamResult> SamService::acceptStream(const std::string& control_session_id, bool use_spare) {
 	
 	SetupStreamResult result;
-	auto data_connection = std::make_shared<SamConnection>(io_ctx_);
+	std::shared_ptr<SamConnection> data_connection = use_spare ? takeSpareConnection() : nullptr;
+	const bool spare = data_connection != nullptr;
+	bool hello_done = spare;
+	bool status_received = false;
+	bool retry_fresh = false;
+	if (!spare) data_connection = std::make_shared<SamConnection>(io_ctx_);
 	result.data_connection = data_connection; // Store early for cleanup in case of partial success
 
 	try {
-		bool connected = co_await data_connection->connect(sam_host_, sam_port_, std::chrono::seconds(10));
-		if (!connected) { throw std::runtime_error("Acceptor P2: Failed to connect."); }
+		if (!spare) {
+			bool connected = co_await data_connection->connect(bridge_, std::chrono::seconds(10));
+			if (!connected) { throw std::runtime_error("Acceptor P2: Failed to connect."); }
 
-		SAM::ParsedMessage hello_reply = co_await data_connection->performHello(std::chrono::seconds(5));
-		if (hello_reply.result != SAM::ResultCode::OK) {
-			SPDLOG_ERROR("Acceptor P2: HELLO failed: {}", hello_reply.original_message);
-			throw std::runtime_error("Acceptor P2: HELLO failed: " + hello_reply.original_message);
+			SAM::ParsedMessage hello_reply = co_await data_connection->performHello(std::chrono::seconds(5));
+			if (hello_reply.result != SAM::ResultCode::OK) {
+				SPDLOG_ERROR("Acceptor P2: HELLO failed: {}", hello_reply.original_message);
+				throw std::runtime_error("Acceptor P2: HELLO failed: " + hello_reply.original_message);
+			}
+			hello_done = true;
 		}
 		
 		std::string accept_cmd = "STREAM ACCEPT ID=" + control_session_id + " SILENT=false\n";
 		co_await net::async_write(data_connection->rawSocket(), net::buffer(accept_cmd), net::use_awaitable);
+		Trace::record(Trace::EventType::COMMAND_SENT, data_connection.get(), accept_cmd.size());
+		Capture::line(Capture::RecordType::COMMAND, data_connection.get(), accept_cmd);
 		
 		
 		std::string status_reply_line = co_await data_connection->readLine(std::chrono::seconds(30)); // Timeout for STREAM STATUS line
+		status_received = true;
 		SPDLOG_INFO("STREAM ACCEPT reply, msg = {}", status_reply_line);
 		
 		SAM::ParsedMessage accept_status_parsed = parser_.parse(status_reply_line);
@@ -153,6 +270,30 @@ net::awaitable<SetupStreamResult> SamService::acceptStreamViaNewConnection(
 			throw std::runtime_error("Acceptor P2: STREAM ACCEPT status error: " + accept_status_parsed.original_message);
 		}
 
+		// Parked until a peer connects; a handoff may move the socket to another process meanwhile.
+		m_parkedAccepts.push_back(data_connection);
+		co_return co_await awaitFromDestination(data_connection, control_session_id);
+
+	} catch (const std::exception& e) {
+		result.error_message = "Acceptor P2 Exception: " + std::string(e.what());
+		result.error_kind = classifyFailure(e, hello_done, status_received);
+		if (data_connection && data_connection->isOpen()) data_connection->closeSocket();
+		result.data_connection = nullptr; // Nullify on error
+		result.success = false;
+		retry_fresh = spare && !status_received && !isReplyTimeout(e);
+		if (retry_fresh) SPDLOG_WARN("Spare connection failed before STREAM STATUS ({}), accepting on a fresh one.", e.what());
+		else SPDLOG_ERROR("Exception: {}", result.error_message);
+	}
+	if (retry_fresh) co_return co_await acceptStream(control_session_id, false);
+	co_return result;
+}
+
+net::awaitable<SetupStreamResult> SamService::awaitFromDestination(
+	std::shared_ptr<SamConnection> data_connection, const std::string& control_session_id) {
+
+	SetupStreamResult result;
+	result.data_connection = data_connection;
+	try {
 		// std::cout << "[SamService DEBUG] Acceptor waiting for FROM_DESTINATION line..." << std::endl;
 		std::string from_dest_line = co_await data_connection->readLine(std::chrono::hours(24*7)); // Long wait for peer
 		if (from_dest_line.empty()) { throw std::runtime_error("Acceptor P2: FROM_DESTINATION line empty."); }
@@ -169,15 +310,228 @@ net::awaitable<SetupStreamResult> SamService::acceptStreamViaNewConnection(
 
 		result.success = true;
 		data_connection->setState(SamConnection::ConnectionState::DATA_STREAM_MODE);
+		if (egress_scheduler_) data_connection->setEgressScheduler(egress_scheduler_);
 		SPDLOG_INFO("Accepted client {} for session {} on new data connection.", result.remote_peer_b32_address, control_session_id);
 
 	} catch (const std::exception& e) {
-		result.error_message = "Acceptor P2 Exception: " + std::string(e.what());
-		SPDLOG_ERROR("Exception: {}", result.error_message);
-		if (data_connection && data_connection->isOpen()) data_connection->closeSocket();
-		result.data_connection = nullptr; // Nullify on error
+		if (m_handedOff && !data_connection->isOpen()) {
+			// The socket now belongs to the process that took over the session.
+			SPDLOG_INFO("Parked STREAM ACCEPT for session {} handed off.", control_session_id);
+			result.error_message = "Acceptor P2: accept handed off to new process";
+		} else {
+			result.error_message = "Acceptor P2 Exception: " + std::string(e.what());
+			result.error_kind = classifyFailure(e, true, false); // EOF here: the bridge dropped the session
+			SPDLOG_ERROR("Exception: {}", result.error_message);
+			if (data_connection->isOpen()) data_connection->closeSocket();
+		}
+		result.data_connection = nullptr;
 		result.success = false;
 	}
+	forgetParkedAccept(data_connection.get());
+	co_return result;
+}
+
+void SamService::forgetParkedAccept(const SamConnection* connection) {
+	std::erase_if(m_parkedAccepts, [connection](const std::weak_ptr<SamConnection>& parked) {
+		auto locked = parked.lock();
+		return !locked || locked.get() == connection;
+	});
+}
+
+net::awaitable<bool> SamService::serveHandoff(const std::string& unix_socket_path) {
+	if (!m_controlConnection || !m_controlConnection->isOpen()) {
+		SPDLOG_ERROR("serveHandoff: no established control session to hand off.");
+		co_return false;
+	}
+	::unlink(unix_socket_path.c_str());
+	net::local::stream_protocol::acceptor acceptor(io_ctx_, net::local::stream_protocol::endpoint(unix_socket_path));
+	// The payload carries the private key: only our own uid may connect, and the peer is checked again below.
+	if (::chmod(unix_socket_path.c_str(), S_IRUSR | S_IWUSR) != 0) {
+		SPDLOG_ERROR("serveHandoff: chmod {} failed: {}", unix_socket_path, std::strerror(errno));
+		acceptor.close();
+		::unlink(unix_socket_path.c_str());
+		co_return false;
+	}
+	SPDLOG_INFO("Waiting for handoff peer on {}", unix_socket_path);
+	net::local::stream_protocol::socket peer(io_ctx_);
+	for (;;) {
+		peer = co_await acceptor.async_accept(net::use_awaitable);
+		std::string peer_error;
+		if (Handoff::peerIsSameUser(peer.native_handle(), peer_error)) break;
+		SPDLOG_WARN("Rejected handoff peer: {}", peer_error);
+		boost::system::error_code ignored;
+		peer.close(ignored);
+	}
+	acceptor.close();
+	::unlink(unix_socket_path.c_str());
+
+	// From here to the release below nothing is awaited: no other handler on this executor can read
+	// from the sockets, so the buffered bytes sent along stay exact.
+	HandoffState state;
+	state.session_id = m_establishedControlSessionId;
+	state.local_b32_address = m_localB32Address;
+	state.raw_destination = m_rawDestination;
+	state.control = HandoffSocket{m_controlConnection->rawSocket().native_handle(), m_controlConnection->bufferedBytes()};
+	std::vector<std::shared_ptr<SamConnection>> parked;
+	for (auto& weak : m_parkedAccepts) {
+		auto connection = weak.lock();
+		if (!connection || !connection->isOpen()) continue;
+		if (state.parked_accepts.size() == Handoff::kMaxSockets) break;
+		state.parked_accepts.push_back(HandoffSocket{connection->rawSocket().native_handle(), connection->bufferedBytes()});
+		parked.push_back(std::move(connection));
+	}
+
+	// The send stays synchronous so the buffered bytes cannot change under it, but on a non-blocking
+	// socket with a deadline.
+	std::string error_message;
+	boost::system::error_code ec;
+	peer.native_non_blocking(true, ec);
+	if (ec || !Handoff::send(peer.native_handle(), state, kHandoffSendTimeout, error_message)) {
+		SPDLOG_ERROR("Handoff failed, keeping session {}: {}", state.session_id, ec ? ec.message() : error_message);
+		co_return false;
+	}
+
+	// The new process holds its own copies; close ours without shutdown so the bridge keeps the session.
+	m_handedOff = true;
+	for (auto& connection : parked) {
+		int fd = connection->releaseNativeHandle();
+		if (fd >= 0) ::close(fd);
+	}
+	int control_fd = m_controlConnection->releaseNativeHandle();
+	if (control_fd >= 0) ::close(control_fd);
+	m_controlConnection = nullptr;
+	SPDLOG_INFO("Session {} handed off with {} parked accept(s).", state.session_id, parked.size());
+	co_return true;
+}
+
+EstablishSessionResult SamService::resumeFromHandoff(const std::string& unix_socket_path) {
+	EstablishSessionResult result;
+	auto start_time = std::chrono::steady_clock::now();
+	net::local::stream_protocol::socket peer(io_ctx_);
+	boost::system::error_code ec;
+	peer.connect(net::local::stream_protocol::endpoint(unix_socket_path), ec);
+	if (ec) {
+		result.error_message = "Handoff: connect to " + unix_socket_path + " failed: " + ec.message();
+		return result;
+	}
+	if (!Handoff::peerIsSameUser(peer.native_handle(), result.error_message)) {
+		return result;
+	}
+
+	HandoffState state;
+	if (!Handoff::receive(peer.native_handle(), state, result.error_message)) {
+		return result;
+	}
+
+	auto control = std::make_shared<SamConnection>(io_ctx_);
+	if (!control->adoptNativeHandle(state.control.fd, SamConnection::ConnectionState::HELLO_OK, state.control.buffered)) {
+		::close(state.control.fd);
+		for (auto& parked : state.parked_accepts) ::close(parked.fd);
+		result.error_message = "Handoff: could not adopt control socket";
+		return result;
+	}
+	m_controlConnection = control;
+	m_establishedControlSessionId = state.session_id;
+	m_localB32Address = state.local_b32_address;
+	m_rawDestination = state.raw_destination;
+
+	for (auto& parked : state.parked_accepts) {
+		auto connection = std::make_shared<SamConnection>(io_ctx_);
+		if (connection->adoptNativeHandle(parked.fd, SamConnection::ConnectionState::HELLO_OK, parked.buffered)) {
+			m_handedOffAccepts.push_back(std::move(connection));
+		} else {
+			::close(parked.fd);
+		}
+	}
+
+	result.success = true;
+	result.created_session_id = state.session_id;
+	result.local_b32_address = state.local_b32_address;
+	result.raw_sam_destination_reply = state.raw_destination;
+	result.session_creation_duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now() - start_time);
+	SPDLOG_INFO("Resumed session {} from handoff ({} parked accept(s)).", state.session_id, m_handedOffAccepts.size());
+	return result;
+}
+
+std::vector<std::shared_ptr<SamConnection>> SamService::takeHandedOffAccepts() {
+	return std::exchange(m_handedOffAccepts, {});
+}
+
+net::awaitable<SetupStreamResult> SamService::resumeAccept(std::shared_ptr<SamConnection> parked_connection) {
+	m_parkedAccepts.push_back(parked_connection);
+	co_return co_await awaitFromDestination(std::move(parked_connection), m_establishedControlSessionId);
+}
+
+std::shared_ptr<SamTransientPool> SamService::makeTransientPool(const TransientPoolConfig& config) {
+	auto pool = std::make_shared<SamTransientPool>(io_ctx_, bridge_, config);
+	pool->setNameCache(name_cache_);
+	pool->start();
+	return pool;
+}
+
+void SamService::enableEgressScheduling(std::size_t chunk_size, std::size_t max_inflight_chunks) {
+	egress_scheduler_ = std::make_shared<SamEgressScheduler>(io_ctx_.get_executor(), chunk_size, max_inflight_chunks);
+}
+
+net::awaitable<NamingLookupResult> SamService::lookupName(const std::string& name, SteadyClock::duration timeout) {
+	auto cache = name_cache_; // Stays alive even if setNameCache swaps it mid-lookup
+	co_return co_await cache->resolve(name, [this, timeout](const std::string& lookup_name) {
+		return fetchName(lookup_name, timeout);
+	});
+}
+
+net::awaitable<NamingLookupResult> SamService::fetchName(const std::string& name, SteadyClock::duration timeout) {
+	NamingLookupResult result;
+	result.name = name;
+	// Never the control connection: a lookup that times out closes its connection, and lookups there
+	// would queue behind each other and behind session commands.
+	std::shared_ptr<SamConnection> connection;
+	while (!connection && !m_lookupConnections.empty()) {
+		auto [idle, idle_since] = std::move(m_lookupConnections.back());
+		m_lookupConnections.pop_back();
+		if (idle->isOpen() && SteadyClock::now() - idle_since < kSpareMaxAge) connection = std::move(idle);
+		else if (idle->isOpen()) idle->closeSocket();
+	}
+	const bool reused = connection != nullptr;
+	bool reusable = false;
+	bool retry_fresh = false;
+	try {
+		if (!connection) {
+			connection = std::make_shared<SamConnection>(io_ctx_);
+			if (!co_await connection->connect(bridge_, std::chrono::seconds(10))) {
+				throw std::runtime_error("Failed to connect for NAMING LOOKUP.");
+			}
+			SAM::ParsedMessage hello_reply = co_await connection->performHello(std::chrono::seconds(5));
+			if (hello_reply.result != SAM::ResultCode::OK) {
+				throw std::runtime_error("HELLO failed: " + hello_reply.original_message);
+			}
+		}
+		SAM::ParsedMessage reply = co_await connection->sendCommandAndWaitReply("NAMING LOOKUP NAME=" + name, timeout);
+		if (reply.error) throwExchangeFailure(reply);
+		if (reply.type != SAM::MessageType::NAMING_REPLY) {
+			throw std::runtime_error("Unexpected reply: " + (reply.original_message.empty() ? reply.message_text : reply.original_message));
+		}
+		reusable = true;
+		result.result = reply.result;
+		result.destination = reply.value;
+		result.success = reply.result == SAM::ResultCode::OK && !reply.value.empty();
+		if (!result.success) {
+			result.error_message = "NAMING LOOKUP " + name + " failed: " + reply.original_message;
+			SPDLOG_DEBUG("{}", result.error_message);
+		}
+	} catch (const std::exception& e) {
+		result.error_message = "NAMING LOOKUP exception: " + std::string(e.what());
+		retry_fresh = reused && !isReplyTimeout(e); // Dropped by the bridge while idle
+		if (retry_fresh) SPDLOG_DEBUG("Idle lookup connection failed ({}), retrying.", e.what());
+		else SPDLOG_ERROR("{}", result.error_message);
+	}
+	if (reusable && connection->isOpen() && m_lookupConnections.size() < kLookupConnectionsIdleMax) {
+		m_lookupConnections.emplace_back(connection, SteadyClock::now());
+	} else if (connection && connection->isOpen()) {
+		connection->closeSocket();
+	}
+	if (retry_fresh) co_return co_await fetchName(name, timeout);
 	co_return result;
 }
 
@@ -185,28 +539,79 @@ net::awaitable<SetupStreamResult> SamService::connectToPeerViaNewConnection(
 	const std::string& control_session_id, // This client's own SAM session ID
 	const std::string& target_peer_i2p_address_b32,
 	const std::map<std::string, std::string>& stream_connect_options) {
+	co_return co_await connectToPeerViaNewConnection(
+		control_session_id, target_peer_i2p_address_b32, net::const_buffer(), stream_connect_options);
+}
+
+net::awaitable<SetupStreamResult> SamService::connectToPeerViaNewConnection(
+	const std::string& control_session_id,
+	const std::string& target_peer_i2p_address_b32,
+	net::const_buffer initial_payload,
+	const std::map<std::string, std::string>& stream_connect_options) {
+	co_return co_await connectToPeer(
+		control_session_id, target_peer_i2p_address_b32, initial_payload, stream_connect_options, true);
+}
+
+net::awaitable<SetupStreamResult> SamService::connectToPeer(
+	const std::string& control_session_id,
+	const std::string& target_peer_i2p_address_b32,
+	net::const_buffer initial_payload,
+	const std::map<std::string, std::string>& stream_connect_options,
+	bool use_spare) {
 	
 	SetupStreamResult result;
 	result.remote_peer_b32_address = target_peer_i2p_address_b32; // We know who we are connecting to
-	auto data_connection = std::make_shared<SamConnection>(io_ctx_);
+	const bool warm = isWarm(target_peer_i2p_address_b32);
+	std::shared_ptr<SamConnection> data_connection = use_spare ? takeSpareConnection() : nullptr;
+	const bool spare = data_connection != nullptr;
+	bool hello_done = spare;
+	bool status_received = false;
+	bool retry_fresh = false;
+	if (!spare) data_connection = std::make_shared<SamConnection>(io_ctx_);
 	result.data_connection = data_connection;
 
 	try {
-		bool connected = co_await data_connection->connect(sam_host_, sam_port_, std::chrono::seconds(10));
-		if (!connected) { throw std::runtime_error("Connector P2: Failed to connect.");}
+		if (!spare) {
+			bool connected = co_await data_connection->connect(bridge_, std::chrono::seconds(10));
+			if (!connected) { throw std::runtime_error("Connector P2: Failed to connect.");}
 
-		SAM::ParsedMessage hello_reply = co_await data_connection->performHello(std::chrono::seconds(5));
-		if (hello_reply.result != SAM::ResultCode::OK) {
-			SPDLOG_ERROR("Connector P2: HELLO failed: {}", hello_reply.original_message);
-			throw std::runtime_error("Connector P2: HELLO failed: " + hello_reply.original_message);
+			SAM::ParsedMessage hello_reply = co_await data_connection->performHello(std::chrono::seconds(5));
+			if (hello_reply.result != SAM::ResultCode::OK) {
+				SPDLOG_ERROR("Connector P2: HELLO failed: {}", hello_reply.original_message);
+				throw std::runtime_error("Connector P2: HELLO failed: " + hello_reply.original_message);
+			}
+			hello_done = true;
 		}
 
+		// Hostnames resolved earlier go out as full destinations, skipping the bridge's own lookup.
+		std::string destination = target_peer_i2p_address_b32;
+		if (destination.ends_with(".i2p") && !destination.ends_with(".b32.i2p")) {
+			if (std::string cached = name_cache_->peek(destination); !cached.empty()) destination = cached;
+		}
 		std::string connect_cmd = "STREAM CONNECT ID=" + control_session_id + 
-								  " DESTINATION=" + target_peer_i2p_address_b32 + 
+								  " DESTINATION=" + destination + 
 								  " SILENT=false";
 		for (const auto& opt : stream_connect_options) { connect_cmd += " " + opt.first + "=" + opt.second; }
 		
-		SAM::ParsedMessage connect_status = co_await data_connection->sendCommandAndWaitReply(connect_cmd, std::chrono::seconds(90)); 
+		SAM::ParsedMessage connect_status;
+		if (initial_payload.size() == 0) {
+			connect_status = co_await data_connection->sendCommandAndWaitReply(connect_cmd, std::chrono::seconds(90)); 
+			if (!data_connection->isOpen()) throwExchangeFailure(connect_status); // No reply line
+		} else {
+			// Command line and payload leave in a single gathered write, so the request
+			// is already queued at the bridge when the tunnel handshake completes.
+			connect_cmd += '\n';
+			std::array<net::const_buffer, 2> request = { net::buffer(connect_cmd), initial_payload };
+			co_await net::async_write(data_connection->rawSocket(), request, net::use_awaitable);
+			Trace::record(Trace::EventType::COMMAND_SENT, data_connection.get(), connect_cmd.size());
+			Trace::record(Trace::EventType::BYTES_WRITTEN, data_connection.get(), initial_payload.size());
+			Capture::line(Capture::RecordType::COMMAND, data_connection.get(), connect_cmd);
+			Capture::data(Capture::RecordType::DATA_OUT, data_connection.get(), initial_payload.size());
+			result.early_data_bytes = initial_payload.size();
+			std::string status_reply_line = co_await data_connection->readLine(std::chrono::seconds(90));
+			connect_status = parser_.parse(status_reply_line);
+		}
+		status_received = true;
 		SPDLOG_INFO("STREAM CONNECT to {} reply, msg = {}", target_peer_i2p_address_b32, connect_status.original_message);
 		
 		if (connect_status.type != SAM::MessageType::STREAM_STATUS || connect_status.result != SAM::ResultCode::OK) {
@@ -215,17 +620,298 @@ net::awaitable<SetupStreamResult> SamService::connectToPeerViaNewConnection(
 		}
 		
 		result.success = true;
+		result.early_data_delivered = result.early_data_bytes > 0;
 		data_connection->setState(SamConnection::ConnectionState::DATA_STREAM_MODE);
-		SPDLOG_INFO("Connected to peer {} via client session {} on new data connection.", target_peer_i2p_address_b32, control_session_id);
+		if (egress_scheduler_) data_connection->setEgressScheduler(egress_scheduler_);
+		markWarm(target_peer_i2p_address_b32);
+		SPDLOG_INFO("Connected to peer {} via client session {} on new data connection{}.", target_peer_i2p_address_b32,
+			control_session_id, warm ? " (warm)" : "");
 
 	} catch (const std::exception& e) {
 		result.error_message = "Connector P2 Exception: " + std::string(e.what());
-		SPDLOG_ERROR("Exception: {}", result.error_message);
+		result.error_kind = classifyFailure(e, hello_done, status_received);
 		if (data_connection && data_connection->isOpen()) data_connection->closeSocket();
 		result.data_connection = nullptr;
+		result.early_data_delivered = false;
 		result.success = false;
+		retry_fresh = spare && !status_received && !isReplyTimeout(e);
+		if (retry_fresh) SPDLOG_WARN("Spare connection failed before STREAM STATUS ({}), connecting on a fresh one.", e.what());
+		else SPDLOG_ERROR("Exception: {}", result.error_message);
+	}
+	if (retry_fresh) { // Early data was not delivered either: it goes out again with the new STREAM CONNECT
+		co_return co_await connectToPeer(
+			control_session_id, target_peer_i2p_address_b32, initial_payload, stream_connect_options, false);
 	}
 	co_return result;
 }
 
-} // namespace SAM
\ No newline at end of file
+void SamService::keepSpareConnections(std::size_t count) {
+	m_spareTarget = count;
+	while (m_spareConnections.size() > m_spareTarget) {
+		if (m_spareConnections.back().first->isOpen()) m_spareConnections.back().first->closeSocket();
+		m_spareConnections.pop_back();
+	}
+	replenishSpares();
+}
+
+std::shared_ptr<SamConnection> SamService::takeSpareConnection() {
+	std::shared_ptr<SamConnection> taken;
+	while (!taken && !m_spareConnections.empty()) {
+		auto [connection, ready_since] = std::move(m_spareConnections.front());
+		m_spareConnections.pop_front();
+		if (connection->isOpen() && SteadyClock::now() - ready_since < kSpareMaxAge) {
+			taken = std::move(connection);
+		} else if (connection->isOpen()) {
+			connection->closeSocket();
+		}
+	}
+	replenishSpares();
+	return taken;
+}
+
+void SamService::replenishSpares() {
+	std::weak_ptr<SamService> weak_self = weak_from_this();
+	if (weak_self.expired()) return; // Not owned by a shared_ptr
+	// A failed build is not retried here; the next take starts another one.
+	while (m_spareConnections.size() + m_spareBuilds < m_spareTarget) {
+		++m_spareBuilds;
+		auto connection = std::make_shared<SamConnection>(io_ctx_);
+		net::co_spawn(io_ctx_,
+			[weak_self, connection, bridge = bridge_]() -> net::awaitable<void> {
+				bool ready = false;
+				try {
+					if (co_await connection->connect(bridge, std::chrono::seconds(10))) {
+						SAM::ParsedMessage hello_reply = co_await connection->performHello(std::chrono::seconds(5));
+						ready = hello_reply.result == SAM::ResultCode::OK;
+					}
+				} catch (const std::exception& e) {
+					SPDLOG_WARN("Spare bridge connection failed: {}", e.what());
+				}
+				auto self = weak_self.lock();
+				if (self) --self->m_spareBuilds;
+				if (self && ready && self->m_spareConnections.size() < self->m_spareTarget) {
+					self->m_spareConnections.emplace_back(connection, SteadyClock::now());
+				} else if (connection->isOpen()) {
+					connection->closeSocket();
+				}
+			},
+			net::detached);
+	}
+}
+
+net::awaitable<FanOutStats> SamService::connectToPeers(
+	const std::string& control_session_id,
+	const std::vector<std::string>& destinations,
+	FanOutResultHandler on_result,
+	FanOutConfig config) {
+
+	auto round = std::make_shared<FanOutRound>();
+	round->control_session_id = control_session_id;
+	round->destinations = destinations;
+	round->on_result = std::move(on_result);
+	round->config = std::move(config);
+	round->start = SteadyClock::now();
+	round->deadline = round->start + round->config.deadline;
+
+	// Each worker takes the next destination as soon as its previous connect finished, so the round
+	// never has more than max_parallel bridge connections open for connects.
+	const std::size_t workers = std::min(std::max<std::size_t>(1, round->config.max_parallel), destinations.size());
+	// The workers keep the service and wait group alive: they may outlive this frame if the round is abandoned.
+	std::shared_ptr<SamService> self = weak_from_this().lock();
+	if (!self) {
+		SPDLOG_ERROR("connectToPeers: the service must be owned by a std::shared_ptr.");
+		co_return round->stats;
+	}
+	auto pending = std::make_shared<AsyncWaitGroup>(io_ctx_.get_executor());
+	for (std::size_t w = 0; w < workers; ++w) {
+		pending->add();
+		net::co_spawn(io_ctx_,
+			[self, round, pending]() -> net::awaitable<void> {
+				co_await self->fanOutWorker(round);
+				pending->done();
+			},
+			net::detached);
+	}
+	co_await pending->wait();
+
+	FanOutStats& stats = round->stats;
+	stats.round_ms = std::chrono::duration<double, std::milli>(SteadyClock::now() - round->start).count();
+	std::sort(round->completion_ms.begin(), round->completion_ms.end());
+	stats.p50_ms = percentileOfSorted(round->completion_ms, 50);
+	stats.p90_ms = percentileOfSorted(round->completion_ms, 90);
+	stats.p99_ms = percentileOfSorted(round->completion_ms, 99);
+	SPDLOG_INFO("Fan-out to {} destination(s): {} connected, {} failed, {} past deadline in {:.0f} ms "
+		"(completion p50 {:.0f} ms, p90 {:.0f} ms, p99 {:.0f} ms, {} in parallel).",
+		destinations.size(), stats.connected, stats.failed, stats.deadline_exceeded, stats.round_ms,
+		stats.p50_ms, stats.p90_ms, stats.p99_ms, workers);
+	co_return stats;
+}
+
+net::awaitable<void> SamService::fanOutWorker(std::shared_ptr<FanOutRound> round) {
+	using namespace net::experimental::awaitable_operators;
+	while (round->next < round->destinations.size()) {
+		const std::size_t index = round->next++;
+		const std::string& destination = round->destinations[index];
+		SetupStreamResult result;
+		bool cut_off = SteadyClock::now() >= round->deadline;
+		if (!cut_off) {
+			net::steady_timer deadline_timer(io_ctx_, round->deadline);
+			// Losing the race cancels the connect, which closes its bridge connection.
+			auto outcome = co_await (
+				connectToPeerViaNewConnection(round->control_session_id, destination, round->config.stream_connect_options) ||
+				deadline_timer.async_wait(net::use_awaitable));
+			if (outcome.index() == 0) result = std::get<0>(std::move(outcome));
+			else cut_off = true;
+		}
+		if (cut_off) {
+			result.remote_peer_b32_address = destination;
+			result.error_message = "Fan-out deadline exceeded";
+			++round->stats.deadline_exceeded;
+		} else if (result.success) {
+			++round->stats.connected;
+			round->completion_ms.push_back(std::chrono::duration<double, std::milli>(SteadyClock::now() - round->start).count());
+		} else {
+			++round->stats.failed;
+		}
+		if (round->on_result) round->on_result(index, std::move(result));
+	}
+}
+
+net::awaitable<WarmUpStats> SamService::warmUpPeers(
+	const std::string& control_session_id,
+	const std::vector<std::string>& destinations,
+	WarmUpConfig config) {
+
+	// The workers keep the service and wait group alive: they may outlive this frame if the round is abandoned.
+	std::shared_ptr<SamService> self = weak_from_this().lock();
+	if (!self) {
+		SPDLOG_ERROR("warmUpPeers: the service must be owned by a std::shared_ptr.");
+		co_return WarmUpStats{};
+	}
+	auto round = std::make_shared<WarmUpRound>();
+	round->control_session_id = control_session_id;
+	round->config = std::move(config);
+	round->start = SteadyClock::now();
+	for (const std::string& destination : destinations) {
+		if (isWarm(destination) || !m_warming.insert(destination).second) ++round->stats.already_warm;
+		else round->destinations.push_back(destination);
+	}
+
+	// Lookups share the control connection, whose exchanges take turns anyway: one worker runs them in
+	// order and lets other commands in between. max_parallel applies to probe connects.
+	const std::size_t parallel = round->config.method == WarmUpConfig::Method::LOOKUP ? 1 : round->config.max_parallel;
+	const std::size_t workers = std::min(std::max<std::size_t>(1, parallel), round->destinations.size());
+	auto pending = std::make_shared<AsyncWaitGroup>(io_ctx_.get_executor());
+	for (std::size_t w = 0; w < workers; ++w) {
+		pending->add();
+		net::co_spawn(io_ctx_,
+			[self, round, pending]() -> net::awaitable<void> {
+				co_await self->warmUpWorker(round);
+				pending->done();
+			},
+			net::detached);
+	}
+	co_await pending->wait();
+
+	WarmUpStats& stats = round->stats;
+	stats.round_ms = std::chrono::duration<double, std::milli>(SteadyClock::now() - round->start).count();
+	std::sort(round->warm_ms.begin(), round->warm_ms.end());
+	stats.p50_ms = percentileOfSorted(round->warm_ms, 50);
+	stats.p99_ms = percentileOfSorted(round->warm_ms, 99);
+	SPDLOG_INFO("Warm-up of {} destination(s) by {}: {} warmed, {} already warm, {} failed in {:.0f} ms "
+		"(p50 {:.0f} ms, p99 {:.0f} ms).", destinations.size(),
+		round->config.method == WarmUpConfig::Method::LOOKUP ? "lookup" : "probe connect",
+		stats.warmed, stats.already_warm, stats.failed, stats.round_ms, stats.p50_ms, stats.p99_ms);
+	co_return stats;
+}
+
+void SamService::warmUp(const std::string& control_session_id, std::vector<std::string> destinations, WarmUpConfig config) {
+	std::weak_ptr<SamService> weak_self = weak_from_this();
+	if (weak_self.expired()) return; // Not owned by a shared_ptr
+	net::co_spawn(io_ctx_,
+		[weak_self, control_session_id, destinations = std::move(destinations), config = std::move(config)]() -> net::awaitable<void> {
+			if (auto self = weak_self.lock()) co_await self->warmUpPeers(control_session_id, destinations, config);
+		},
+		net::detached);
+}
+
+bool SamService::isWarm(const std::string& destination) const {
+	auto it = m_warmUntil.find(destination);
+	return it != m_warmUntil.end() && SteadyClock::now() < it->second;
+}
+
+void SamService::markWarm(const std::string& destination) {
+	const auto now = SteadyClock::now();
+	if (m_warmUntil.size() >= kWarmTrackedMax) {
+		std::erase_if(m_warmUntil, [now](const auto& entry) { return entry.second <= now; });
+	}
+	m_warmUntil[destination] = now + kWarmLifetime;
+}
+
+net::awaitable<void> SamService::warmUpWorker(std::shared_ptr<WarmUpRound> round) {
+	while (round->next < round->destinations.size()) {
+		const std::string& destination = round->destinations[round->next++];
+		const auto start = SteadyClock::now();
+		bool warmed = false;
+		try {
+			warmed = co_await warmUpOne(round->control_session_id, destination, round->config);
+		} catch (const std::exception& e) {
+			SPDLOG_WARN("Warm-up of {} failed: {}", destination, e.what());
+		}
+		m_warming.erase(destination);
+		if (warmed) {
+			markWarm(destination);
+			++round->stats.warmed;
+			round->warm_ms.push_back(std::chrono::duration<double, std::milli>(SteadyClock::now() - start).count());
+		} else {
+			++round->stats.failed;
+		}
+		// Control commands that queued behind this lookup were woken by its turn ending; let them
+		// take the control connection before the next lookup does.
+		if (round->config.method == WarmUpConfig::Method::LOOKUP) co_await net::post(io_ctx_, net::use_awaitable);
+	}
+}
+
+net::awaitable<bool> SamService::warmUpOne(const std::string& control_session_id, const std::string& destination,
+	const WarmUpConfig& config) {
+	using namespace net::experimental::awaitable_operators;
+	if (config.method == WarmUpConfig::Method::PROBE_CONNECT) {
+		net::steady_timer timeout_timer(io_ctx_, config.timeout);
+		// Losing the race cancels the connect, which closes its bridge connection.
+		auto outcome = co_await (
+			connectToPeerViaNewConnection(control_session_id, destination, config.stream_connect_options) ||
+			timeout_timer.async_wait(net::use_awaitable));
+		if (outcome.index() != 0) co_return false;
+		SetupStreamResult probe = std::get<0>(std::move(outcome));
+		if (probe.data_connection && probe.data_connection->isOpen()) probe.data_connection->closeSocket();
+		co_return probe.success;
+	}
+
+	// Routers only fetch a LeaseSet when asked for a .b32.i2p name; hostnames and full destinations
+	// are mapped to their .b32.i2p address first.
+	std::string b32 = destination;
+	if (!b32.ends_with(".b32.i2p")) {
+		std::string full_destination = destination;
+		if (destination.ends_with(".i2p")) {
+			NamingLookupResult name = co_await lookupName(destination, config.timeout);
+			if (!name.success) co_return false;
+			full_destination = name.destination;
+		}
+		b32 = I2PIdentityUtils::getB32AddressFromSamDestinationReply(full_destination, false);
+		if (!b32.ends_with(".b32.i2p")) co_return false;
+	}
+	// Straight to the bridge: a name cache hit would never reach the router. On the control connection
+	// the lookup runs in our session's destination, whose LeaseSet cache the connects use; on any other
+	// connection it would fill the router's shared destination instead. A lookup timeout leaves the
+	// control connection (and the session) up.
+	std::shared_ptr<SamConnection> control = m_controlConnection;
+	if (!control || !control->isOpen()) {
+		NamingLookupResult lookup = co_await fetchName(b32, config.timeout);
+		co_return lookup.success;
+	}
+	// The router keeps fetching after a timeout; a short one bounds how long other commands wait.
+	SAM::ParsedMessage reply = co_await control->namingLookup(b32, std::min(config.timeout, kWarmLookupTimeout));
+	co_return reply.type == SAM::MessageType::NAMING_REPLY && reply.result == SAM::ResultCode::OK;
+}
+
+} // namespace SAM
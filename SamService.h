@@ -3,15 +3,32 @@
 #include <string>
 #include <memory>
 #include <map>
+#include <vector>
+#include <deque>
+#include <set>
+#include <functional>
 #include <boost/asio.hpp>
 #include "SamConnection.h"    // Our base connection class
 #include "SamMessageParser.h" // For result structs/enums
 #include "I2PIdentityUtils.h" // For address parsing
+#include "SamNameCache.h"
 
 namespace net = boost::asio;
 
 namespace SAM {
+
+class SamTransientPool;
+struct TransientPoolConfig;
 	
+// What a failed session or stream setup ran into, so callers can tell a bridge that went away from a
+// command the bridge refused without parsing error_message.
+enum class SamErrorKind {
+	NONE,
+	BRIDGE,  // Connecting or HELLO failed, or the bridge dropped the connection before replying
+	TIMEOUT, // The bridge took the command but no reply came in time (e.g. peer unreachable)
+	COMMAND  // The bridge replied with an error (SESSION STATUS / STREAM STATUS not OK) or something unusable
+};
+
 // Result for establishing the main SAM session
 struct EstablishSessionResult {
 	bool success = false;
@@ -19,6 +36,7 @@ struct EstablishSessionResult {
 	std::string local_b32_address;       // Parsed .b32.i2p address
 	std::string raw_sam_destination_reply; // Raw DESTINATION= field from SAM
 	std::string error_message;
+	SamErrorKind error_kind = SamErrorKind::NONE;
 	bool maybe_unreliable = false;
 	std::chrono::milliseconds session_creation_duration;
 	// The control connection is managed internally by SamService if persistent
@@ -30,12 +48,70 @@ struct SetupStreamResult {
 	std::string remote_peer_b32_address; // Parsed .b32.i2p address of the peer
 	std::shared_ptr<SamConnection> data_connection; // The connection for data transfer
 	std::string error_message;
+	SamErrorKind error_kind = SamErrorKind::NONE;
+	// Optimistic early data (connectToPeerViaNewConnection with an initial payload).
+	// early_data_delivered is only true once STREAM STATUS RESULT=OK was received;
+	// on failure the payload must be treated as not delivered and resent by the caller.
+	std::size_t early_data_bytes = 0;
+	bool early_data_delivered = false;
+};
+
+// Settings for a fan-out connect round (SamService::connectToPeers).
+struct FanOutConfig {
+	std::size_t max_parallel = 16;                             // STREAM CONNECTs in flight at once
+	SteadyClock::duration deadline = std::chrono::seconds(90); // For the whole round
+	std::map<std::string, std::string> stream_connect_options = {
+		{"i2p.streaming.profile", "INTERACTIVE"}, 
+		{"inbound.length", "1"}, 
+		{"outbound.length", "1"}};
+};
+
+struct FanOutStats {
+	std::size_t connected = 0;
+	std::size_t failed = 0;
+	std::size_t deadline_exceeded = 0; // Cut off, or never started, at the round deadline
+	double round_ms = 0;               // Until the last result was delivered
+	// Completion times (from round start) of the successful connects.
+	double p50_ms = 0;
+	double p90_ms = 0;
+	double p99_ms = 0;
+};
+
+// Called once per destination in completion order; index refers to the destinations passed in.
+using FanOutResultHandler = std::function<void(std::size_t index, SetupStreamResult result)>;
+
+// Settings for warming up destinations before their first connect (SamService::warmUpPeers).
+struct WarmUpConfig {
+	enum class Method {
+		// NAMING LOOKUP of the .b32.i2p address on the control connection: the router fetches the LeaseSet.
+		// Sequential, one lookup of at most 10 s at a time; other control commands go in between.
+		LOOKUP,
+		PROBE_CONNECT // STREAM CONNECT, closed as soon as it succeeds; also builds the streaming path, but the peer sees it
+	};
+	Method method = Method::LOOKUP;
+	std::size_t max_parallel = 4;                             // Probes in flight (PROBE_CONNECT only)
+	SteadyClock::duration timeout = std::chrono::seconds(60); // Per destination
+	std::map<std::string, std::string> stream_connect_options = {
+		{"i2p.streaming.profile", "INTERACTIVE"}, 
+		{"inbound.length", "1"}, 
+		{"outbound.length", "1"}};
+};
+
+struct WarmUpStats {
+	std::size_t warmed = 0;
+	std::size_t already_warm = 0; // Skipped: warm or being warmed already
+	std::size_t failed = 0;
+	double round_ms = 0;
+	double p50_ms = 0; // Per-destination warm-up time
+	double p99_ms = 0;
 };
 
 class SamService : public std::enable_shared_from_this<SamService> {
 public:
 	SamService(net::io_context& io_ctx, 
 			   const std::string& sam_host, uint16_t sam_port);
+	// Bridge may also be a Unix domain socket path; used for both control and data connections.
+	SamService(net::io_context& io_ctx, const SamBridgeEndpoint& bridge);
 	~SamService();
 
 	// Establishes the main control SAM session.
@@ -58,7 +134,8 @@ public:
 	);
 
 	// For an Initiator/Client: uses an established control_session_id to connect to a peer.
-	// This will create a new TCP connection to SAM for the connect and data phases.
+	// This will create a new TCP connection to SAM for the connect and data phases
+	// (or take a spare one, see keepSpareConnections).
 	net::awaitable<SetupStreamResult> connectToPeerViaNewConnection(
 		const std::string& control_session_id, // Client's own session ID (from its establishControlSession)
 		const std::string& target_peer_i2p_address_b32, // Target server's .b32.i2p address
@@ -67,20 +144,144 @@ public:
 			{"inbound.length", "1"}, 
 			{"outbound.length", "1"}}
 	);
+
+	// Same as above, but initial_payload is written immediately behind the STREAM CONNECT line
+	// instead of waiting a tunnel round-trip for STREAM STATUS. The bridge buffers it and sends it
+	// as the first stream data once the connect completes. If the connect fails the payload is
+	// reported as not delivered (SetupStreamResult::early_data_delivered == false).
+	// The caller must keep initial_payload alive until the awaitable completes.
+	net::awaitable<SetupStreamResult> connectToPeerViaNewConnection(
+		const std::string& control_session_id,
+		const std::string& target_peer_i2p_address_b32,
+		net::const_buffer initial_payload,
+		const std::map<std::string, std::string>& stream_connect_options = {
+			{"i2p.streaming.profile", "INTERACTIVE"}, 
+			{"inbound.length", "1"}, 
+			{"outbound.length", "1"}}
+	);
 	
+	// Opens streams to many destinations with at most config.max_parallel connects in flight, handing
+	// each SetupStreamResult to on_result as it completes. Connects still pending at the round deadline
+	// are cancelled and reported as failed, like destinations not started by then. Completes once every
+	// destination has been reported; the stats are also logged. Needs the service to be owned by a
+	// std::shared_ptr (the workers hold it).
+	net::awaitable<FanOutStats> connectToPeers(
+		const std::string& control_session_id,
+		const std::vector<std::string>& destinations,
+		FanOutResultHandler on_result,
+		FanOutConfig config = {});
+
+	// Keeps up to count bridge connections connected and past HELLO; stream connects and accepts take
+	// one instead of paying those bridge round trips themselves. 0 (the default) disables spares.
+	// Needs the service to be owned by a std::shared_ptr.
+	void keepSpareConnections(std::size_t count);
+
+	// Makes the router fetch the LeaseSets of destinations we expect to contact soon, so their first
+	// STREAM CONNECT skips the cold lookup. Destinations count as warm for a while after a warm-up or a
+	// successful connect (LeaseSets last about ten minutes); warm ones are skipped. Accepts .b32.i2p
+	// addresses, hostnames (resolved through the name cache) and full destinations. Needs the service
+	// to be owned by a std::shared_ptr.
+	net::awaitable<WarmUpStats> warmUpPeers(
+		const std::string& control_session_id,
+		const std::vector<std::string>& destinations,
+		WarmUpConfig config = {});
+	// Same in the background. Needs the service to be owned by a std::shared_ptr.
+	void warmUp(const std::string& control_session_id, std::vector<std::string> destinations, WarmUpConfig config = {});
+	bool isWarm(const std::string& destination) const;
+
+	// NAMING LOOKUP through the name cache: answers (including KEY_NOT_FOUND) are cached, concurrent
+	// lookups of one name share a single bridge round-trip. Runs on HELLO'd connections of its own,
+	// never the control connection; a few idle ones are kept for the next lookups.
+	net::awaitable<NamingLookupResult> lookupName(const std::string& name,
+		SteadyClock::duration timeout = std::chrono::seconds(30));
+	// The cache is per service by default; several services may share one (same executor).
+	// connectToPeerViaNewConnection uses cached destinations for .i2p hostnames without a lookup.
+	SamNameCache& nameCache() { return *name_cache_; }
+	void setNameCache(std::shared_ptr<SamNameCache> cache) { name_cache_ = std::move(cache); }
+
+	// Pool of pre-built TRANSIENT sessions on this service's bridge, sharing its name cache; one fresh
+	// destination per job without waiting for tunnels. The pool is started before it is returned.
+	std::shared_ptr<SamTransientPool> makeTransientPool(const TransientPoolConfig& config);
+
+	// Optional egress scheduling for this session: data connections set up afterwards share one
+	// SamEgressScheduler (default StreamEgressConfig; adjust per stream with setEgressScheduler).
+	void enableEgressScheduling(std::size_t chunk_size = 16 * 1024, std::size_t max_inflight_chunks = 1);
+	std::shared_ptr<SamEgressScheduler> egressScheduler() const { return egress_scheduler_; }
+
+	// Zero-downtime restart. The running process calls serveHandoff, which waits for one peer on the
+	// Unix socket path and passes it the control socket (keeping the SAM session alive) plus every
+	// STREAM ACCEPT still waiting for a peer. On success this service lets go of those sockets without
+	// closing them on the bridge side; the pending accepts complete with success == false.
+	// The socket is created mode 0600 and peers running as another uid are turned away (both sides
+	// check SO_PEERCRED), since the payload includes the private key. The send itself is bounded by a
+	// few seconds, after which the session is kept.
+	// Must run on a single-threaded io_context so no handler reads from the sockets mid-transfer.
+	net::awaitable<bool> serveHandoff(const std::string& unix_socket_path);
+	// The new process calls resumeFromHandoff instead of establishControlSession (blocking).
+	EstablishSessionResult resumeFromHandoff(const std::string& unix_socket_path);
+	// Accept connections received by resumeFromHandoff; finish each with resumeAccept.
+	std::vector<std::shared_ptr<SamConnection>> takeHandedOffAccepts();
+	net::awaitable<SetupStreamResult> resumeAccept(std::shared_ptr<SamConnection> parked_connection);
+
 	void shutdown(); // Closes the main control connection if it's open
 	bool isOpen();
+	// Completes once the control connection is closed, by shutdown() or by the bridge (EOF or an I/O
+	// error, after which isOpen() is false); meanwhile answers the bridge's PINGs. Cancellable.
+	net::awaitable<void> watchControlConnection();
 	
 	net::any_io_executor get_executor();
 private:
 	net::io_context& io_ctx_;
-	std::string sam_host_;
-	uint16_t sam_port_;
+	SamBridgeEndpoint bridge_;
 	SamMessageParser parser_; // A parser instance for the service if needed, though SamConnection has its own
+	std::shared_ptr<SamNameCache> name_cache_;
+	std::shared_ptr<SamEgressScheduler> egress_scheduler_;
 
 	// Connection for the main SAM session (SESSION CREATE)
 	std::shared_ptr<SamConnection> m_controlConnection; 
 	std::string m_establishedControlSessionId; // Stored after successful establishControlSession
+	std::string m_localB32Address;
+	std::string m_rawDestination;
+
+	// STREAM ACCEPT connections past STREAM STATUS, waiting for FROM_DESTINATION (handoff candidates)
+	std::vector<std::weak_ptr<SamConnection>> m_parkedAccepts;
+	std::vector<std::shared_ptr<SamConnection>> m_handedOffAccepts;
+	bool m_handedOff = false;
+
+	net::awaitable<SetupStreamResult> awaitFromDestination(
+		std::shared_ptr<SamConnection> data_connection, const std::string& control_session_id);
+	void forgetParkedAccept(const SamConnection* connection);
+	net::awaitable<NamingLookupResult> fetchName(const std::string& name, SteadyClock::duration timeout);
+	// Idle HELLO'd connections for fetchName, with the time they went idle
+	std::vector<std::pair<std::shared_ptr<SamConnection>, SteadyClock::time_point>> m_lookupConnections;
+
+	// Bridge connections already past HELLO (keepSpareConnections), with the time they became ready
+	std::deque<std::pair<std::shared_ptr<SamConnection>, SteadyClock::time_point>> m_spareConnections;
+	std::size_t m_spareTarget = 0;
+	std::size_t m_spareBuilds = 0;
+	std::shared_ptr<SamConnection> takeSpareConnection(); // nullptr when none is ready
+	void replenishSpares();
+	// The public accept/connect calls with use_spare = true. A spare that fails before STREAM STATUS
+	// (the bridge dropped it while idle) is retried once with use_spare = false.
+	net::awaitable<SetupStreamResult> acceptStream(const std::string& control_session_id, bool use_spare);
+	net::awaitable<SetupStreamResult> connectToPeer(
+		const std::string& control_session_id,
+		const std::string& target_peer_i2p_address_b32,
+		net::const_buffer initial_payload,
+		const std::map<std::string, std::string>& stream_connect_options,
+		bool use_spare);
+
+	struct FanOutRound;
+	net::awaitable<void> fanOutWorker(std::shared_ptr<FanOutRound> round);
+
+	// Warm-up tracking, by destination as the caller passes it to connect
+	std::map<std::string, SteadyClock::time_point> m_warmUntil;
+	std::set<std::string> m_warming;
+	void markWarm(const std::string& destination);
+	struct WarmUpRound;
+	net::awaitable<void> warmUpWorker(std::shared_ptr<WarmUpRound> round);
+	net::awaitable<bool> warmUpOne(const std::string& control_session_id, const std::string& destination,
+		const WarmUpConfig& config);
 };
 
 } // namespace SAM
\ No newline at end of file
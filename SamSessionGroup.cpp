@@ -0,0 +1,160 @@
+#include "SamSessionGroup.h"
+#include "SamAsyncUtils.h"
+
+namespace SAM {
+
+std::size_t SessionGroupMember::inFlightBytes() const {
+	std::size_t bytes = 0;
+	for (const auto& weak_conn : streams) {
+		if (auto conn = weak_conn.lock()) bytes += conn->pendingWriteBytes();
+	}
+	return bytes;
+}
+
+std::size_t SessionGroupMember::liveStreams() const {
+	std::size_t live = 0;
+	for (const auto& weak_conn : streams) {
+		auto conn = weak_conn.lock();
+		if (conn && conn->isOpen()) ++live;
+	}
+	return live;
+}
+
+SamSessionGroup::SamSessionGroup(net::io_context& io_ctx, const SamBridgeEndpoint& bridge)
+	: io_ctx_(io_ctx), bridge_(bridge) {
+}
+
+SamSessionGroup::~SamSessionGroup() {
+	shutdown();
+}
+
+void SamSessionGroup::shutdown() {
+	running_ = false;
+	for (auto& m : members_) {
+		if (m.service) m.service->shutdown();
+	}
+	members_.clear();
+}
+
+std::string SamSessionGroup::localB32Address() const {
+	return members_.empty() ? std::string() : members_.front().session.local_b32_address;
+}
+
+net::awaitable<std::size_t> SamSessionGroup::establish(
+	const std::string& base_nickname,
+	const std::string& private_key_b64,
+	const std::string& signature_type,
+	std::size_t count,
+	const std::map<std::string, std::string>& options,
+	const std::vector<std::map<std::string, std::string>>& per_member_options) {
+
+	shutdown();
+	// Shared with the workers, which may outlive this frame if establish() is abandoned.
+	auto candidates = std::make_shared<std::vector<SessionGroupMember>>(count);
+	auto pending = std::make_shared<AsyncWaitGroup>(io_ctx_.get_executor());
+
+	// Tunnel builds dominate session setup, so all members are created concurrently.
+	for (std::size_t i = 0; i < count; ++i) {
+		std::map<std::string, std::string> member_options = options;
+		if (i < per_member_options.size()) {
+			for (const auto& opt : per_member_options[i]) member_options[opt.first] = opt.second;
+		}
+		(*candidates)[i].service = std::make_shared<SamService>(io_ctx_, bridge_);
+		pending->add();
+		net::co_spawn(io_ctx_,
+			[candidates, pending, i, member_options,
+			 nickname = base_nickname + "_" + std::to_string(i),
+			 private_key_b64, signature_type]() -> net::awaitable<void> {
+				SessionGroupMember& candidate = (*candidates)[i];
+				try {
+					candidate.session = co_await candidate.service->establishControlSession(
+						nickname, private_key_b64, signature_type, member_options);
+				} catch (const std::exception& e) {
+					candidate.session.success = false;
+					candidate.session.error_message = e.what();
+				}
+				pending->done();
+			},
+			net::detached);
+	}
+	co_await pending->wait();
+
+	for (auto& c : *candidates) {
+		if (c.session.success) {
+			members_.push_back(std::move(c));
+		} else {
+			SPDLOG_WARN("Session group member {} failed: {}", c.session.created_session_id, c.session.error_message);
+		}
+	}
+	running_ = !members_.empty();
+	SPDLOG_INFO("Session group '{}' established with {}/{} members.", base_nickname, members_.size(), count);
+	co_return members_.size();
+}
+
+void SamSessionGroup::startAccepting(StreamHandler handler, std::size_t accepts_per_member) {
+	for (std::size_t i = 0; i < members_.size(); ++i) {
+		for (std::size_t n = 0; n < accepts_per_member; ++n) {
+			net::co_spawn(io_ctx_, acceptLoop(i, handler), net::detached);
+		}
+	}
+}
+
+net::awaitable<void> SamSessionGroup::acceptLoop(std::size_t member_index, StreamHandler handler) {
+	auto self = shared_from_this();
+	while (running_ && member_index < members_.size()) {
+		auto service = members_[member_index].service;
+		std::string session_id = members_[member_index].session.created_session_id;
+		SetupStreamResult accept_res = co_await service->acceptStreamViaNewConnection(session_id);
+		if (!running_) break;
+		if (!accept_res.success || !accept_res.data_connection) {
+			SPDLOG_WARN("Session group accept on {} failed: {}", session_id, accept_res.error_message);
+			net::steady_timer backoff(io_ctx_, std::chrono::seconds(1));
+			co_await backoff.async_wait(net::use_awaitable);
+			continue;
+		}
+		members_[member_index].streams.push_back(accept_res.data_connection);
+		net::co_spawn(io_ctx_, handler(std::move(accept_res)), net::detached);
+	}
+}
+
+std::size_t SamSessionGroup::pickMember() {
+	std::size_t best = 0;
+	std::size_t best_bytes = SIZE_MAX;
+	std::size_t best_streams = SIZE_MAX;
+	for (std::size_t i = 0; i < members_.size(); ++i) {
+		auto& m = members_[i];
+		// Drop bookkeeping for streams that are gone.
+		std::erase_if(m.streams, [](const std::weak_ptr<SamConnection>& w) { return w.expired(); });
+		std::size_t bytes = m.inFlightBytes();
+		std::size_t streams = m.liveStreams();
+		if (bytes < best_bytes || (bytes == best_bytes && streams < best_streams)) {
+			best = i;
+			best_bytes = bytes;
+			best_streams = streams;
+		}
+	}
+	return best;
+}
+
+net::awaitable<SetupStreamResult> SamSessionGroup::connectToPeer(
+	const std::string& target_peer_i2p_address_b32,
+	const std::map<std::string, std::string>& stream_connect_options) {
+
+	if (members_.empty()) {
+		SetupStreamResult result;
+		result.remote_peer_b32_address = target_peer_i2p_address_b32;
+		result.error_message = "Session group has no established members.";
+		co_return result;
+	}
+	std::size_t index = pickMember();
+	auto service = members_[index].service;
+	SetupStreamResult result = co_await service->connectToPeerViaNewConnection(
+		members_[index].session.created_session_id, target_peer_i2p_address_b32, stream_connect_options);
+	if (result.success && result.data_connection && index < members_.size()) {
+		members_[index].streams.push_back(result.data_connection);
+		members_[index].streams_opened++;
+	}
+	co_return result;
+}
+
+} // namespace SAM
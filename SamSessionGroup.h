@@ -0,0 +1,82 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <map>
+#include <vector>
+#include <functional>
+#include <boost/asio.hpp>
+#include "SamService.h"
+
+namespace net = boost::asio;
+
+namespace SAM {
+
+// A member of a SamSessionGroup: one control session (own control connection, own tunnel set).
+struct SessionGroupMember {
+	std::shared_ptr<SamService> service;
+	EstablishSessionResult session;
+	std::vector<std::weak_ptr<SamConnection>> streams; // Live data connections opened through this member
+	std::size_t streams_opened = 0;
+
+	std::size_t inFlightBytes() const;
+	std::size_t liveStreams() const;
+};
+
+// Creates K SAM sessions for the same destination key (distinct nicknames, optionally distinct
+// tunnel options), arms accepts on all of them and spreads outbound STREAM CONNECTs over them by
+// the bytes currently in flight on each member's streams. More sessions means more tunnel sets,
+// which lifts the per-destination bandwidth cap of a single session.
+// Bridges that refuse a second session for the same destination (DUPLICATED_DEST) simply yield a
+// smaller group; establish() reports how many members came up.
+class SamSessionGroup : public std::enable_shared_from_this<SamSessionGroup> {
+public:
+	using StreamHandler = std::function<net::awaitable<void>(SetupStreamResult)>;
+
+	SamSessionGroup(net::io_context& io_ctx, const SamBridgeEndpoint& bridge);
+	~SamSessionGroup();
+
+	// Brings up `count` sessions in parallel; member i is named "<base_nickname>_<i>" and uses
+	// options merged with per_member_options[i] (if given). Returns the number of live members.
+	net::awaitable<std::size_t> establish(
+		const std::string& base_nickname,
+		const std::string& private_key_b64,
+		const std::string& signature_type,
+		std::size_t count,
+		const std::map<std::string, std::string>& options = {
+			{"i2p.streaming.profile", "INTERACTIVE"}, 
+			{"inbound.length", "1"}, 
+			{"outbound.length", "1"}},
+		const std::vector<std::map<std::string, std::string>>& per_member_options = {}
+	);
+
+	// Keeps accepts_per_member STREAM ACCEPTs armed on every member; each accepted stream
+	// is passed to handler in its own coroutine.
+	void startAccepting(StreamHandler handler, std::size_t accepts_per_member = 1);
+
+	// Opens a stream on the member with the fewest bytes in flight.
+	net::awaitable<SetupStreamResult> connectToPeer(
+		const std::string& target_peer_i2p_address_b32,
+		const std::map<std::string, std::string>& stream_connect_options = {
+			{"i2p.streaming.profile", "INTERACTIVE"}, 
+			{"inbound.length", "1"}, 
+			{"outbound.length", "1"}}
+	);
+
+	std::size_t size() const { return members_.size(); }
+	const SessionGroupMember& member(std::size_t index) const { return members_.at(index); }
+	std::string localB32Address() const;
+
+	void shutdown();
+
+private:
+	net::awaitable<void> acceptLoop(std::size_t member_index, StreamHandler handler);
+	std::size_t pickMember();
+
+	net::io_context& io_ctx_;
+	SamBridgeEndpoint bridge_;
+	std::vector<SessionGroupMember> members_;
+	bool running_ = false;
+};
+
+} // namespace SAM
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <utility>
+#include <boost/asio.hpp>
+#include "SamConnection.h"
+
+namespace net = boost::asio;
+
+namespace SAM {
+
+// Asio AsyncReadStream / AsyncWriteStream over a SamConnection in DATA_STREAM_MODE, so protocol
+// layers such as net::ssl::stream<SamStream> or Boost.Beast's http::async_read/async_write run over
+// an I2P stream. Operations go through streamRead/streamWrite: data moves directly between the
+// caller's buffers and the socket (no intermediate copy), the connection's per-direction deadlines
+// apply (see setReadTimeout/setWriteTimeout) and the trace records the traffic as usual.
+// Per-operation cancellation (e.g. net::bind_cancellation_slot on the completion token) maps to
+// cancel_read_operations / cancel_write_operations. Handlers complete with error_code: eof when the
+// peer closed, timed_out when a deadline passed, operation_aborted when cancelled.
+class SamStream {
+public:
+	using executor_type = net::any_io_executor;
+	using lowest_layer_type = SamStream;
+
+	explicit SamStream(std::shared_ptr<SamConnection> connection)
+		: connection_(std::move(connection)) {}
+
+	executor_type get_executor() { return connection_->get_executor(); }
+	SamConnection& connection() { return *connection_; }
+	// For net::ssl::stream<SamStream>::lowest_layer() and beast::get_lowest_layer().
+	SamStream& lowest_layer() { return *this; }
+	const SamStream& lowest_layer() const { return *this; }
+
+	// Deadline for each read / write operation; duration::max() waits indefinitely.
+	void setReadTimeout(SteadyClock::duration timeout) { read_timeout_ = timeout; }
+	void setWriteTimeout(SteadyClock::duration timeout) { write_timeout_ = timeout; }
+
+	void close() { connection_->closeSocket(); }
+	bool is_open() const { return connection_->isOpen(); }
+
+	template <typename MutableBufferSequence, typename ReadToken>
+	auto async_read_some(const MutableBufferSequence& buffers, ReadToken&& token) {
+		// A read fills the first non-empty buffer, as the socket's own async_read_some does.
+		net::mutable_buffer target;
+		for (auto it = net::buffer_sequence_begin(buffers); it != net::buffer_sequence_end(buffers); ++it) {
+			net::mutable_buffer b(*it);
+			if (b.size() > 0) {
+				target = b;
+				break;
+			}
+		}
+		auto conn = connection_;
+		auto timeout = read_timeout_;
+		return net::async_initiate<ReadToken, void(boost::system::error_code, std::size_t)>(
+			[conn, target, timeout](auto handler) {
+				launch(conn, std::move(handler),
+					[conn] { conn->cancel_read_operations(); },
+					[conn, target, timeout]() -> net::awaitable<std::size_t> {
+						if (target.size() == 0) co_return 0;
+						co_return co_await conn->streamRead(target, timeout);
+					});
+			},
+			token);
+	}
+
+	template <typename ConstBufferSequence, typename WriteToken>
+	auto async_write_some(const ConstBufferSequence& buffers, WriteToken&& token) {
+		// Gathered into one streamWrite; the buffer descriptors are copied, the data is not.
+		std::vector<net::const_buffer> gathered;
+		for (auto it = net::buffer_sequence_begin(buffers); it != net::buffer_sequence_end(buffers); ++it) {
+			net::const_buffer b(*it);
+			if (b.size() > 0) gathered.push_back(b);
+		}
+		auto conn = connection_;
+		auto timeout = write_timeout_;
+		return net::async_initiate<WriteToken, void(boost::system::error_code, std::size_t)>(
+			[conn, timeout, gathered = std::move(gathered)](auto handler) mutable {
+				launch(conn, std::move(handler),
+					[conn] { conn->cancel_write_operations(); },
+					[conn, timeout, gathered = std::move(gathered)]() -> net::awaitable<std::size_t> {
+						const std::size_t total = net::buffer_size(gathered);
+						if (total == 0) co_return 0;
+						co_await conn->streamWrite(std::span<const net::const_buffer>(gathered), timeout);
+						co_return total;
+					});
+			},
+			token);
+	}
+
+private:
+	// Runs op on the connection's executor and completes handler(ec, bytes) on the handler's executor.
+	template <typename Handler, typename Cancel, typename Operation>
+	static void launch(std::shared_ptr<SamConnection> conn, Handler handler, Cancel cancel, Operation op) {
+		auto slot = net::get_associated_cancellation_slot(handler);
+		if (slot.is_connected()) {
+			slot.assign([cancel](net::cancellation_type) { cancel(); });
+		}
+		auto work = net::make_work_guard(net::get_associated_executor(handler, conn->get_executor()));
+		net::co_spawn(conn->get_executor(),
+			[op = std::move(op)]() -> net::awaitable<std::pair<boost::system::error_code, std::size_t>> {
+				try {
+					std::size_t n = co_await op();
+					co_return std::make_pair(boost::system::error_code(), n);
+				} catch (const boost::system::system_error& e) {
+					co_return std::make_pair(e.code(), std::size_t{0});
+				}
+			},
+			[handler = std::move(handler), work = std::move(work), slot](
+				std::exception_ptr ep, std::pair<boost::system::error_code, std::size_t> result) mutable {
+				if (slot.is_connected()) slot.clear();
+				if (ep) result = {net::error::fault, 0};
+				auto ex = work.get_executor();
+				work.reset();
+				net::dispatch(ex, [handler = std::move(handler), result]() mutable {
+					std::move(handler)(result.first, result.second);
+				});
+			});
+	}
+
+	std::shared_ptr<SamConnection> connection_;
+	SteadyClock::duration read_timeout_ = std::chrono::minutes(5);
+	SteadyClock::duration write_timeout_ = std::chrono::seconds(30);
+};
+
+} // namespace SAM
@@ -0,0 +1,567 @@
+#include "SamTls.h"
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <climits>
+#include <ctime>
+#include <boost/asio/ssl/error.hpp>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+#include <spdlog/spdlog.h>
+
+namespace SAM {
+
+namespace {
+
+constexpr std::size_t kWriteChunk = 64 * 1024; // Plaintext per SSL_write, bounds the memory BIO
+
+std::string sslErrorString() {
+	unsigned long code = ERR_get_error();
+	ERR_clear_error();
+	if (code == 0) return "unknown error";
+	char buffer[256];
+	ERR_error_string_n(code, buffer, sizeof(buffer));
+	return buffer;
+}
+
+std::string certificateDigest(X509* cert) {
+	if (!cert) return {};
+	unsigned char digest[EVP_MAX_MD_SIZE];
+	unsigned int length = 0;
+	if (X509_digest(cert, EVP_sha256(), digest, &length) != 1) return {};
+	static const char* hex = "0123456789abcdef";
+	std::string out;
+	for (unsigned int i = 0; i < length; ++i) {
+		out += hex[digest[i] >> 4];
+		out += hex[digest[i] & 0x0f];
+	}
+	return out;
+}
+
+bool equalsIgnoreCase(const std::string& a, const std::string& b) {
+	return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(),
+		[](char x, char y) { return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y)); });
+}
+
+// Ed25519 key and a self-signed certificate valid for `days`; the caller frees both.
+bool generateCertificate(long days, EVP_PKEY*& key, X509*& cert) {
+	key = nullptr;
+	EVP_PKEY_CTX* key_ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_ED25519, nullptr);
+	bool ok = key_ctx && EVP_PKEY_keygen_init(key_ctx) == 1 && EVP_PKEY_keygen(key_ctx, &key) == 1;
+	EVP_PKEY_CTX_free(key_ctx);
+	cert = ok ? X509_new() : nullptr;
+	if (!cert) return false;
+	X509_set_version(cert, 2);
+	ASN1_INTEGER_set(X509_get_serialNumber(cert), static_cast<long>(std::time(nullptr)));
+	X509_gmtime_adj(X509_getm_notBefore(cert), -3600);
+	X509_gmtime_adj(X509_getm_notAfter(cert), days * 24 * 3600);
+	X509_set_pubkey(cert, key);
+	X509_NAME* name = X509_get_subject_name(cert);
+	X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>("samssl"), -1, -1, 0);
+	X509_set_issuer_name(cert, name);
+	return X509_sign(cert, key, nullptr) > 0;
+}
+
+// One-year certificate for servers without a configured one.
+bool useEphemeralCertificate(SSL_CTX* ctx) {
+	EVP_PKEY* key = nullptr;
+	X509* cert = nullptr;
+	bool ok = generateCertificate(365, key, cert) && SSL_CTX_use_certificate(ctx, cert) == 1 && SSL_CTX_use_PrivateKey(ctx, key) == 1;
+	X509_free(cert);
+	EVP_PKEY_free(key);
+	return ok;
+}
+
+// Generates a ten-year certificate into cert_file/key_file (key readable by us only), so restarts keep
+// the same certificate and fingerprint. Neither file may exist yet.
+bool writeGeneratedCertificate(const std::string& cert_file, const std::string& key_file, std::string& error_message) {
+	EVP_PKEY* key = nullptr;
+	X509* cert = nullptr;
+	bool ok = generateCertificate(3650, key, cert);
+	if (!ok) error_message = "Cannot generate TLS certificate: " + sslErrorString();
+	if (ok) {
+		int fd = ::open(key_file.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, S_IRUSR | S_IWUSR);
+		FILE* out = fd >= 0 ? ::fdopen(fd, "w") : nullptr;
+		ok = out && PEM_write_PrivateKey(out, key, nullptr, nullptr, 0, nullptr, nullptr) == 1;
+		if (out) ok = std::fclose(out) == 0 && ok;
+		else if (fd >= 0) ::close(fd);
+		if (!ok) error_message = "Cannot write TLS key " + key_file + ": " + std::strerror(errno);
+	}
+	if (ok) {
+		FILE* out = std::fopen(cert_file.c_str(), "wx");
+		ok = out && PEM_write_X509(out, cert) == 1;
+		if (out) ok = std::fclose(out) == 0 && ok;
+		if (!ok) {
+			error_message = "Cannot write TLS certificate " + cert_file + ": " + std::strerror(errno);
+			::unlink(key_file.c_str());
+		}
+	}
+	X509_free(cert);
+	EVP_PKEY_free(key);
+	return ok;
+}
+
+bool fileExists(const std::string& path) {
+	struct stat st;
+	return ::stat(path.c_str(), &st) == 0;
+}
+
+// TLS 1.3 tickets arrive after the handshake; OpenSSL hands each one over here.
+int onNewSession(SSL* ssl, SSL_SESSION* session) {
+	auto* channel = static_cast<TlsChannel*>(SSL_get_app_data(ssl));
+	auto* context = static_cast<TlsContext*>(SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl)));
+	if (!channel || !context) return 0;
+	context->storeSession(channel->peer(), session);
+	return 1; // Ownership taken
+}
+
+double millisSince(SteadyClock::time_point start) {
+	return std::chrono::duration<double, std::milli>(SteadyClock::now() - start).count();
+}
+
+} // namespace
+
+// --- TlsContext ---
+
+TlsContext::TlsContext(SSL_CTX* ctx, TlsConfig config, bool server)
+	: ctx_(ctx), config_(std::move(config)), server_(server) {
+	SSL_CTX_set_app_data(ctx_, this);
+	if (server_) cert_sha256_ = certificateDigest(SSL_CTX_get0_certificate(ctx_));
+}
+
+TlsContext::~TlsContext() {
+	clearSessions();
+	SSL_CTX_free(ctx_);
+}
+
+std::shared_ptr<TlsContext> TlsContext::makeClient(const TlsConfig& config, std::string& error_message) {
+	SSL_CTX* ctx = SSL_CTX_new(TLS_client_method());
+	if (!ctx) {
+		error_message = "SSL_CTX_new failed: " + sslErrorString();
+		return nullptr;
+	}
+	if (config.pinned_sha256.empty()) {
+		if (!config.allow_unpinned) {
+			error_message = "TLS client needs TlsConfig::pinned_sha256 (or allow_unpinned to accept any certificate)";
+			SSL_CTX_free(ctx);
+			return nullptr;
+		}
+		SPDLOG_WARN("TLS client without a certificate pin: any server certificate is accepted, "
+			"only the I2P destination authenticates the peer.");
+	}
+	SSL_CTX_set_min_proto_version(ctx, TLS1_3_VERSION);
+	SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, nullptr); // Checked against pinned_sha256 after the handshake
+	SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+	SSL_CTX_sess_set_new_cb(ctx, onNewSession);
+	return std::shared_ptr<TlsContext>(new TlsContext(ctx, config, false));
+}
+
+std::shared_ptr<TlsContext> TlsContext::makeServer(const TlsConfig& config, std::string& error_message) {
+	SSL_CTX* ctx = SSL_CTX_new(TLS_server_method());
+	if (!ctx) {
+		error_message = "SSL_CTX_new failed: " + sslErrorString();
+		return nullptr;
+	}
+	SSL_CTX_set_min_proto_version(ctx, TLS1_3_VERSION);
+	bool loaded;
+	if (config.cert_file.empty() && config.key_file.empty()) {
+		loaded = useEphemeralCertificate(ctx);
+	} else {
+		if (!config.cert_file.empty() && !config.key_file.empty() &&
+			!fileExists(config.cert_file) && !fileExists(config.key_file)) {
+			if (!writeGeneratedCertificate(config.cert_file, config.key_file, error_message)) {
+				SSL_CTX_free(ctx);
+				return nullptr;
+			}
+			SPDLOG_INFO("Generated TLS certificate {} and key {}", config.cert_file, config.key_file);
+		}
+		loaded = SSL_CTX_use_certificate_chain_file(ctx, config.cert_file.c_str()) == 1
+			&& SSL_CTX_use_PrivateKey_file(ctx, config.key_file.c_str(), SSL_FILETYPE_PEM) == 1
+			&& SSL_CTX_check_private_key(ctx) == 1;
+	}
+	if (!loaded) {
+		error_message = "Cannot set up TLS certificate: " + sslErrorString();
+		SSL_CTX_free(ctx);
+		return nullptr;
+	}
+	static const unsigned char kSessionContext[] = "samssl";
+	SSL_CTX_set_session_id_context(ctx, kSessionContext, sizeof(kSessionContext) - 1);
+	if (config.max_early_data > 0) {
+		// OpenSSL keeps its anti-replay protection on: each ticket is accepted for 0-RTT once.
+		SSL_CTX_set_max_early_data(ctx, config.max_early_data);
+		SSL_CTX_set_recv_max_early_data(ctx, config.max_early_data);
+	}
+	return std::shared_ptr<TlsContext>(new TlsContext(ctx, config, true));
+}
+
+SSL_SESSION* TlsContext::takeSession(const std::string& peer) {
+	auto it = sessions_.find(peer);
+	if (it == sessions_.end()) return nullptr;
+	const long now = static_cast<long>(std::time(nullptr));
+	while (!it->second.empty()) {
+		SSL_SESSION* session = it->second.back(); // Newest ticket first
+		it->second.pop_back();
+		if (SSL_SESSION_get_time(session) + SSL_SESSION_get_timeout(session) > now) return session;
+		SSL_SESSION_free(session);
+	}
+	return nullptr;
+}
+
+void TlsContext::storeSession(const std::string& peer, SSL_SESSION* session) {
+	if (!SSL_SESSION_is_resumable(session)) {
+		SSL_SESSION_free(session);
+		return;
+	}
+	auto it = sessions_.find(peer);
+	if (it == sessions_.end()) {
+		while (sessions_.size() >= std::max<std::size_t>(1, config_.max_cached_peers) && !peer_order_.empty()) {
+			auto oldest = sessions_.find(peer_order_.front());
+			peer_order_.pop_front();
+			if (oldest == sessions_.end()) continue;
+			for (SSL_SESSION* s : oldest->second) SSL_SESSION_free(s);
+			sessions_.erase(oldest);
+		}
+		it = sessions_.emplace(peer, std::deque<SSL_SESSION*>{}).first;
+		peer_order_.push_back(peer);
+	}
+	it->second.push_back(session);
+	while (it->second.size() > std::max<std::size_t>(1, config_.tickets_per_peer)) {
+		SSL_SESSION_free(it->second.front());
+		it->second.pop_front();
+	}
+}
+
+std::size_t TlsContext::cachedSessions(const std::string& peer) const {
+	auto it = sessions_.find(peer);
+	return it == sessions_.end() ? 0 : it->second.size();
+}
+
+void TlsContext::clearSessions() {
+	for (auto& [peer, queue] : sessions_) {
+		for (SSL_SESSION* s : queue) SSL_SESSION_free(s);
+	}
+	sessions_.clear();
+	peer_order_.clear();
+}
+
+// --- TlsChannel ---
+
+TlsChannel::TlsChannel(std::shared_ptr<TlsContext> context, std::string peer, bool server)
+	: context_(std::move(context)), peer_(std::move(peer)), server_(server), read_buffer_(16 * 1024) {
+	ssl_ = SSL_new(context_->native_handle());
+	if (!ssl_) throw std::runtime_error("SSL_new failed: " + sslErrorString());
+	network_in_ = BIO_new(BIO_s_mem());
+	network_out_ = BIO_new(BIO_s_mem());
+	BIO_set_mem_eof_return(network_in_, -1); // Empty input means "wait for the stream", not EOF
+	SSL_set_bio(ssl_, network_in_, network_out_); // SSL owns both BIOs now
+	SSL_set_app_data(ssl_, this);
+	if (server_) SSL_set_accept_state(ssl_);
+	else SSL_set_connect_state(ssl_);
+}
+
+TlsChannel::~TlsChannel() {
+	if (!ssl_) return;
+	// Without this SSL_free marks the current session, i.e. the newest ticket, as not resumable.
+	// I2P streams often end without close_notify; tickets received on them stay good.
+	SSL_set_shutdown(ssl_, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+	SSL_free(ssl_);
+}
+
+bool TlsChannel::resumed() const {
+	return SSL_session_reused(ssl_) == 1;
+}
+
+net::awaitable<TlsConnectResult> TlsChannel::connect(
+	SamService& service,
+	const std::string& control_session_id,
+	const std::string& peer_b32,
+	std::shared_ptr<TlsContext> context,
+	net::const_buffer early_data,
+	SteadyClock::duration timeout) {
+
+	TlsConnectResult result;
+	TlsStats& stats = context->stats();
+	const auto start = SteadyClock::now();
+	std::shared_ptr<TlsChannel> channel(new TlsChannel(context, peer_b32, false));
+
+	// Build the first flight before the stream exists: ClientHello, plus 0-RTT data when a ticket allows it.
+	bool early_sent = false;
+	if (SSL_SESSION* session = context->takeSession(peer_b32)) {
+		SSL_set_session(channel->ssl_, session);
+		if (early_data.size() > 0 && early_data.size() <= SSL_SESSION_get_max_early_data(session)) {
+			std::size_t written = 0;
+			early_sent = SSL_write_early_data(channel->ssl_, early_data.data(), early_data.size(), &written) == 1
+				&& written == early_data.size();
+			if (!early_sent) {
+				result.error_message = "Writing 0-RTT data failed: " + sslErrorString();
+				++stats.failures;
+				SSL_SESSION_free(session);
+				co_return result;
+			}
+		}
+		SSL_SESSION_free(session);
+	}
+	if (!early_sent) {
+		int ret = SSL_do_handshake(channel->ssl_);
+		if (ret != 1 && SSL_get_error(channel->ssl_, ret) != SSL_ERROR_WANT_READ) {
+			result.error_message = "Creating ClientHello failed: " + sslErrorString();
+			++stats.failures;
+			co_return result;
+		}
+	}
+	if (early_data.size() > 0) ++stats.early_data_offered;
+	std::string first_flight = channel->takeOutput();
+
+	// The flight rides behind the STREAM CONNECT line (SAM early data) instead of waiting for STREAM STATUS.
+	SetupStreamResult stream = co_await service.connectToPeerViaNewConnection(
+		control_session_id, peer_b32, net::buffer(first_flight));
+	if (!stream.success || !stream.data_connection) {
+		result.error_message = stream.error_message;
+		++stats.failures;
+		co_return result;
+	}
+	channel->connection_ = stream.data_connection;
+
+	try {
+		co_await channel->finishHandshake(timeout);
+		const std::string& pin = context->config().pinned_sha256;
+		if (!pin.empty()) {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+			X509* cert = SSL_get1_peer_certificate(channel->ssl_);
+#else
+			X509* cert = SSL_get_peer_certificate(channel->ssl_);
+#endif
+			std::string digest = certificateDigest(cert);
+			X509_free(cert);
+			if (!equalsIgnoreCase(digest, pin)) throw std::runtime_error("server certificate " + digest + " does not match the pinned one");
+		}
+		result.resumed = channel->resumed();
+		if (early_data.size() > 0) {
+			result.early_data_accepted = early_sent && SSL_get_early_data_status(channel->ssl_) == SSL_EARLY_DATA_ACCEPTED;
+			// Rejected or not sent: deliver it now, in the same write as our Finished.
+			if (!result.early_data_accepted) co_await channel->write(early_data, timeout);
+		}
+		co_await channel->flush(timeout);
+	} catch (const std::exception& e) {
+		result.error_message = "TLS handshake with " + peer_b32 + " failed: " + e.what();
+		SPDLOG_ERROR("{}", result.error_message);
+		++stats.failures;
+		if (channel->connection_->isOpen()) channel->connection_->closeSocket();
+		co_return result;
+	}
+
+	result.handshake_ms = millisSince(start);
+	++stats.handshakes;
+	if (result.resumed) {
+		++stats.resumed;
+		stats.resumed_handshake_ms_total += result.handshake_ms;
+	} else {
+		stats.full_handshake_ms_total += result.handshake_ms;
+	}
+	if (result.early_data_accepted) ++stats.early_data_accepted;
+	SPDLOG_INFO("TLS to {} up in {:.1f} ms ({}{})", peer_b32, result.handshake_ms,
+		result.resumed ? "resumed" : "full handshake", result.early_data_accepted ? ", 0-RTT accepted" : "");
+	result.channel = std::move(channel);
+	result.success = true;
+	co_return result;
+}
+
+net::awaitable<TlsAcceptResult> TlsChannel::accept(
+	std::shared_ptr<SamConnection> connection,
+	const std::string& peer_b32,
+	std::shared_ptr<TlsContext> context,
+	SteadyClock::duration timeout) {
+
+	TlsAcceptResult result;
+	TlsStats& stats = context->stats();
+	std::shared_ptr<TlsChannel> channel(new TlsChannel(context, peer_b32, true));
+	channel->connection_ = std::move(connection);
+
+	try {
+		if (context->config().max_early_data > 0) {
+			std::array<char, 4096> buffer;
+			for (;;) {
+				std::size_t n = 0;
+				int ret = SSL_read_early_data(channel->ssl_, buffer.data(), buffer.size(), &n);
+				if (ret == SSL_READ_EARLY_DATA_SUCCESS) {
+					result.early_data.append(buffer.data(), n);
+					continue;
+				}
+				if (ret == SSL_READ_EARLY_DATA_FINISH) break;
+				if (SSL_get_error(channel->ssl_, ret) != SSL_ERROR_WANT_READ) channel->throwSslError(ret);
+				if (!result.early_data.empty()) {
+					// The client sends EndOfEarlyData only after our flight; hand over what arrived and
+					// let read() deliver any remaining early data.
+					channel->early_reading_ = true;
+					break;
+				}
+				co_await channel->flush(timeout);
+				co_await channel->fill(timeout);
+			}
+			channel->early_write_ = SSL_get_early_data_status(channel->ssl_) == SSL_EARLY_DATA_ACCEPTED;
+		}
+		// With accepted early data the application may answer before the client's Finished arrives.
+		if (!channel->early_write_) co_await channel->finishHandshake(timeout);
+		co_await channel->flush(timeout);
+	} catch (const std::exception& e) {
+		result.error_message = "TLS accept from " + peer_b32 + " failed: " + e.what();
+		SPDLOG_ERROR("{}", result.error_message);
+		++stats.failures;
+		if (channel->connection_->isOpen()) channel->connection_->closeSocket();
+		co_return result;
+	}
+
+	++stats.handshakes;
+	if (channel->resumed()) ++stats.resumed;
+	if (channel->early_write_) ++stats.early_data_accepted;
+	result.channel = std::move(channel);
+	result.success = true;
+	co_return result;
+}
+
+net::awaitable<std::size_t> TlsChannel::read(net::mutable_buffer buffer, SteadyClock::duration timeout) {
+	if (buffer.size() == 0) co_return 0;
+	while (early_reading_) {
+		std::size_t n = 0;
+		int ret = SSL_read_early_data(ssl_, buffer.data(), buffer.size(), &n);
+		if (ret == SSL_READ_EARLY_DATA_SUCCESS) co_return n;
+		if (ret == SSL_READ_EARLY_DATA_FINISH) {
+			early_reading_ = false;
+			break;
+		}
+		if (SSL_get_error(ssl_, ret) != SSL_ERROR_WANT_READ) throwSslError(ret);
+		co_await flush(timeout);
+		co_await fill(timeout);
+	}
+	const int wanted = static_cast<int>(std::min<std::size_t>(buffer.size(), INT_MAX));
+	for (;;) {
+		int ret = SSL_read(ssl_, buffer.data(), wanted);
+		if (ret > 0) {
+			// Handshake completion, tickets and key updates queue records of their own.
+			if (BIO_ctrl_pending(network_out_) > 0) co_await flush(timeout);
+			co_return static_cast<std::size_t>(ret);
+		}
+		int err = SSL_get_error(ssl_, ret);
+		if (err == SSL_ERROR_ZERO_RETURN) throw boost::system::system_error(net::error::eof);
+		if (err != SSL_ERROR_WANT_READ) throwSslError(ret);
+		co_await flush(timeout);
+		co_await fill(timeout);
+	}
+}
+
+net::awaitable<void> TlsChannel::write(net::const_buffer buffer, SteadyClock::duration timeout) {
+	const char* data = static_cast<const char*>(buffer.data());
+	std::size_t remaining = buffer.size();
+	while (remaining > 0) {
+		const std::size_t chunk = std::min(remaining, kWriteChunk);
+		std::size_t written = 0;
+		int ret;
+		if (server_ && early_write_ && !SSL_is_init_finished(ssl_)) {
+			ret = SSL_write_early_data(ssl_, data, chunk, &written); // 0.5-RTT data
+		} else {
+			ret = SSL_write_ex(ssl_, data, chunk, &written);
+		}
+		if (ret == 1) {
+			data += written;
+			remaining -= written;
+			co_await flush(timeout);
+			continue;
+		}
+		int err = SSL_get_error(ssl_, ret);
+		if (err == SSL_ERROR_WANT_WRITE) {
+			co_await flush(timeout);
+		} else if (err == SSL_ERROR_WANT_READ) { // Handshake still in progress
+			co_await flush(timeout);
+			co_await fill(timeout);
+		} else {
+			throwSslError(ret);
+		}
+	}
+}
+
+net::awaitable<void> TlsChannel::shutdown() {
+	if (!connection_ || !connection_->isOpen()) co_return;
+	SSL_shutdown(ssl_);
+	try {
+		co_await flush(std::chrono::seconds(5));
+		// The server sends tickets once it has our Finished, which after a 0-RTT exchange may be after
+		// the response. With none cached for this peer, wait for them (or the server's close_notify).
+		std::array<char, 512> discard;
+		while (!server_ && context_->cachedSessions(peer_) == 0) {
+			co_await read(net::buffer(discard), std::chrono::seconds(5));
+		}
+	} catch (const std::exception&) {
+		// Peer gone or closed; nothing left to exchange.
+	}
+	connection_->closeSocket();
+}
+
+net::awaitable<void> TlsChannel::finishHandshake(SteadyClock::duration timeout) {
+	for (;;) {
+		int ret = SSL_do_handshake(ssl_);
+		if (ret == 1) co_return;
+		int err = SSL_get_error(ssl_, ret);
+		if (err == SSL_ERROR_WANT_WRITE) {
+			co_await flush(timeout);
+		} else if (err == SSL_ERROR_WANT_READ) {
+			co_await flush(timeout);
+			co_await fill(timeout);
+		} else {
+			throwSslError(ret);
+		}
+	}
+}
+
+net::awaitable<void> TlsChannel::flush(SteadyClock::duration timeout) {
+	// Records must leave in order, so one flush writes at a time; a caller arriving meanwhile waits for
+	// it, then writes whatever is still queued (its own records may already be gone).
+	while (flushing_) {
+		if (!flush_done_) flush_done_ = std::make_unique<AsyncCondition>(connection_->get_executor());
+		co_await flush_done_->wait();
+	}
+	flushing_ = true;
+	struct FlushDone {
+		TlsChannel& channel;
+		~FlushDone() {
+			channel.flushing_ = false;
+			if (channel.flush_done_) channel.flush_done_->notifyAll();
+		}
+	} done{*this};
+	for (std::string out = takeOutput(); !out.empty(); out = takeOutput()) {
+		co_await connection_->streamWrite(net::buffer(out), timeout);
+	}
+}
+
+net::awaitable<void> TlsChannel::fill(SteadyClock::duration timeout) {
+	std::size_t n = co_await connection_->streamRead(net::buffer(read_buffer_), timeout);
+	if (n == 0) throw boost::system::system_error(net::error::eof);
+	BIO_write(network_in_, read_buffer_.data(), static_cast<int>(n));
+}
+
+std::string TlsChannel::takeOutput() {
+	std::string out(BIO_ctrl_pending(network_out_), '\0');
+	if (!out.empty()) {
+		int n = BIO_read(network_out_, out.data(), static_cast<int>(out.size()));
+		out.resize(n > 0 ? static_cast<std::size_t>(n) : 0);
+	}
+	return out;
+}
+
+void TlsChannel::throwSslError(int ret) {
+	int err = SSL_get_error(ssl_, ret);
+	unsigned long code = ERR_get_error();
+	ERR_clear_error();
+	if (err == SSL_ERROR_SYSCALL && code == 0) throw boost::system::system_error(net::error::eof);
+	throw boost::system::system_error(
+		boost::system::error_code(static_cast<int>(code), net::error::get_ssl_category()));
+}
+
+} // namespace SAM
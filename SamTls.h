@@ -0,0 +1,163 @@
+#pragma once
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include <openssl/ssl.h>
+#include "SamService.h"
+#include "SamConnection.h"
+
+namespace net = boost::asio;
+
+namespace SAM {
+
+struct TlsConfig {
+	// Server: PEM certificate chain and key. Both empty generates an ephemeral self-signed Ed25519 cert.
+	// When both are set and neither file exists yet, one is generated and written there (key mode 0600),
+	// so the certificate, and the pin clients hold, survives restarts.
+	std::string cert_file;
+	std::string key_file;
+	// Client: hex SHA-256 of the server certificate to require (the server's certificateSha256()).
+	// makeClient refuses an empty pin unless allow_unpinned is set: any certificate is then accepted,
+	// the I2P destination alone authenticates the peer and TLS only adds encryption above the bridge.
+	std::string pinned_sha256;
+	bool allow_unpinned = false;
+	uint32_t max_early_data = 16384;     // Server: 0-RTT bytes accepted per connection (0 disables 0-RTT)
+	std::size_t tickets_per_peer = 4;    // Client: resumption tickets kept per peer
+	std::size_t max_cached_peers = 1024; // Client: peers with tickets; the oldest peer is dropped beyond this
+};
+
+struct TlsStats {
+	uint64_t handshakes = 0;
+	uint64_t resumed = 0;               // Handshakes that resumed a cached session
+	uint64_t early_data_offered = 0;    // Client handshakes that sent 0-RTT data
+	uint64_t early_data_accepted = 0;
+	uint64_t failures = 0;
+	double full_handshake_ms_total = 0;    // Client: STREAM CONNECT to handshake complete, fresh sessions
+	double resumed_handshake_ms_total = 0; // Same for resumed sessions
+};
+
+// SSL_CTX for one side (client or server) plus, on the client side, the resumption ticket cache
+// keyed by peer address. Tickets are single use: a resumption takes one and the server sends fresh
+// ones after the handshake. Not thread-safe, like the rest of the library.
+class TlsContext {
+public:
+	static std::shared_ptr<TlsContext> makeClient(const TlsConfig& config, std::string& error_message);
+	static std::shared_ptr<TlsContext> makeServer(const TlsConfig& config, std::string& error_message);
+	~TlsContext();
+	TlsContext(const TlsContext&) = delete;
+	TlsContext& operator=(const TlsContext&) = delete;
+
+	SSL_CTX* native_handle() const { return ctx_; }
+	const TlsConfig& config() const { return config_; }
+	bool isServer() const { return server_; }
+	// Hex SHA-256 of this server's certificate, for clients to pin.
+	const std::string& certificateSha256() const { return cert_sha256_; }
+
+	// Client ticket cache. takeSession returns an owned reference (or nullptr) and removes it.
+	SSL_SESSION* takeSession(const std::string& peer);
+	void storeSession(const std::string& peer, SSL_SESSION* session); // Takes ownership
+	std::size_t cachedSessions(const std::string& peer) const;
+	void clearSessions();
+
+	TlsStats& stats() { return stats_; }
+	const TlsStats& stats() const { return stats_; }
+
+private:
+	TlsContext(SSL_CTX* ctx, TlsConfig config, bool server);
+
+	SSL_CTX* ctx_;
+	TlsConfig config_;
+	bool server_;
+	std::string cert_sha256_;
+	std::map<std::string, std::deque<SSL_SESSION*>> sessions_;
+	std::deque<std::string> peer_order_; // Insertion order of sessions_ keys, for eviction
+	TlsStats stats_;
+};
+
+class TlsChannel;
+
+struct TlsConnectResult {
+	bool success = false;
+	std::shared_ptr<TlsChannel> channel;
+	bool resumed = false;
+	// The early data went out with the ClientHello and the server accepted it. If it was rejected
+	// (or there was no ticket) it has been sent as ordinary data right after the handshake instead.
+	bool early_data_accepted = false;
+	double handshake_ms = 0; // STREAM CONNECT to handshake complete
+	std::string error_message;
+};
+
+struct TlsAcceptResult {
+	bool success = false;
+	std::shared_ptr<TlsChannel> channel;
+	// 0-RTT data that came with the client's first flight (the rest, if any, arrives through read()).
+	// It may be replayed by an attacker: treat it as an idempotent request.
+	std::string early_data;
+	std::string error_message;
+};
+
+// TLS 1.3 over a DATA_STREAM_MODE SamConnection, driven through memory BIOs so each handshake flight
+// leaves in one streamWrite. connect() sends the ClientHello (and 0-RTT data when a ticket for the
+// peer is cached) together with the STREAM CONNECT line, so a resumed request costs one tunnel round
+// trip instead of three. When the client's early data was accepted, accept() returns right after its
+// first flight so the server can answer before the client's Finished arrives; otherwise it returns
+// once the handshake has completed.
+// One read and one write may be outstanding at a time once the handshake has completed.
+class TlsChannel : public std::enable_shared_from_this<TlsChannel> {
+public:
+	// Only send idempotent requests as early_data: a 0-RTT flight can be replayed to the server.
+	static net::awaitable<TlsConnectResult> connect(
+		SamService& service,
+		const std::string& control_session_id,
+		const std::string& peer_b32,
+		std::shared_ptr<TlsContext> context,
+		net::const_buffer early_data = {},
+		SteadyClock::duration timeout = std::chrono::seconds(90));
+
+	static net::awaitable<TlsAcceptResult> accept(
+		std::shared_ptr<SamConnection> connection,
+		const std::string& peer_b32,
+		std::shared_ptr<TlsContext> context,
+		SteadyClock::duration timeout = std::chrono::seconds(90));
+
+	~TlsChannel();
+
+	// Throws boost::system::system_error: eof on close_notify or stream close, SSL errors otherwise.
+	net::awaitable<std::size_t> read(net::mutable_buffer buffer, SteadyClock::duration timeout = std::chrono::minutes(5));
+	net::awaitable<void> write(net::const_buffer buffer, SteadyClock::duration timeout = std::chrono::seconds(30));
+	// Sends close_notify and closes the stream. A client without a cached ticket for the peer first
+	// waits (up to 5 s) for the server's tickets.
+	net::awaitable<void> shutdown();
+
+	SamConnection& connection() { return *connection_; }
+	const std::string& peer() const { return peer_; }
+	bool resumed() const;
+
+private:
+	TlsChannel(std::shared_ptr<TlsContext> context, std::string peer, bool server);
+
+	net::awaitable<void> flush(SteadyClock::duration timeout);
+	net::awaitable<void> fill(SteadyClock::duration timeout);
+	net::awaitable<void> finishHandshake(SteadyClock::duration timeout);
+	std::string takeOutput(); // Bytes the SSL engine queued for the network
+	[[noreturn]] void throwSslError(int ret);
+
+	std::shared_ptr<TlsContext> context_;
+	std::shared_ptr<SamConnection> connection_;
+	std::string peer_;
+	bool server_;
+	SSL* ssl_ = nullptr;
+	BIO* network_in_ = nullptr;  // Bytes read from the stream, consumed by the SSL engine
+	BIO* network_out_ = nullptr; // Records produced by the SSL engine, written to the stream
+	bool flushing_ = false;
+	std::unique_ptr<AsyncCondition> flush_done_; // Wakes callers waiting for the flush in progress
+	bool early_write_ = false;   // Server: 0.5-RTT writes allowed before the handshake completes
+	bool early_reading_ = false; // Server: read() still draining early data
+	std::vector<char> read_buffer_;
+};
+
+} // namespace SAM
@@ -0,0 +1,78 @@
+#include "SamTrace.h"
+#include <mutex>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <algorithm>
+
+namespace SAM {
+namespace Trace {
+
+std::atomic<bool> g_enabled{true};
+
+namespace {
+
+std::mutex g_registry_mutex;
+// Rings outlive their threads so a dump after a worker exits still sees its history.
+std::vector<std::unique_ptr<Ring>>& registry() {
+	static std::vector<std::unique_ptr<Ring>> rings;
+	return rings;
+}
+
+} // namespace
+
+Ring& threadRing() {
+	thread_local Ring* ring = nullptr;
+	if (!ring) {
+		auto fresh = std::make_unique<Ring>();
+		std::lock_guard<std::mutex> lock(g_registry_mutex);
+		fresh->thread_index = static_cast<uint32_t>(registry().size());
+		ring = fresh.get();
+		registry().push_back(std::move(fresh));
+	}
+	return *ring;
+}
+
+bool dumpToFile(const std::string& path) {
+	std::vector<Event> snapshot;
+	{
+		std::lock_guard<std::mutex> lock(g_registry_mutex);
+		for (const auto& ring : registry()) {
+			uint64_t head = ring->head.load(std::memory_order_acquire);
+			uint64_t count = std::min<uint64_t>(head, kRingCapacity);
+			for (uint64_t i = head - count; i < head; ++i) {
+				snapshot.push_back(ring->events[i & (kRingCapacity - 1)]);
+			}
+		}
+	}
+	std::sort(snapshot.begin(), snapshot.end(),
+		[](const Event& a, const Event& b) { return a.timestamp_ns < b.timestamp_ns; });
+
+	std::ofstream out(path, std::ios::binary | std::ios::trunc);
+	if (!out) return false;
+	uint32_t event_size = sizeof(Event);
+	uint32_t event_count = static_cast<uint32_t>(snapshot.size());
+	out.write(kFileMagic, sizeof(kFileMagic));
+	out.write(reinterpret_cast<const char*>(&event_size), sizeof(event_size));
+	out.write(reinterpret_cast<const char*>(&event_count), sizeof(event_count));
+	out.write(reinterpret_cast<const char*>(snapshot.data()), static_cast<std::streamsize>(snapshot.size() * sizeof(Event)));
+	return static_cast<bool>(out);
+}
+
+const char* eventTypeName(uint16_t type) {
+	switch (static_cast<EventType>(type)) {
+	case EventType::STATE_CHANGE: return "state";
+	case EventType::COMMAND_SENT: return "command_sent";
+	case EventType::REPLY_RECEIVED: return "reply_received";
+	case EventType::BYTES_READ: return "bytes_read";
+	case EventType::BYTES_WRITTEN: return "bytes_written";
+	case EventType::TIMEOUT: return "timeout";
+	case EventType::CANCELLED: return "cancelled";
+	case EventType::PEER_EOF: return "eof";
+	case EventType::IO_ERROR: return "io_error";
+	}
+	return "unknown";
+}
+
+} // namespace Trace
+} // namespace SAM
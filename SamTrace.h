@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <atomic>
+#include <chrono>
+
+namespace SAM {
+namespace Trace {
+
+// Always-on binary event trace of connection lifecycles. Each thread appends fixed-size records to
+// its own ring (no locks, no formatting, no allocation on the hot path); older records are
+// overwritten. dumpToFile() snapshots every thread's ring; i2p_sam_trace_dump converts the file to
+// Chrome trace JSON (chrome://tracing, Perfetto).
+
+enum class EventType : uint16_t {
+	STATE_CHANGE = 1,   // arg = (old_state << 8) | new_state
+	COMMAND_SENT,       // arg = command length
+	REPLY_RECEIVED,     // arg = reply line length
+	BYTES_READ,         // arg = bytes
+	BYTES_WRITTEN,      // arg = bytes
+	TIMEOUT,            // arg = operation (see Op)
+	CANCELLED,          // arg = operation
+	PEER_EOF,
+	IO_ERROR,           // arg = error code value
+};
+
+enum class Op : uint64_t { CONNECT = 1, READ_LINE, STREAM_READ, STREAM_WRITE };
+
+struct Event {
+	uint64_t timestamp_ns; // steady_clock
+	uint64_t connection;   // SamConnection address
+	uint64_t arg;
+	uint16_t type;
+	uint16_t reserved;
+	uint32_t thread_index;
+};
+static_assert(sizeof(Event) == 32, "trace records are fixed-size");
+
+constexpr std::size_t kRingCapacity = 8192; // Events per thread (power of two)
+constexpr char kFileMagic[8] = {'S', 'A', 'M', 'T', 'R', 'C', '0', '1'};
+
+struct Ring {
+	Event events[kRingCapacity];
+	std::atomic<uint64_t> head{0};
+	uint32_t thread_index = 0;
+};
+
+Ring& threadRing(); // Registers the calling thread's ring on first use
+extern std::atomic<bool> g_enabled;
+
+inline void record(EventType type, const void* connection, uint64_t arg = 0) {
+	if (!g_enabled.load(std::memory_order_relaxed)) return;
+	Ring& ring = threadRing();
+	uint64_t index = ring.head.load(std::memory_order_relaxed);
+	Event& ev = ring.events[index & (kRingCapacity - 1)];
+	ev.timestamp_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count());
+	ev.connection = reinterpret_cast<uintptr_t>(connection);
+	ev.arg = arg;
+	ev.type = static_cast<uint16_t>(type);
+	ev.reserved = 0;
+	ev.thread_index = ring.thread_index;
+	ring.head.store(index + 1, std::memory_order_release);
+}
+
+inline void setEnabled(bool enabled) { g_enabled.store(enabled, std::memory_order_relaxed); }
+
+// Writes the current contents of all rings: magic(8) event_size(u32) event_count(u32) events[].
+// Records written concurrently with the dump may be torn; they are rare and harmless for diagnosis.
+bool dumpToFile(const std::string& path);
+
+const char* eventTypeName(uint16_t type);
+
+} // namespace Trace
+} // namespace SAM
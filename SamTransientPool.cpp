@@ -0,0 +1,149 @@
+#include "SamTransientPool.h"
+#include <boost/asio/experimental/awaitable_operators.hpp>
+#include <algorithm>
+#include <bit>
+
+namespace SAM {
+
+namespace {
+
+std::size_t log2Bucket(uint64_t value, std::size_t buckets) {
+	return std::min<std::size_t>(buckets - 1, std::bit_width(value));
+}
+
+} // namespace
+
+SamTransientPool::SamTransientPool(net::io_context& io_ctx, const SamBridgeEndpoint& bridge, TransientPoolConfig config)
+	: io_ctx_(io_ctx), bridge_(bridge), config_(std::move(config)),
+	  available_(io_ctx.get_executor()), backoff_timer_(io_ctx) {
+	config_.max_parallel_builds = std::max<std::size_t>(1, config_.max_parallel_builds);
+}
+
+SamTransientPool::~SamTransientPool() {
+	stop();
+}
+
+void SamTransientPool::start() {
+	running_ = true;
+	replenish();
+}
+
+void SamTransientPool::stop() {
+	running_ = false;
+	backoff_timer_.cancel();
+	for (auto& idle : ready_) {
+		if (idle.pooled->service) idle.pooled->service->shutdown();
+	}
+	ready_.clear();
+	available_.notifyAll();
+}
+
+void SamTransientPool::replenish() {
+	if (!running_ || backoff_pending_) return;
+	while (ready_.size() + building_ < config_.target_depth && building_ < config_.max_parallel_builds) {
+		building_++;
+		net::co_spawn(io_ctx_, buildOne(), net::detached);
+	}
+}
+
+net::awaitable<void> SamTransientPool::buildOne() {
+	auto self = shared_from_this();
+	auto pooled = std::make_shared<PooledTransientSession>();
+	pooled->service = std::make_shared<SamService>(io_ctx_, bridge_);
+	if (name_cache_) pooled->service->setNameCache(name_cache_);
+	const std::string nickname = config_.nickname_prefix + "_" + std::to_string(next_id_++);
+
+	auto started = SteadyClock::now();
+	try {
+		pooled->session = co_await pooled->service->establishControlSession(nickname, "TRANSIENT", "", config_.options);
+	} catch (const std::exception& e) {
+		pooled->session.success = false;
+		pooled->session.error_message = e.what();
+	}
+	auto build_ms = std::chrono::duration_cast<std::chrono::milliseconds>(SteadyClock::now() - started).count();
+	building_--;
+
+	if (!running_) {
+		pooled->service->shutdown();
+		co_return;
+	}
+	if (pooled->session.success) {
+		stats_.built++;
+		stats_.build_ms[log2Bucket(static_cast<uint64_t>(build_ms), TransientPoolStats::kBuckets)]++;
+		consecutive_failures_ = 0;
+		auto handed_out = std::make_shared<net::steady_timer>(io_ctx_, SteadyClock::time_point::max());
+		net::co_spawn(io_ctx_, watchIdle(weak_from_this(), pooled, handed_out), net::detached);
+		ready_.push_back(IdleSession{std::move(pooled), std::move(handed_out)});
+		available_.notifyAll();
+		SPDLOG_DEBUG("Transient pool: {} built in {} ms (depth {}).", nickname, build_ms, ready_.size());
+		replenish();
+		co_return;
+	}
+
+	stats_.failed++;
+	consecutive_failures_++;
+	SPDLOG_WARN("Transient pool: build of {} failed: {}", nickname, pooled->session.error_message);
+	// Back off before the next round so a down bridge is not hammered: 1s, 2s, 4s ... up to 60s.
+	if (!backoff_pending_) {
+		backoff_pending_ = true;
+		auto delay = std::chrono::seconds(std::min<std::size_t>(60, std::size_t{1} << std::min<std::size_t>(consecutive_failures_ - 1, 6)));
+		backoff_timer_.expires_after(delay);
+		boost::system::error_code ec;
+		co_await backoff_timer_.async_wait(net::redirect_error(net::use_awaitable, ec));
+		backoff_pending_ = false;
+		replenish();
+	}
+}
+
+net::awaitable<std::shared_ptr<PooledTransientSession>> SamTransientPool::acquire(SteadyClock::duration timeout) {
+	auto self = shared_from_this();
+	stats_.depth_at_acquire[log2Bucket(ready_.size(), TransientPoolStats::kBuckets)]++;
+	const auto deadline = SteadyClock::now() + timeout;
+	bool waited = false;
+
+	while (running_) {
+		while (!ready_.empty()) {
+			IdleSession idle = std::move(ready_.front());
+			ready_.pop_front();
+			// Expiring (rather than cancelling) also ends a watcher that has not started waiting yet.
+			idle.handed_out->expires_at(SteadyClock::time_point::min());
+			auto pooled = std::move(idle.pooled);
+			if (!pooled->service->isOpen()) { // Closed since the watcher last ran
+				stats_.discarded++;
+				continue;
+			}
+			stats_.handed_out++;
+			replenish();
+			co_return pooled;
+		}
+		replenish();
+		if (!waited) {
+			waited = true;
+			stats_.acquire_waited++;
+		}
+		if (!co_await available_.waitUntil(deadline)) break;
+	}
+	if (running_) stats_.acquire_timeouts++;
+	co_return nullptr;
+}
+
+net::awaitable<void> SamTransientPool::watchIdle(std::weak_ptr<SamTransientPool> weak_self,
+	std::shared_ptr<PooledTransientSession> pooled, std::shared_ptr<net::steady_timer> handed_out) {
+	using namespace net::experimental::awaitable_operators;
+	boost::system::error_code ec;
+	auto outcome = co_await (
+		pooled->service->watchControlConnection() ||
+		handed_out->async_wait(net::redirect_error(net::use_awaitable, ec)));
+	if (outcome.index() == 1) co_return; // Handed out: the caller owns it now
+	auto self = weak_self.lock();
+	if (!self || !running_) co_return;
+	auto it = std::find_if(ready_.begin(), ready_.end(), [&](const IdleSession& idle) { return idle.pooled == pooled; });
+	if (it == ready_.end()) co_return;
+	ready_.erase(it);
+	stats_.discarded++;
+	SPDLOG_WARN("Transient pool: idle session {} lost its control connection (depth {}).",
+		pooled->session.created_session_id, ready_.size());
+	replenish();
+}
+
+} // namespace SAM
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <array>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <boost/asio.hpp>
+#include "SamService.h"
+#include "SamAsyncUtils.h"
+
+namespace net = boost::asio;
+
+namespace SAM {
+
+struct TransientPoolConfig {
+	std::size_t target_depth = 4;        // Sessions kept built and idle
+	std::size_t max_parallel_builds = 2; // Concurrent SESSION CREATEs while replenishing
+	std::string nickname_prefix = "transient";
+	std::map<std::string, std::string> options = {
+		{"i2p.streaming.profile", "INTERACTIVE"}, 
+		{"inbound.length", "1"}, 
+		{"outbound.length", "1"}};
+};
+
+// A fresh TRANSIENT destination handed out by the pool. Dropping the last reference closes its
+// control connection, which destroys the destination on the bridge.
+struct PooledTransientSession {
+	std::shared_ptr<SamService> service;
+	EstablishSessionResult session;      // created_session_id, local_b32_address, ...
+};
+
+struct TransientPoolStats {
+	static constexpr std::size_t kBuckets = 24;
+	std::array<uint64_t, kBuckets> build_ms{};       // log2 histogram of SESSION CREATE time (ms)
+	std::array<uint64_t, kBuckets> depth_at_acquire{}; // Idle sessions left when acquire() was called
+	uint64_t built = 0;
+	uint64_t failed = 0;
+	uint64_t handed_out = 0;
+	uint64_t acquire_waited = 0;  // acquire() calls that found the pool empty
+	uint64_t acquire_timeouts = 0;
+	uint64_t discarded = 0;       // Idle sessions whose control connection the bridge closed
+};
+
+// Keeps target_depth TRANSIENT sessions built in the background, each with its own control connection,
+// so a job needing a new identity gets one without waiting for a tunnel build. acquire() hands one out
+// and triggers replenishment with at most max_parallel_builds builds in flight; failed builds back off.
+// Not thread-safe: use from a single-threaded io_context (as the examples do) or from one strand.
+class SamTransientPool : public std::enable_shared_from_this<SamTransientPool> {
+public:
+	SamTransientPool(net::io_context& io_ctx, const SamBridgeEndpoint& bridge, TransientPoolConfig config = {});
+	~SamTransientPool();
+
+	void start();
+	void stop(); // Stops replenishing and destroys idle sessions
+
+	// Returns an idle session, waiting up to timeout for a build if the pool is empty;
+	// nullptr on timeout or when the pool is stopped.
+	net::awaitable<std::shared_ptr<PooledTransientSession>> acquire(
+		SteadyClock::duration timeout = std::chrono::minutes(3));
+
+	std::size_t depth() const { return ready_.size(); }
+	std::size_t building() const { return building_; }
+	const TransientPoolStats& stats() const { return stats_; }
+	// Name cache handed to every pooled service (optional).
+	void setNameCache(std::shared_ptr<SamNameCache> cache) { name_cache_ = std::move(cache); }
+
+private:
+	// An idle session and the timer that tells its watcher it was handed out.
+	struct IdleSession {
+		std::shared_ptr<PooledTransientSession> pooled;
+		std::shared_ptr<net::steady_timer> handed_out;
+	};
+
+	void replenish();
+	net::awaitable<void> buildOne();
+	// Drops the idle session once the bridge closes its control connection; ends when it is handed out.
+	// Holds the pool weakly: idle sessions must not keep it alive, its destructor shuts them down.
+	net::awaitable<void> watchIdle(std::weak_ptr<SamTransientPool> weak_self, std::shared_ptr<PooledTransientSession> pooled,
+		std::shared_ptr<net::steady_timer> handed_out);
+
+	net::io_context& io_ctx_;
+	SamBridgeEndpoint bridge_;
+	TransientPoolConfig config_;
+	std::shared_ptr<SamNameCache> name_cache_;
+	std::deque<IdleSession> ready_;
+	std::size_t building_ = 0;
+	std::size_t consecutive_failures_ = 0;
+	uint64_t next_id_ = 0;
+	bool running_ = false;
+	AsyncCondition available_;
+	net::steady_timer backoff_timer_;
+	bool backoff_pending_ = false;
+	TransientPoolStats stats_;
+};
+
+} // namespace SAM
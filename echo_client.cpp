@@ -1,13 +1,23 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <sstream>
 #include <algorithm>
+#include <cstdlib>
 #include <boost/asio.hpp>
 #include <boost/asio/signal_set.hpp> 
 #include "SamService.h"       // Our new service class
+#include "EmbeddedRouter.h"    // Optional in-process router (SAM_BRIDGE=embedded)
 #include "SamConnection.h"    // For std::shared_ptr<SamConnection> type
+#include "SamTrace.h"
+#include "SamCapture.h"
+#include "SamTls.h"
 #include "SamMessageParser.h" // For enums (though not strictly needed in main)
 #include <spdlog/spdlog.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
 
 net::io_context client_io_ctx; // Renamed global io_context
 std::atomic<bool> client_running(true);  // Renamed global running flag
@@ -27,11 +37,13 @@ void app_server_signal_handler(const boost::system::error_code& error, int signa
 
 // Main server coroutine
 net::awaitable<void> echo_client_application_logic(
-	const std::string& sam_host, uint16_t sam_port,
+	const SAM::SamBridgeEndpoint& sam_bridge,
 	const std::string& client_nickname, const std::string& client_private_key, const std::string& client_sig_type,
 	const std::string& target_peer_i2p_address_b32
 ) {
-	g_app_sam_service = std::make_shared<SAM::SamService>(client_io_ctx, sam_host, sam_port);
+	g_app_sam_service = std::make_shared<SAM::SamService>(client_io_ctx, sam_bridge);
+	const char* name_cache_file = std::getenv("SAM_NAME_CACHE_FILE"); // Lookup snapshot kept across runs
+	if (name_cache_file) g_app_sam_service->nameCache().loadSnapshot(name_cache_file);
 	auto active_streams_count = std::make_shared<std::atomic<int>>(0);
 	SAM::EstablishSessionResult control_session_info;
 	SAM::SetupStreamResult connect_res;
@@ -46,6 +58,16 @@ net::awaitable<void> echo_client_application_logic(
 			co_return; 
 		}
 		SPDLOG_INFO("Client control session '{}' established. Local I2P Address: {}", control_session_info.created_session_id, control_session_info.local_b32_address);
+		if (const char* spare_env = std::getenv("SAM_SPARE_CONNECTIONS")) { // Bridge connections kept past HELLO
+			g_app_sam_service->keepSpareConnections(std::stoul(spare_env));
+		}
+
+		if (!target_peer_i2p_address_b32.ends_with(".b32.i2p")) { // Hostname: resolve once, then served from the cache
+			SAM::NamingLookupResult lookup = co_await g_app_sam_service->lookupName(target_peer_i2p_address_b32);
+			SPDLOG_INFO("Lookup of {}: {}{}", target_peer_i2p_address_b32, lookup.success ? "OK" : lookup.error_message,
+				lookup.from_cache ? " (cached)" : "");
+			if (lookup.success && name_cache_file) g_app_sam_service->nameCache().saveSnapshot(name_cache_file);
+		}
 
 		try {
 			connect_res = co_await g_app_sam_service->connectToPeerViaNewConnection(
@@ -81,14 +103,127 @@ net::awaitable<void> echo_client_application_logic(
 			}
 			if (line.empty()) continue;
 			
-			if (line.substr(0, 4) == "big ") 
+			if (line.substr(0, 4) == "big ") // N KiB of 'A', produced chunk by chunk instead of held in memory
 			{
-				int size = std::stoi(line.substr(4));
-				line = std::string(size * 1024, 'A');
+				std::size_t remaining = std::stoull(line.substr(4)) * 1024;
+				std::size_t sent = co_await connect_res.data_connection->streamWriteFrom(
+					[&remaining](net::mutable_buffer chunk) -> net::awaitable<std::size_t> {
+						std::size_t n = std::min(remaining, chunk.size());
+						std::fill_n(static_cast<char*>(chunk.data()), n, 'A');
+						remaining -= n;
+						co_return n;
+					});
+				SPDLOG_INFO("Sent {} bytes", sent);
+			}
+			else if (line.substr(0, 7) == "fanout ") // N parallel streams to the target in one round (16 in flight, 60 s deadline)
+			{
+				std::vector<std::string> destinations(std::stoull(line.substr(7)), target_peer_i2p_address_b32);
+				SAM::FanOutConfig fan_out_cfg;
+				fan_out_cfg.deadline = std::chrono::seconds(60);
+				co_await g_app_sam_service->connectToPeers(control_session_info.created_session_id, destinations,
+					[](std::size_t, SAM::SetupStreamResult result) {
+						if (result.data_connection && result.data_connection->isOpen()) result.data_connection->closeSocket();
+					},
+					fan_out_cfg);
+				continue;
+			}
+			else if (line.substr(0, 5) == "warm ") // Destinations not contacted yet: every other one is warmed up first; first-connect latency warm vs cold
+			{
+				std::istringstream names(line.substr(5));
+				std::vector<std::string> cold, warm;
+				for (std::string name; names >> name;) (cold.size() > warm.size() ? warm : cold).push_back(name);
+				co_await g_app_sam_service->warmUpPeers(control_session_info.created_session_id, warm);
+				double connect_ms_total[2] = {0, 0};
+				int connect_count[2] = {0, 0};
+				for (int is_warm = 0; is_warm < 2; ++is_warm) {
+					for (const std::string& destination : is_warm ? warm : cold) {
+						auto started = std::chrono::steady_clock::now();
+						SAM::SetupStreamResult probe = co_await g_app_sam_service->connectToPeerViaNewConnection(
+							control_session_info.created_session_id, destination);
+						if (!probe.success) continue;
+						connect_ms_total[is_warm] += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+						++connect_count[is_warm];
+						probe.data_connection->closeSocket();
+					}
+				}
+				SPDLOG_INFO("First connect: cold {:.1f} ms avg over {}, warmed up {:.1f} ms avg over {}",
+					connect_count[0] ? connect_ms_total[0] / connect_count[0] : 0.0, connect_count[0],
+					connect_count[1] ? connect_ms_total[1] / connect_count[1] : 0.0, connect_count[1]);
+				continue;
+			}
+			else if (line.substr(0, 4) == "tls ") // N TLS connections (server run with SAM_TLS=1); time to first byte, fresh vs resumed
+			{
+				static std::shared_ptr<SAM::TlsContext> tls_context;
+				if (!tls_context) {
+					SAM::TlsConfig tls_cfg;
+					// SAM_TLS_PIN: the fingerprint the server logs at startup; "any" skips certificate pinning
+					if (const char* pin_env = std::getenv("SAM_TLS_PIN")) {
+						if (std::string(pin_env) == "any") tls_cfg.allow_unpinned = true;
+						else tls_cfg.pinned_sha256 = pin_env;
+					}
+					std::string tls_error;
+					tls_context = SAM::TlsContext::makeClient(tls_cfg, tls_error);
+					if (!tls_context) {
+						SPDLOG_ERROR("TLS setup failed: {}", tls_error);
+						continue;
+					}
+				}
+				const std::string request = "ping\n"; // Idempotent, so it may go out as 0-RTT data
+				double ttfb_ms_total[2] = {0, 0};
+				int ttfb_count[2] = {0, 0};
+				for (std::size_t i = 0, n = std::stoull(line.substr(4)); i < n && client_running; ++i) {
+					auto started = std::chrono::steady_clock::now();
+					SAM::TlsConnectResult tls_res = co_await SAM::TlsChannel::connect(*g_app_sam_service,
+						control_session_info.created_session_id, target_peer_i2p_address_b32, tls_context, boost::asio::buffer(request));
+					if (!tls_res.success) {
+						SPDLOG_ERROR("TLS connect failed: {}", tls_res.error_message);
+						continue;
+					}
+					try {
+						bytes_read = co_await tls_res.channel->read(boost::asio::buffer(data_buffer), std::chrono::minutes(2));
+					} catch (const boost::system::system_error& e) {
+						SPDLOG_ERROR("TLS read failed: {}", e.code().message());
+						continue;
+					}
+					double ttfb_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+					ttfb_ms_total[tls_res.resumed] += ttfb_ms;
+					++ttfb_count[tls_res.resumed];
+					SPDLOG_INFO("TLS #{}: first byte after {:.1f} ms ({}{})", i + 1, ttfb_ms, tls_res.resumed ? "resumed" : "fresh",
+						tls_res.early_data_accepted ? ", 0-RTT" : "");
+					co_await tls_res.channel->shutdown();
+				}
+				SPDLOG_INFO("TLS time to first byte: fresh {:.1f} ms avg over {}, resumed {:.1f} ms avg over {}",
+					ttfb_count[0] ? ttfb_ms_total[0] / ttfb_count[0] : 0.0, ttfb_count[0],
+					ttfb_count[1] ? ttfb_ms_total[1] / ttfb_count[1] : 0.0, ttfb_count[1]);
+				continue;
+			}
+			else if (line.substr(0, 5) == "file ") // Zero-copy send of a file; logs throughput and CPU time
+			{
+				int fd = ::open(line.substr(5).c_str(), O_RDONLY | O_CLOEXEC);
+				struct stat st{};
+				if (fd < 0 || ::fstat(fd, &st) != 0) {
+					SPDLOG_ERROR("Cannot open {}", line.substr(5));
+					if (fd >= 0) ::close(fd);
+					continue;
+				}
+				rusage usage_before{}, usage_after{};
+				::getrusage(RUSAGE_SELF, &usage_before);
+				auto started = std::chrono::steady_clock::now();
+				std::size_t sent = co_await connect_res.data_connection->streamSendFile(fd, 0, static_cast<uint64_t>(st.st_size));
+				double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+				::getrusage(RUSAGE_SELF, &usage_after);
+				::close(fd);
+				auto cpu_us = [](const rusage& u) {
+					return (u.ru_utime.tv_sec + u.ru_stime.tv_sec) * 1000000LL + u.ru_utime.tv_usec + u.ru_stime.tv_usec;
+				};
+				SPDLOG_INFO("Sent {} bytes in {:.3f} s ({:.2f} MB/s, {} ms CPU)", sent, seconds,
+					seconds > 0 ? sent / seconds / (1024 * 1024) : 0.0, (cpu_us(usage_after) - cpu_us(usage_before)) / 1000);
+			}
+			else
+			{
+				// Send line to peer
+				co_await connect_res.data_connection->streamWrite(boost::asio::buffer(line));
 			}
-			
-			// Send line to peer
-			co_await connect_res.data_connection->streamWrite(boost::asio::buffer(line));
 			//std::cout << "[AppLogic] Sent to peer: " << line << std::endl;
 			
 			try {
@@ -132,7 +267,28 @@ net::awaitable<void> echo_client_application_logic(
 
 int main(int argc, char* argv[]) {
 	std::string SAM_HOST_CFG = "localhost";//"gate.peerpoker.site"; 
-	uint16_t SAM_PORT_CFG = 7656;      
+	uint16_t SAM_PORT_CFG = 7656;
+	// SAM_BRIDGE overrides the default bridge, e.g. "127.0.0.1:7656" or "unix:/run/i2pd/sam.sock"
+	SAM::SamBridgeEndpoint SAM_BRIDGE_CFG = SAM::SamBridgeEndpoint::tcp(SAM_HOST_CFG, SAM_PORT_CFG);
+	if (const char* bridge_env = std::getenv("SAM_BRIDGE")) {
+		std::string bridge_error;
+		if (!SAM::SamBridgeEndpoint::parse(bridge_env, SAM_PORT_CFG, SAM_BRIDGE_CFG, bridge_error)) {
+			SPDLOG_ERROR("Invalid SAM_BRIDGE: {}", bridge_error);
+			return 1;
+		}
+	}
+	if (const char* capture_file = std::getenv("SAM_CAPTURE_FILE")) { // Traffic capture for i2p_sam_replay
+		if (!SAM::Capture::start(capture_file)) SPDLOG_WARN("Cannot write capture file {}", capture_file);
+	}
+	if (SAM_BRIDGE_CFG.embedded) { // SAM_BRIDGE=embedded: run the router in this process
+		SAM::EmbeddedRouterConfig router_cfg;
+		if (const char* datadir_env = std::getenv("I2PD_DATADIR")) router_cfg.data_dir = datadir_env;
+		std::string router_error;
+		if (!SAM::EmbeddedRouter::start(router_cfg, router_error)) {
+			SPDLOG_ERROR("Failed to start embedded router: {}", router_error);
+			return 1;
+		}
+	}      
 	std::string CLIENT_NICKNAME_CFG = "I2PECHO"; 
 	std::string CLIENT_KEY_B64_CFG = "YOUR_BASE64_ENCODED_PRIVATE_KEY_STRING_HERE"; 
 	std::string CLIENT_SIG_TYPE_CFG = "EdDSA_SHA512_Ed25519";
@@ -180,9 +336,10 @@ int main(int argc, char* argv[]) {
 		net::signal_set signals(client_io_ctx, SIGINT, SIGTERM);
 		signals.async_wait(&app_server_signal_handler);
 
+		SPDLOG_INFO("Socket I/O backend: {}", SAM::SamConnection::ioBackendName());
 		SPDLOG_INFO("Spawning main echo client application logic coroutine.");
 		net::co_spawn(client_io_ctx, 
-			echo_client_application_logic(SAM_HOST_CFG, SAM_PORT_CFG, 
+			echo_client_application_logic(SAM_BRIDGE_CFG, 
 										  CLIENT_NICKNAME_CFG, CLIENT_KEY_B64_CFG, CLIENT_SIG_TYPE_CFG,
 										  TARGET_PEER_I2P_ADDRESS_B32_CFG),
 			[](std::exception_ptr p) {
@@ -209,6 +366,11 @@ int main(int argc, char* argv[]) {
 	}
 	
 	g_app_sam_service = nullptr; 
+	SAM::EmbeddedRouter::stop();
+	SAM::Capture::stop();
+	if (const char* trace_file = std::getenv("SAM_TRACE_FILE")) { // Binary lifecycle trace for i2p_sam_trace_dump
+		SAM::Trace::dumpToFile(trace_file);
+	}
 	SPDLOG_INFO("Program exiting.");
 	return 0;
 }
\ No newline at end of file
@@ -2,16 +2,22 @@
 #include <fstream>
 #include <string>
 #include <algorithm>
+#include <cstdlib>
 #include <boost/asio.hpp>
 #include <boost/asio/signal_set.hpp>
 #include "SamService.h"		  // Our new service class
+#include "EmbeddedRouter.h"	  // Optional in-process router (SAM_BRIDGE=embedded)
 #include "SamConnection.h"	  // For std::shared_ptr<SamConnection> type
+#include "SamTrace.h"
+#include "SamCapture.h"
+#include "SamTls.h"
 #include "SamMessageParser.h" // For enums (though not strictly needed in main)
 #include <spdlog/spdlog.h>
 
 net::io_context server_io_ctx_main;						 // Renamed global io_context
 volatile bool server_main_running = true;				 // Renamed global running flag
 std::shared_ptr<SAM::SamService> g_app_sam_service = nullptr; // Global for signal handler
+std::shared_ptr<SAM::TlsContext> g_tls_context;		 // SAM_TLS=1: every stream is TLS 1.3
 
 void app_server_signal_handler(const boost::system::error_code &error, int signal_number)
 {
@@ -98,21 +104,113 @@ net::awaitable<void> process_echo_stream_with_connection(
 	co_return;
 }
 
+// TLS variant of the echo loop. Early data is echoed right away, before the client's Finished arrives.
+net::awaitable<void> process_tls_echo_stream(
+	std::shared_ptr<SAM::SamConnection> data_conn_sptr,
+	std::string remote_peer_addr)
+{
+	SAM::TlsAcceptResult accepted = co_await SAM::TlsChannel::accept(data_conn_sptr, remote_peer_addr, g_tls_context);
+	if (!accepted.success)
+		co_return;
+	SAM::TlsChannel &channel = *accepted.channel;
+	SPDLOG_INFO("TLS stream with {} ({}, {} bytes early data)", remote_peer_addr,
+				channel.resumed() ? "resumed" : "full handshake", accepted.early_data.size());
+	try
+	{
+		if (!accepted.early_data.empty())
+			co_await channel.write(boost::asio::buffer(accepted.early_data));
+		std::array<char, 8192> data_buffer;
+		while (server_main_running)
+		{
+			std::size_t bytes_read = co_await channel.read(boost::asio::buffer(data_buffer), std::chrono::minutes(10));
+			SPDLOG_INFO("Rcvd {} bytes", bytes_read);
+			co_await channel.write(boost::asio::buffer(data_buffer.data(), bytes_read));
+		}
+	}
+	catch (const boost::system::system_error &e)
+	{
+		if (e.code() != boost::asio::error::eof)
+			SPDLOG_INFO("TLS stream with {} ended: {}", remote_peer_addr, e.code().message());
+	}
+	co_await channel.shutdown();
+}
+
+// One acceptor worker; parked is a STREAM ACCEPT connection inherited through a handoff (or null).
+net::awaitable<void> accept_worker(std::shared_ptr<SAM::SamService> sam_svc_cap, std::shared_ptr<SAM::SamConnection> parked,
+	std::string main_sid, std::shared_ptr<std::atomic<int>> active_c)
+{
+	// std::cout << "[AcceptorSM] Worker started for main session '" << main_sid << "'." << std::endl;
+	SAM::SetupStreamResult accept_res;
+	try
+	{
+		if (parked)
+			accept_res = co_await sam_svc_cap->resumeAccept(parked);
+		else
+			accept_res = co_await sam_svc_cap->acceptStreamViaNewConnection(main_sid);
+	}
+	catch (const std::exception &e_accept_worker)
+	{
+		SPDLOG_ERROR("Worker exception during accept: {}", e_accept_worker.what());
+		accept_res.success = false;
+	}
+
+	if (!server_main_running)
+	{ /* Worker sees shutdown */
+	}
+	else if (accept_res.success && accept_res.data_connection)
+	{
+		SPDLOG_INFO("Accepted I2P stream from: {}", accept_res.remote_peer_b32_address);
+		try
+		{
+			if (g_tls_context)
+				co_await process_tls_echo_stream(accept_res.data_connection, accept_res.remote_peer_b32_address);
+			else
+				co_await process_echo_stream_with_connection(accept_res.data_connection, accept_res.remote_peer_b32_address);
+		}
+		catch (const std::exception &e_echo_worker)
+		{
+			SPDLOG_ERROR("Worker exception during echo processing for {}: {}", accept_res.remote_peer_b32_address, e_echo_worker.what());
+			if (accept_res.data_connection && accept_res.data_connection->isOpen())
+			{
+				accept_res.data_connection->closeSocket(); // Ensure data conn closed on echo error
+			}
+		}
+	}
+	else
+	{
+		SPDLOG_ERROR("Worker failed to accept stream: {}", accept_res.error_message);
+		// data_connection in accept_res should be null or closed by acceptStreamViaNewConnection on failure
+	}
+	active_c->fetch_sub(1);
+	// std::cout << "[AcceptorSM] Worker finished for main session '" << main_sid << "'." << std::endl;
+	co_return;
+}
+
 // Main server coroutine
 net::awaitable<void> echo_server_application_logic(
-	const std::string &sam_host, uint16_t sam_port,
+	const SAM::SamBridgeEndpoint &sam_bridge,
 	const std::string &server_nickname, const std::string &server_private_key, const std::string &server_sig_type,
 	int max_concurrent_streams = 5)
 {
-	g_app_sam_service = std::make_shared<SAM::SamService>(server_io_ctx_main, sam_host, sam_port);
+	g_app_sam_service = std::make_shared<SAM::SamService>(server_io_ctx_main, sam_bridge);
 	auto active_streams_count = std::make_shared<std::atomic<int>>(0);
 	SAM::EstablishSessionResult control_session_info;
 
 	//std::map<std::string, std::string> options = {{"i2p.streaming.profile", "INTERACTIVE"}, {"inbound.length", "2"}, {"outbound.length", "2"}};
 	try
 	{
-		control_session_info = co_await g_app_sam_service->establishControlSession(
-			server_nickname, server_private_key, server_sig_type);
+		// SAM_HANDOFF_PATH: take over the session of a running instance if one is listening there,
+		// and offer it to the next instance in turn (restart without rebuilding tunnels).
+		const char *handoff_path = std::getenv("SAM_HANDOFF_PATH");
+		if (handoff_path)
+		{
+			control_session_info = g_app_sam_service->resumeFromHandoff(handoff_path);
+			if (!control_session_info.success)
+				SPDLOG_INFO("No session handed off ({}), creating a new one.", control_session_info.error_message);
+		}
+		if (!control_session_info.success)
+			control_session_info = co_await g_app_sam_service->establishControlSession(
+				server_nickname, server_private_key, server_sig_type);
 		if (!control_session_info.success)
 		{
 			SPDLOG_ERROR("Failed to establish server's control SAM session: {}", control_session_info.error_message);
@@ -120,6 +218,23 @@ net::awaitable<void> echo_server_application_logic(
 		}
 		SPDLOG_INFO("Server control session '{}' established. Local I2P Address: {}", control_session_info.created_session_id, control_session_info.local_b32_address);
 		SPDLOG_INFO("Ready to spawn stream acceptor workers (max {}).", max_concurrent_streams);
+		for (auto &parked : g_app_sam_service->takeHandedOffAccepts())
+		{
+			active_streams_count->fetch_add(1);
+			net::co_spawn(server_io_ctx_main,
+				accept_worker(g_app_sam_service, parked, control_session_info.created_session_id, active_streams_count),
+				boost::asio::detached);
+		}
+		if (handoff_path)
+		{
+			net::co_spawn(server_io_ctx_main,
+				[svc = g_app_sam_service, path = std::string(handoff_path)]() -> net::awaitable<void>
+				{
+					if (co_await svc->serveHandoff(path))
+						server_main_running = false; // Session lives on in the new process
+				},
+				boost::asio::detached);
+		}
 
 		while (server_main_running)
 		{
@@ -136,50 +251,7 @@ net::awaitable<void> echo_server_application_logic(
 				active_streams_count->fetch_add(1);
 				net::co_spawn(
 					server_io_ctx_main,
-					[sam_svc_cap = g_app_sam_service, // Capture SamService
-					 main_sid = control_session_info.created_session_id,
-					 active_c = active_streams_count]() -> net::awaitable<void>
-					{
-						// std::cout << "[AcceptorSM] Worker started for main session '" << main_sid << "'." << std::endl;
-						SAM::SetupStreamResult accept_res;
-						try
-						{
-							accept_res = co_await sam_svc_cap->acceptStreamViaNewConnection(main_sid);
-						}
-						catch (const std::exception &e_accept_worker)
-						{
-							SPDLOG_ERROR("Worker exception during accept: {}", e_accept_worker.what());
-							accept_res.success = false;
-						}
-
-						if (!server_main_running)
-						{ /* Worker sees shutdown */
-						}
-						else if (accept_res.success && accept_res.data_connection)
-						{
-							SPDLOG_INFO("Accepted I2P stream from: {}", accept_res.remote_peer_b32_address);
-							try
-							{
-								co_await process_echo_stream_with_connection(accept_res.data_connection, accept_res.remote_peer_b32_address);
-							}
-							catch (const std::exception &e_echo_worker)
-							{
-								SPDLOG_ERROR("Worker exception during echo processing for {}: {}", accept_res.remote_peer_b32_address, e_echo_worker.what());
-								if (accept_res.data_connection && accept_res.data_connection->isOpen())
-								{
-									accept_res.data_connection->closeSocket(); // Ensure data conn closed on echo error
-								}
-							}
-						}
-						else
-						{
-							SPDLOG_ERROR("Worker failed to accept stream: {}", accept_res.error_message);
-							// data_connection in accept_res should be null or closed by acceptStreamViaNewConnection on failure
-						}
-						active_c->fetch_sub(1);
-						// std::cout << "[AcceptorSM] Worker finished for main session '" << main_sid << "'." << std::endl;
-						co_return;
-					},
+					accept_worker(g_app_sam_service, nullptr, control_session_info.created_session_id, active_streams_count),
 					boost::asio::detached);
 			}
 			else
@@ -217,6 +289,27 @@ int main(int argc, char *argv[])
 {
 	std::string SAM_HOST_CFG = "localhost";//"peerpoker.site";
 	uint16_t SAM_PORT_CFG = 7656;
+	// SAM_BRIDGE overrides the default bridge, e.g. "127.0.0.1:7656" or "unix:/run/i2pd/sam.sock"
+	SAM::SamBridgeEndpoint SAM_BRIDGE_CFG = SAM::SamBridgeEndpoint::tcp(SAM_HOST_CFG, SAM_PORT_CFG);
+	if (const char* bridge_env = std::getenv("SAM_BRIDGE")) {
+		std::string bridge_error;
+		if (!SAM::SamBridgeEndpoint::parse(bridge_env, SAM_PORT_CFG, SAM_BRIDGE_CFG, bridge_error)) {
+			SPDLOG_ERROR("Invalid SAM_BRIDGE: {}", bridge_error);
+			return 1;
+		}
+	}
+	if (const char* capture_file = std::getenv("SAM_CAPTURE_FILE")) { // Traffic capture for i2p_sam_replay
+		if (!SAM::Capture::start(capture_file)) SPDLOG_WARN("Cannot write capture file {}", capture_file);
+	}
+	if (SAM_BRIDGE_CFG.embedded) { // SAM_BRIDGE=embedded: run the router in this process
+		SAM::EmbeddedRouterConfig router_cfg;
+		if (const char* datadir_env = std::getenv("I2PD_DATADIR")) router_cfg.data_dir = datadir_env;
+		std::string router_error;
+		if (!SAM::EmbeddedRouter::start(router_cfg, router_error)) {
+			SPDLOG_ERROR("Failed to start embedded router: {}", router_error);
+			return 1;
+		}
+	}
 	std::string SERVER_NICKNAME_CFG = "I2PECHO";
 	std::string SERVER_KEY_B64_CFG = "YOUR_BASE64_ENCODED_PRIVATE_KEY_STRING_HERE";
 	std::string SERVER_SIG_TYPE_CFG = "EdDSA_SHA512_Ed25519";
@@ -259,14 +352,32 @@ int main(int argc, char *argv[])
 
 	SERVER_NICKNAME_CFG = SERVER_NICKNAME_CFG + "_" + I2PIdentityUtils::genRandomName();
 
+	// SAM_TLS=1 serves TLS 1.3 (SAM_TLS_CERT / SAM_TLS_KEY, generated there on first start if both are
+	// missing; otherwise an ephemeral self-signed cert)
+	if (const char *tls_env = std::getenv("SAM_TLS"); tls_env && std::string(tls_env) == "1")
+	{
+		SAM::TlsConfig tls_cfg;
+		if (const char *cert_env = std::getenv("SAM_TLS_CERT")) tls_cfg.cert_file = cert_env;
+		if (const char *key_env = std::getenv("SAM_TLS_KEY")) tls_cfg.key_file = key_env;
+		std::string tls_error;
+		g_tls_context = SAM::TlsContext::makeServer(tls_cfg, tls_error);
+		if (!g_tls_context)
+		{
+			SPDLOG_ERROR("TLS setup failed: {}", tls_error);
+			return 1;
+		}
+		SPDLOG_INFO("TLS enabled, certificate SHA-256 {}", g_tls_context->certificateSha256());
+	}
+
 	try
 	{
 		net::signal_set signals(server_io_ctx_main, SIGINT, SIGTERM);
 		signals.async_wait(&app_server_signal_handler);
 
+		SPDLOG_INFO("Socket I/O backend: {}", SAM::SamConnection::ioBackendName());
 		SPDLOG_INFO("Spawning main echo server application logic coroutine.");
 		net::co_spawn(server_io_ctx_main,
-					  echo_server_application_logic(SAM_HOST_CFG, SAM_PORT_CFG,
+					  echo_server_application_logic(SAM_BRIDGE_CFG,
 													SERVER_NICKNAME_CFG, SERVER_KEY_B64_CFG, SERVER_SIG_TYPE_CFG,
 													MAX_CLIENTS_CFG),
 					  [](std::exception_ptr p)
@@ -303,6 +414,11 @@ int main(int argc, char *argv[])
 	}
 
 	g_app_sam_service = nullptr;
+	SAM::EmbeddedRouter::stop();
+	SAM::Capture::stop();
+	if (const char* trace_file = std::getenv("SAM_TRACE_FILE")) { // Binary lifecycle trace for i2p_sam_trace_dump
+		SAM::Trace::dumpToFile(trace_file);
+	}
 	SPDLOG_INFO("Program exiting.");
 	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,221 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/beast/core/flat_buffer.hpp>
+#include <boost/beast/http.hpp>
+#include "SamService.h"
+#include "EmbeddedRouter.h"    // Optional in-process router (SAM_BRIDGE=embedded)
+#include "SamConnection.h"
+#include "SamStream.h"
+#include "SamAsyncUtils.h"
+#include "I2PIdentityUtils.h"
+#include <spdlog/spdlog.h>
+
+// HTTP-over-I2P benchmark: Beast's HTTP client runs directly on SamStream.
+// Each worker opens one I2P stream, sends GET requests on it with keep-alive and reopens the
+// stream when the server closes it. Reports request latency percentiles, stream setup cost and
+// body throughput. With SAM_HTTPS=1 the requests go over net::ssl::stream<SamStream> (HTTPS).
+
+namespace http = boost::beast::http;
+
+namespace {
+
+net::io_context bench_io_ctx;
+std::shared_ptr<SAM::SamService> g_bench_sam_service;
+std::unique_ptr<net::ssl::context> g_bench_tls_ctx; // Set with SAM_HTTPS
+
+struct BenchStats {
+	std::vector<double> latency_ms;  // Per successful request, write of the request to end of the response
+	std::vector<double> setup_ms;    // Per STREAM CONNECT (and TLS handshake)
+	uint64_t body_bytes = 0;
+	uint64_t failures = 0;
+	uint64_t streams_opened = 0;
+};
+BenchStats g_bench;
+
+double percentile(std::vector<double> values, double p) {
+	if (values.empty()) return 0.0;
+	std::sort(values.begin(), values.end());
+	const std::size_t index = std::min(values.size() - 1, static_cast<std::size_t>(p / 100.0 * values.size()));
+	return values[index];
+}
+
+template <typename Stream>
+net::awaitable<void> exchange(Stream& stream, boost::beast::flat_buffer& buffer,
+	const http::request<http::empty_body>& request, http::response<http::string_body>& response) {
+	co_await http::async_write(stream, request, net::use_awaitable);
+	co_await http::async_read(stream, buffer, response, net::use_awaitable);
+}
+
+net::awaitable<void> benchWorker(std::string session_id, std::string target, std::string path,
+	std::shared_ptr<std::size_t> remaining, SAM::AsyncWaitGroup& done) {
+	std::unique_ptr<SAM::SamStream> plain;
+	std::unique_ptr<net::ssl::stream<SAM::SamStream>> tls;
+	auto stream = [&]() -> SAM::SamStream* { return tls ? &tls->lowest_layer() : plain.get(); };
+	boost::beast::flat_buffer buffer;
+	while (*remaining > 0) {
+		--*remaining;
+		if (!stream() || !stream()->is_open()) {
+			plain.reset();
+			tls.reset();
+			auto connect_start = SteadyClock::now();
+			auto connect_res = co_await g_bench_sam_service->connectToPeerViaNewConnection(session_id, target);
+			if (!connect_res.success) {
+				SPDLOG_WARN("STREAM CONNECT to {} failed: {}", target, connect_res.error_message);
+				++g_bench.failures;
+				continue;
+			}
+			SAM::SamStream sam_stream(connect_res.data_connection);
+			sam_stream.setReadTimeout(std::chrono::minutes(2));
+			if (g_bench_tls_ctx) {
+				tls = std::make_unique<net::ssl::stream<SAM::SamStream>>(std::move(sam_stream), *g_bench_tls_ctx);
+				SSL_set_tlsext_host_name(tls->native_handle(), target.c_str());
+				try {
+					co_await tls->async_handshake(net::ssl::stream_base::client, net::use_awaitable);
+				} catch (const boost::system::system_error& e) {
+					SPDLOG_WARN("TLS handshake with {} failed: {}", target, e.code().message());
+					++g_bench.failures;
+					tls->lowest_layer().close();
+					continue;
+				}
+			} else {
+				plain = std::make_unique<SAM::SamStream>(std::move(sam_stream));
+			}
+			g_bench.setup_ms.push_back(std::chrono::duration<double, std::milli>(SteadyClock::now() - connect_start).count());
+			++g_bench.streams_opened;
+			buffer.clear();
+		}
+
+		http::request<http::empty_body> request{http::verb::get, path, 11};
+		request.set(http::field::host, target);
+		request.set(http::field::user_agent, "i2p_sam_http_bench");
+		request.keep_alive(true);
+		http::response<http::string_body> response;
+		auto start = SteadyClock::now();
+		try {
+			if (tls) co_await exchange(*tls, buffer, request, response);
+			else co_await exchange(*plain, buffer, request, response);
+		} catch (const boost::system::system_error& e) {
+			SPDLOG_WARN("Request on {} failed: {}", target, e.code().message());
+			++g_bench.failures;
+			stream()->close();
+			continue;
+		}
+		g_bench.latency_ms.push_back(std::chrono::duration<double, std::milli>(SteadyClock::now() - start).count());
+		g_bench.body_bytes += response.body().size();
+		if (!response.keep_alive()) stream()->close();
+	}
+	if (stream()) stream()->close();
+	done.done();
+}
+
+net::awaitable<void> bench_application_logic(const std::string& nickname, const std::string& private_key,
+	const std::string& sig_type, std::string target, std::size_t requests, std::size_t concurrency, std::string path) {
+	auto session = co_await g_bench_sam_service->establishControlSession(nickname, private_key, sig_type);
+	if (!session.success) {
+		SPDLOG_ERROR("Failed to establish benchmark SAM session: {}", session.error_message);
+		co_return;
+	}
+	SPDLOG_INFO("Session '{}' up as {}; {} requests to {}{} over {} stream(s)", session.created_session_id,
+		session.local_b32_address, requests, target, path, concurrency);
+
+	auto remaining = std::make_shared<std::size_t>(requests);
+	SAM::AsyncWaitGroup done(bench_io_ctx.get_executor());
+	done.add(concurrency);
+	auto start = SteadyClock::now();
+	for (std::size_t i = 0; i < concurrency; ++i) {
+		net::co_spawn(bench_io_ctx, benchWorker(session.created_session_id, target, path, remaining, done), net::detached);
+	}
+	co_await done.wait();
+	const double elapsed_s = std::chrono::duration<double>(SteadyClock::now() - start).count();
+
+	SPDLOG_INFO("Requests: {} ok, {} failed in {:.2f}s ({:.1f} req/s)", g_bench.latency_ms.size(), g_bench.failures,
+		elapsed_s, elapsed_s > 0 ? g_bench.latency_ms.size() / elapsed_s : 0.0);
+	SPDLOG_INFO("Latency ms: p50 {:.1f}, p90 {:.1f}, p99 {:.1f}, max {:.1f}", percentile(g_bench.latency_ms, 50),
+		percentile(g_bench.latency_ms, 90), percentile(g_bench.latency_ms, 99), percentile(g_bench.latency_ms, 100));
+	SPDLOG_INFO("Streams opened: {} (setup ms p50 {:.1f}, p99 {:.1f})", g_bench.streams_opened,
+		percentile(g_bench.setup_ms, 50), percentile(g_bench.setup_ms, 99));
+	SPDLOG_INFO("Body bytes: {} ({:.3f} MB/s)", g_bench.body_bytes,
+		elapsed_s > 0 ? g_bench.body_bytes / elapsed_s / (1024.0 * 1024.0) : 0.0);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+	// SAM_BRIDGE overrides the default bridge, e.g. "127.0.0.1:7656" or "unix:/run/i2pd/sam.sock"
+	SAM::SamBridgeEndpoint sam_bridge = SAM::SamBridgeEndpoint::tcp("localhost", 7656);
+	if (const char* bridge_env = std::getenv("SAM_BRIDGE")) {
+		std::string bridge_error;
+		if (!SAM::SamBridgeEndpoint::parse(bridge_env, 7656, sam_bridge, bridge_error)) {
+			SPDLOG_ERROR("Invalid SAM_BRIDGE: {}", bridge_error);
+			return 1;
+		}
+	}
+	if (argc < 3 || argc > 6) {
+		SPDLOG_ERROR("Usage: {} <private_key_file_path|TRANSIENT> <target.i2p> [requests(100)] [concurrency(1)] [path(/)]", argv[0]);
+		return 1;
+	}
+	if (sam_bridge.embedded) { // SAM_BRIDGE=embedded: run the router in this process
+		SAM::EmbeddedRouterConfig router_cfg;
+		if (const char* datadir_env = std::getenv("I2PD_DATADIR")) router_cfg.data_dir = datadir_env;
+		std::string router_error;
+		if (!SAM::EmbeddedRouter::start(router_cfg, router_error)) {
+			SPDLOG_ERROR("Failed to start embedded router: {}", router_error);
+			return 1;
+		}
+	}
+
+	std::string private_key = "TRANSIENT";
+	std::string sig_type;
+	if (std::string(argv[1]) != "TRANSIENT") {
+		std::ifstream key_file(argv[1]);
+		if (!key_file.is_open()) {
+			SPDLOG_ERROR("Failed to open key file: {}", argv[1]);
+			return 1;
+		}
+		private_key.assign(std::istreambuf_iterator<char>(key_file), std::istreambuf_iterator<char>());
+		private_key.erase(std::remove_if(private_key.begin(), private_key.end(),
+			[](char c) { return c == '\n' || c == '\r'; }), private_key.end());
+		sig_type = "EdDSA_SHA512_Ed25519";
+	}
+	const std::size_t requests = argc > 3 ? std::stoul(argv[3]) : 100;
+	const std::size_t concurrency = std::max<std::size_t>(1, argc > 4 ? std::stoul(argv[4]) : 1);
+	const std::string path = argc > 5 ? argv[5] : "/";
+
+	g_bench_sam_service = std::make_shared<SAM::SamService>(bench_io_ctx, sam_bridge);
+	if (const char* https_env = std::getenv("SAM_HTTPS"); https_env && std::string(https_env) == "1") {
+		// The I2P destination already authenticates the server; eepsite certificates are mostly self-signed.
+		g_bench_tls_ctx = std::make_unique<net::ssl::context>(net::ssl::context::tls_client);
+		g_bench_tls_ctx->set_verify_mode(net::ssl::verify_none);
+	}
+	const char* name_cache_file = std::getenv("SAM_NAME_CACHE_FILE");
+	if (name_cache_file) g_bench_sam_service->nameCache().loadSnapshot(name_cache_file);
+
+	try {
+		net::co_spawn(bench_io_ctx,
+			bench_application_logic("I2PBENCH_" + I2PIdentityUtils::genRandomName(), private_key, sig_type,
+				argv[2], requests, concurrency, path),
+			[](std::exception_ptr p) {
+				if (p) {
+					try { std::rethrow_exception(p); }
+					catch (const std::exception& e) { SPDLOG_ERROR("Benchmark coroutine exited with exception: {}", e.what()); }
+				}
+				if (g_bench_sam_service) g_bench_sam_service->shutdown();
+				if (!bench_io_ctx.stopped()) bench_io_ctx.stop();
+			});
+		bench_io_ctx.run();
+	} catch (const std::exception& e) {
+		SPDLOG_ERROR("Unhandled exception during setup or run: {}", e.what());
+		return 1;
+	}
+
+	if (name_cache_file) g_bench_sam_service->nameCache().saveSnapshot(name_cache_file);
+	g_bench_sam_service = nullptr;
+	SAM::EmbeddedRouter::stop();
+	return 0;
+}
@@ -0,0 +1,606 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <algorithm>
+#include <cstdlib>
+#include <deque>
+#include <array>
+#include <sstream>
+#include <map>
+#include <boost/asio.hpp>
+#include <boost/asio/signal_set.hpp>
+#include "SamService.h"
+#include "EmbeddedRouter.h"    // Optional in-process router (SAM_BRIDGE=embedded)
+#include "SamConnection.h"
+#include "SamAsyncUtils.h"
+#include "SamTrace.h"
+#include <spdlog/spdlog.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <strings.h>
+
+// Local SOCKS5 / HTTP proxy onto I2P.
+//  - SOCKS5 (CONNECT, domain names) and HTTP CONNECT are relayed as opaque tunnels with splice(2).
+//  - Plain HTTP requests (absolute-form URI) are forwarded request by request; when a response is
+//    length-delimited the I2P stream is parked and reused for the next request to that destination.
+//  - Destinations contacted often get fresh streams opened ahead of time.
+// .i2p hostnames are resolved through the SamService name cache (snapshot in SAM_NAME_CACHE_FILE).
+
+using tcp = net::ip::tcp;
+
+net::io_context proxy_io_ctx;
+std::atomic<bool> proxy_running(true);
+std::shared_ptr<SAM::SamService> g_app_sam_service = nullptr; // Global for signal handler
+std::string g_session_id;
+
+namespace {
+
+constexpr auto kIdleStreamMaxAge = std::chrono::seconds(60); // Peers drop idle streams; don't trust older ones
+constexpr std::size_t kPreopenAfterContacts = 3;             // Contacts before a destination gets warm streams
+constexpr std::size_t kPreopenDepth = 1;                     // Fresh streams kept per warm destination
+constexpr std::size_t kMaxRequestBody = 8 * 1024 * 1024;
+
+struct ProxyStats {
+	uint64_t client_connections = 0;
+	uint64_t tunnels = 0;           // SOCKS5 and HTTP CONNECT
+	uint64_t http_requests = 0;     // Forwarded plain HTTP requests
+	uint64_t streams_opened = 0;    // STREAM CONNECTs issued on demand
+	uint64_t streams_reused = 0;    // Requests served on a parked keep-alive stream
+	uint64_t preopened_used = 0;    // Requests/tunnels served on a stream opened ahead of time
+	uint64_t preopened = 0;
+	uint64_t open_failures = 0;
+	uint64_t retries = 0;           // Reused stream turned out dead, request resent on a new one
+	double setup_ms_total = 0;      // Sum over streams_opened
+};
+ProxyStats g_stats;
+
+struct IdleStream {
+	std::shared_ptr<SAM::SamConnection> conn;
+	SteadyClock::time_point since;
+	std::shared_ptr<bool> taken; // Tells the idle watcher the stream was handed out
+};
+struct DestinationStreams {
+	std::deque<IdleStream> fresh; // Never carried data (pre-opened)
+	std::deque<IdleStream> used;  // Parked after a complete keep-alive exchange
+	std::size_t preopening = 0;
+	uint64_t contacts = 0;
+};
+std::map<std::string, DestinationStreams> g_streams;
+
+void app_proxy_signal_handler(const boost::system::error_code &error, int signal_number) {
+	if (error == net::error::operation_aborted) return;
+	if (proxy_running) {
+		SPDLOG_INFO("Signal {} received. Shutdown...", signal_number);
+		proxy_running.store(false);
+		net::post(proxy_io_ctx, [] {
+			if (g_app_sam_service) g_app_sam_service->shutdown();
+			if (!proxy_io_ctx.stopped()) proxy_io_ctx.stop();
+		});
+	}
+}
+
+double meanSetupMs() {
+	return g_stats.streams_opened ? g_stats.setup_ms_total / g_stats.streams_opened : 0.0;
+}
+
+void logStats() {
+	const uint64_t served = g_stats.streams_opened + g_stats.streams_reused + g_stats.preopened_used;
+	const uint64_t saved = g_stats.streams_reused + g_stats.preopened_used;
+	SPDLOG_INFO("Proxy stats: {} clients, {} tunnels, {} HTTP requests; streams: {} opened, {} reused, {} pre-opened used "
+		"(reuse rate {:.1f}%), {} failures, {} retries; mean setup {:.0f} ms, ~{:.1f} s setup saved",
+		g_stats.client_connections, g_stats.tunnels, g_stats.http_requests, g_stats.streams_opened,
+		g_stats.streams_reused, g_stats.preopened_used, served ? 100.0 * saved / served : 0.0,
+		g_stats.open_failures, g_stats.retries, meanSetupMs(), saved * meanSetupMs() / 1000.0);
+}
+
+// Splits "host[:port]" (port is meaningless on I2P and dropped) and lowercases the host.
+std::string hostOnly(std::string authority) {
+	if (auto colon = authority.rfind(':'); colon != std::string::npos && authority.find(']') == std::string::npos) {
+		authority.resize(colon);
+	}
+	std::transform(authority.begin(), authority.end(), authority.begin(), ::tolower);
+	return authority;
+}
+
+bool isI2PHost(const std::string& host) {
+	return host.size() > 4 && host.ends_with(".i2p");
+}
+
+net::awaitable<std::shared_ptr<SAM::SamConnection>> openNewStream(const std::string& host) {
+	std::string destination = host;
+	if (!host.ends_with(".b32.i2p")) {
+		SAM::NamingLookupResult lookup = co_await g_app_sam_service->lookupName(host);
+		if (!lookup.success) {
+			SPDLOG_WARN("Proxy: cannot resolve {}: {}", host, lookup.error_message);
+			g_stats.open_failures++;
+			co_return nullptr;
+		}
+		destination = lookup.destination;
+	}
+	auto started = SteadyClock::now();
+	SAM::SetupStreamResult res = co_await g_app_sam_service->connectToPeerViaNewConnection(g_session_id, destination);
+	if (!res.success || !res.data_connection) {
+		g_stats.open_failures++;
+		co_return nullptr;
+	}
+	g_stats.setup_ms_total += std::chrono::duration<double, std::milli>(SteadyClock::now() - started).count();
+	co_return res.data_connection;
+}
+
+// Watches a parked stream: any byte, EOF or the age limit means it can no longer be handed out.
+net::awaitable<void> idleWatcher(std::string host, std::shared_ptr<SAM::SamConnection> conn, std::shared_ptr<bool> taken) {
+	char probe;
+	try {
+		co_await conn->streamRead(net::buffer(&probe, 1), kIdleStreamMaxAge);
+	} catch (const std::exception&) {
+	}
+	if (*taken) co_return; // Handed out; the read was cancelled on purpose
+	conn->closeSocket();
+	auto& dest = g_streams[host];
+	for (auto* queue : {&dest.fresh, &dest.used}) {
+		std::erase_if(*queue, [&conn](const IdleStream& idle) { return idle.conn == conn; });
+	}
+}
+
+void parkStream(const std::string& host, std::shared_ptr<SAM::SamConnection> conn, bool used) {
+	if (!proxy_running || !conn->isOpen()) return;
+	auto taken = std::make_shared<bool>(false);
+	auto& queue = used ? g_streams[host].used : g_streams[host].fresh;
+	queue.push_back(IdleStream{conn, SteadyClock::now(), taken});
+	net::co_spawn(proxy_io_ctx, idleWatcher(host, conn, taken), net::detached);
+}
+
+std::shared_ptr<SAM::SamConnection> takeParked(std::deque<IdleStream>& queue) {
+	while (!queue.empty()) {
+		IdleStream idle = std::move(queue.front());
+		queue.pop_front();
+		if (!idle.conn->isOpen() || SteadyClock::now() - idle.since > kIdleStreamMaxAge) continue;
+		*idle.taken = true;
+		idle.conn->cancel_read_operations(); // Stops the idle watcher's probe read
+		return idle.conn;
+	}
+	return nullptr;
+}
+
+void maybePreopen(const std::string& host) {
+	auto& dest = g_streams[host];
+	if (dest.contacts < kPreopenAfterContacts) return;
+	while (dest.fresh.size() + dest.preopening < kPreopenDepth) {
+		dest.preopening++;
+		net::co_spawn(proxy_io_ctx, [host]() -> net::awaitable<void> {
+			auto conn = co_await openNewStream(host);
+			g_streams[host].preopening--;
+			if (conn) {
+				g_stats.preopened++;
+				parkStream(host, conn, false);
+			}
+		}, net::detached);
+	}
+}
+
+// Gets a stream to host: a parked keep-alive stream (if allow_used), a pre-opened one, or a new one.
+// `idle` is set for the first two, which the peer may have closed while they waited.
+net::awaitable<std::shared_ptr<SAM::SamConnection>> acquireStream(const std::string& host, bool allow_used, bool& idle) {
+	auto& dest = g_streams[host];
+	dest.contacts++;
+	idle = false;
+	std::shared_ptr<SAM::SamConnection> conn;
+	if (allow_used && (conn = takeParked(dest.used))) {
+		g_stats.streams_reused++;
+		idle = true;
+	} else if ((conn = takeParked(dest.fresh))) {
+		g_stats.preopened_used++;
+		idle = true;
+	} else if ((conn = co_await openNewStream(host))) {
+		g_stats.streams_opened++;
+	}
+	maybePreopen(host);
+	co_return conn;
+}
+
+// Moves bytes from one socket to another through a pipe with splice(2); returns at EOF or error
+// and shuts down the sending side of `to`.
+template <typename From, typename To>
+net::awaitable<uint64_t> spliceRelay(From& from, To& to) {
+	uint64_t total = 0;
+	int pipe_fds[2];
+	if (::pipe2(pipe_fds, O_CLOEXEC | O_NONBLOCK) != 0) co_return 0;
+	try {
+		from.native_non_blocking(true);
+		to.native_non_blocking(true);
+		bool done = false;
+		while (!done) {
+			ssize_t n = ::splice(from.native_handle(), nullptr, pipe_fds[1], nullptr, 64 * 1024, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+			if (n == 0) break;
+			if (n < 0) {
+				if (errno == EINTR) continue;
+				if (errno != EAGAIN) break;
+				co_await from.async_wait(net::socket_base::wait_read, net::use_awaitable);
+				continue;
+			}
+			std::size_t left = static_cast<std::size_t>(n);
+			while (left > 0) {
+				ssize_t m = ::splice(pipe_fds[0], nullptr, to.native_handle(), nullptr, left, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+				if (m < 0 && errno == EINTR) continue;
+				if (m < 0 && errno == EAGAIN) {
+					co_await to.async_wait(net::socket_base::wait_write, net::use_awaitable);
+					continue;
+				}
+				if (m <= 0) {
+					done = true;
+					break;
+				}
+				left -= static_cast<std::size_t>(m);
+			}
+			total += static_cast<uint64_t>(n) - left;
+		}
+	} catch (const boost::system::system_error&) {
+		// Socket closed by the other direction
+	}
+	::close(pipe_fds[0]);
+	::close(pipe_fds[1]);
+	boost::system::error_code ec;
+	to.shutdown(net::socket_base::shutdown_send, ec);
+	co_return total;
+}
+
+// Opaque tunnel between a client socket and an I2P stream (SOCKS5 / HTTP CONNECT).
+net::awaitable<void> relayTunnel(tcp::socket& client, std::shared_ptr<SAM::SamConnection> stream, std::string client_prefix) {
+	g_stats.tunnels++;
+	if (!client_prefix.empty()) co_await stream->streamWrite(net::buffer(client_prefix));
+	// Bytes the stream already buffered while reading SAM replies go out before splicing.
+	std::array<char, 16384> buffer;
+	while (!stream->bufferedBytes().empty()) {
+		std::size_t n = co_await stream->streamRead(net::buffer(buffer));
+		co_await net::async_write(client, net::buffer(buffer.data(), n), net::use_awaitable);
+	}
+
+	SAM::AsyncWaitGroup directions(proxy_io_ctx.get_executor());
+	uint64_t up = 0, down = 0;
+	directions.add(2);
+	net::co_spawn(proxy_io_ctx, [&]() -> net::awaitable<void> {
+		up = co_await spliceRelay(client, stream->rawSocket());
+		directions.done();
+	}, net::detached);
+	net::co_spawn(proxy_io_ctx, [&]() -> net::awaitable<void> {
+		down = co_await spliceRelay(stream->rawSocket(), client);
+		directions.done();
+	}, net::detached);
+	co_await directions.wait();
+	stream->closeSocket();
+	SPDLOG_DEBUG("Tunnel closed: {} bytes up, {} bytes down", up, down);
+}
+
+net::awaitable<void> handleSocks5(tcp::socket client) {
+	std::array<uint8_t, 262> buf;
+	co_await net::async_read(client, net::buffer(buf.data(), 2), net::use_awaitable); // VER NMETHODS
+	co_await net::async_read(client, net::buffer(buf.data(), buf[1]), net::use_awaitable);
+	const uint8_t no_auth[2] = {0x05, 0x00};
+	co_await net::async_write(client, net::buffer(no_auth), net::use_awaitable);
+
+	co_await net::async_read(client, net::buffer(buf.data(), 4), net::use_awaitable); // VER CMD RSV ATYP
+	auto reply = [&client](uint8_t code) -> net::awaitable<void> {
+		const uint8_t response[10] = {0x05, code, 0x00, 0x01, 0, 0, 0, 0, 0, 0};
+		co_await net::async_write(client, net::buffer(response), net::use_awaitable);
+	};
+	if (buf[1] != 0x01) { co_await reply(0x07); co_return; } // Only CONNECT
+	if (buf[3] != 0x03) { co_await reply(0x08); co_return; } // I2P needs a domain name
+	co_await net::async_read(client, net::buffer(buf.data(), 1), net::use_awaitable);
+	const std::size_t host_len = buf[0];
+	co_await net::async_read(client, net::buffer(buf.data(), host_len + 2), net::use_awaitable); // host + port
+	std::string host = hostOnly(std::string(reinterpret_cast<const char*>(buf.data()), host_len));
+	if (!isI2PHost(host)) { co_await reply(0x02); co_return; }
+
+	bool idle = false;
+	auto stream = co_await acquireStream(host, false, idle);
+	if (!stream) { co_await reply(0x04); co_return; }
+	co_await reply(0x00);
+	co_await relayTunnel(client, stream, {});
+}
+
+struct HttpHead {
+	std::string start_line;
+	std::vector<std::pair<std::string, std::string>> headers;
+
+	std::string get(const std::string& name) const {
+		for (const auto& h : headers) {
+			if (strcasecmp(h.first.c_str(), name.c_str()) == 0) return h.second;
+		}
+		return {};
+	}
+};
+
+HttpHead parseHead(const std::string& text) {
+	HttpHead head;
+	std::size_t pos = text.find("\r\n");
+	head.start_line = text.substr(0, pos);
+	while (pos != std::string::npos && pos + 2 < text.size()) {
+		std::size_t next = text.find("\r\n", pos + 2);
+		std::string line = text.substr(pos + 2, next == std::string::npos ? std::string::npos : next - pos - 2);
+		pos = next;
+		if (line.empty()) break;
+		auto colon = line.find(':');
+		if (colon == std::string::npos) continue;
+		std::string value = line.substr(colon + 1);
+		value.erase(0, value.find_first_not_of(" \t"));
+		head.headers.emplace_back(line.substr(0, colon), value);
+	}
+	return head;
+}
+
+bool headerHasToken(const std::string& value, const char* token) {
+	std::string lower = value;
+	std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+	return lower.find(token) != std::string::npos;
+}
+
+// Reads from the stream until the response head is complete; `data` keeps any body bytes after it.
+net::awaitable<std::size_t> readResponseHead(SAM::SamConnection& stream, std::string& data) {
+	std::array<char, 16384> buffer;
+	for (;;) {
+		if (auto end = data.find("\r\n\r\n"); end != std::string::npos) co_return end + 4;
+		if (data.size() > 64 * 1024) throw std::runtime_error("response head too large");
+		std::size_t n = co_await stream.streamRead(net::buffer(buffer), std::chrono::minutes(2));
+		if (n == 0) throw boost::system::system_error(net::error::eof);
+		data.append(buffer.data(), n);
+	}
+}
+
+// Plain HTTP forwarding with keep-alive stream reuse; `request_head` is the first request's head.
+net::awaitable<void> handleHttpForward(tcp::socket& client, net::streambuf& client_buf, std::string request_head) {
+	std::array<char, 16384> buffer;
+	for (;;) {
+		HttpHead head = parseHead(request_head);
+		std::istringstream start(head.start_line);
+		std::string method, uri, version;
+		start >> method >> uri >> version;
+		std::string host;
+		std::string path = "/";
+		if (uri.rfind("http://", 0) == 0) {
+			auto slash = uri.find('/', 7);
+			host = hostOnly(uri.substr(7, slash == std::string::npos ? std::string::npos : slash - 7));
+			if (slash != std::string::npos) path = uri.substr(slash);
+		}
+		if (!isI2PHost(host) || !head.get("Transfer-Encoding").empty()) {
+			const std::string bad = "HTTP/1.1 400 Bad Request\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+			co_await net::async_write(client, net::buffer(bad), net::use_awaitable);
+			co_return;
+		}
+		const bool client_close = headerHasToken(head.get("Proxy-Connection") + head.get("Connection"), "close");
+
+		// Origin-form request with hop-by-hop headers replaced; body read whole (Content-Length only).
+		std::string request = method + " " + path + " " + version + "\r\n";
+		for (const auto& h : head.headers) {
+			if (strcasecmp(h.first.c_str(), "Proxy-Connection") == 0 || strcasecmp(h.first.c_str(), "Connection") == 0 ||
+				strcasecmp(h.first.c_str(), "Keep-Alive") == 0) continue;
+			request += h.first + ": " + h.second + "\r\n";
+		}
+		request += "Connection: keep-alive\r\n\r\n";
+		std::size_t body_len = std::strtoull(head.get("Content-Length").c_str(), nullptr, 10);
+		if (body_len > kMaxRequestBody) {
+			const std::string too_large = "HTTP/1.1 413 Payload Too Large\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+			co_await net::async_write(client, net::buffer(too_large), net::use_awaitable);
+			co_return;
+		}
+		if (client_buf.size() < body_len) {
+			co_await net::async_read(client, client_buf, net::transfer_exactly(body_len - client_buf.size()), net::use_awaitable);
+		}
+		request.append(net::buffers_begin(client_buf.data()), net::buffers_begin(client_buf.data()) + body_len);
+		client_buf.consume(body_len);
+		g_stats.http_requests++;
+
+		// A parked or pre-opened stream may have been closed by the peer just now: resend once on a new
+		// stream if it fails before any response byte arrived. Once the request went out the peer may
+		// have acted on it, so only idempotent methods are sent again after that.
+		const bool idempotent = method == "GET" || method == "HEAD" || method == "OPTIONS" || method == "TRACE" ||
+			method == "PUT" || method == "DELETE";
+		std::shared_ptr<SAM::SamConnection> stream;
+		std::string response;
+		std::size_t head_end = 0;
+		for (int attempt = 0; attempt < 2 && !head_end; ++attempt) {
+			bool idle = false;
+			bool written = false;
+			stream = co_await acquireStream(host, attempt == 0, idle);
+			if (!stream) break;
+			try {
+				co_await stream->streamWrite(net::buffer(request));
+				written = true;
+				head_end = co_await readResponseHead(*stream, response);
+			} catch (const std::exception& e) {
+				stream->closeSocket();
+				if (!idle || !response.empty() || (written && !idempotent)) throw;
+				g_stats.retries++;
+				response.clear();
+			}
+		}
+		if (!head_end) {
+			const std::string unreachable = "HTTP/1.1 502 Bad Gateway\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+			co_await net::async_write(client, net::buffer(unreachable), net::use_awaitable);
+			co_return;
+		}
+
+		HttpHead response_head = parseHead(response.substr(0, head_end));
+		int status = 0;
+		if (response_head.start_line.size() > 12) status = std::atoi(response_head.start_line.c_str() + 9);
+		const bool no_body = method == "HEAD" || status == 204 || status == 304 || (status >= 100 && status < 200);
+		const std::string content_length = response_head.get("Content-Length");
+		const bool length_delimited = no_body || (!content_length.empty() && response_head.get("Transfer-Encoding").empty());
+		bool reusable = length_delimited && !headerHasToken(response_head.get("Connection"), "close");
+
+		co_await net::async_write(client, net::buffer(response), net::use_awaitable);
+		if (length_delimited) {
+			const std::size_t expected = no_body ? 0 : std::strtoull(content_length.c_str(), nullptr, 10);
+			std::size_t have = response.size() - head_end;
+			if (have > expected) reusable = false; // Peer sent more than it announced
+			while (have < expected) {
+				std::size_t n = co_await stream->streamRead(net::buffer(buffer.data(), std::min(buffer.size(), expected - have)));
+				if (n == 0) throw boost::system::system_error(net::error::eof);
+				co_await net::async_write(client, net::buffer(buffer.data(), n), net::use_awaitable);
+				have += n;
+			}
+			if (reusable) parkStream(host, stream, true);
+			else stream->closeSocket();
+		} else {
+			// Chunked or close-delimited: relay to EOF; the stream cannot be reused.
+			try {
+				for (;;) {
+					std::size_t n = co_await stream->streamRead(net::buffer(buffer));
+					if (n == 0) break;
+					co_await net::async_write(client, net::buffer(buffer.data(), n), net::use_awaitable);
+				}
+			} catch (const boost::system::system_error&) {
+			}
+			stream->closeSocket();
+			co_return;
+		}
+
+		if (client_close) co_return;
+		std::size_t next_head = co_await net::async_read_until(client, client_buf, "\r\n\r\n", net::use_awaitable);
+		request_head.assign(net::buffers_begin(client_buf.data()), net::buffers_begin(client_buf.data()) + next_head);
+		client_buf.consume(next_head);
+	}
+}
+
+net::awaitable<void> handleHttp(tcp::socket client) {
+	net::streambuf client_buf;
+	std::size_t head_len = co_await net::async_read_until(client, client_buf, "\r\n\r\n", net::use_awaitable);
+	std::string request_head(net::buffers_begin(client_buf.data()), net::buffers_begin(client_buf.data()) + head_len);
+	client_buf.consume(head_len);
+
+	if (request_head.rfind("CONNECT ", 0) != 0) {
+		co_await handleHttpForward(client, client_buf, std::move(request_head));
+		co_return;
+	}
+	std::string authority = request_head.substr(8, request_head.find(' ', 8) - 8);
+	std::string host = hostOnly(authority);
+	bool idle = false;
+	auto stream = isI2PHost(host) ? co_await acquireStream(host, false, idle) : nullptr;
+	if (!stream) {
+		const std::string failed = "HTTP/1.1 502 Bad Gateway\r\nContent-Length: 0\r\n\r\n";
+		co_await net::async_write(client, net::buffer(failed), net::use_awaitable);
+		co_return;
+	}
+	const std::string established = "HTTP/1.1 200 Connection established\r\n\r\n";
+	co_await net::async_write(client, net::buffer(established), net::use_awaitable);
+	// Whatever the client sent behind the CONNECT head (e.g. a TLS ClientHello) goes first.
+	std::string prefix(net::buffers_begin(client_buf.data()), net::buffers_end(client_buf.data()));
+	co_await relayTunnel(client, stream, std::move(prefix));
+}
+
+net::awaitable<void> handleClient(tcp::socket client) {
+	g_stats.client_connections++;
+	try {
+		uint8_t first = 0;
+		co_await client.async_receive(net::buffer(&first, 1), tcp::socket::message_peek, net::use_awaitable);
+		if (first == 0x05) co_await handleSocks5(std::move(client));
+		else co_await handleHttp(std::move(client));
+	} catch (const std::exception& e) {
+		SPDLOG_DEBUG("Proxy client finished: {}", e.what());
+	}
+}
+
+net::awaitable<void> statsReporter() {
+	net::steady_timer timer(proxy_io_ctx);
+	while (proxy_running) {
+		timer.expires_after(std::chrono::seconds(60));
+		co_await timer.async_wait(net::use_awaitable);
+		logStats();
+	}
+}
+
+net::awaitable<void> proxy_application_logic(const std::string& nickname, const std::string& private_key,
+	const std::string& sig_type, tcp::endpoint listen_endpoint) {
+	auto session = co_await g_app_sam_service->establishControlSession(nickname, private_key, sig_type);
+	if (!session.success) {
+		SPDLOG_ERROR("Failed to establish proxy SAM session: {}", session.error_message);
+		co_return;
+	}
+	g_session_id = session.created_session_id;
+	SPDLOG_INFO("Proxy session '{}' up as {}", g_session_id, session.local_b32_address);
+
+	tcp::acceptor acceptor(proxy_io_ctx, listen_endpoint);
+	SPDLOG_INFO("SOCKS5 / HTTP proxy listening on {}:{}", listen_endpoint.address().to_string(), listen_endpoint.port());
+	net::co_spawn(proxy_io_ctx, statsReporter(), net::detached);
+	while (proxy_running) {
+		tcp::socket client = co_await acceptor.async_accept(net::use_awaitable);
+		client.set_option(tcp::no_delay(true));
+		net::co_spawn(proxy_io_ctx, handleClient(std::move(client)), net::detached);
+	}
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+	// SAM_BRIDGE overrides the default bridge, e.g. "127.0.0.1:7656" or "unix:/run/i2pd/sam.sock"
+	SAM::SamBridgeEndpoint sam_bridge = SAM::SamBridgeEndpoint::tcp("localhost", 7656);
+	if (const char* bridge_env = std::getenv("SAM_BRIDGE")) {
+		std::string bridge_error;
+		if (!SAM::SamBridgeEndpoint::parse(bridge_env, 7656, sam_bridge, bridge_error)) {
+			SPDLOG_ERROR("Invalid SAM_BRIDGE: {}", bridge_error);
+			return 1;
+		}
+	}
+	if (argc < 2 || argc > 3) {
+		SPDLOG_ERROR("Usage: {} <private_key_file_path|TRANSIENT> [listen_port(4447)]", argv[0]);
+		return 1;
+	}
+	if (sam_bridge.embedded) { // SAM_BRIDGE=embedded: run the router in this process
+		SAM::EmbeddedRouterConfig router_cfg;
+		if (const char* datadir_env = std::getenv("I2PD_DATADIR")) router_cfg.data_dir = datadir_env;
+		std::string router_error;
+		if (!SAM::EmbeddedRouter::start(router_cfg, router_error)) {
+			SPDLOG_ERROR("Failed to start embedded router: {}", router_error);
+			return 1;
+		}
+	}
+
+	std::string private_key = "TRANSIENT";
+	std::string sig_type;
+	if (std::string(argv[1]) != "TRANSIENT") {
+		std::ifstream key_file(argv[1]);
+		if (!key_file.is_open()) {
+			SPDLOG_ERROR("Failed to open key file: {}", argv[1]);
+			return 1;
+		}
+		private_key.assign(std::istreambuf_iterator<char>(key_file), std::istreambuf_iterator<char>());
+		private_key.erase(std::remove_if(private_key.begin(), private_key.end(),
+			[](char c) { return c == '\n' || c == '\r'; }), private_key.end());
+		sig_type = "EdDSA_SHA512_Ed25519";
+	}
+	const uint16_t listen_port = argc == 3 ? static_cast<uint16_t>(std::stoi(argv[2])) : 4447;
+
+	g_app_sam_service = std::make_shared<SAM::SamService>(proxy_io_ctx, sam_bridge);
+	const char* name_cache_file = std::getenv("SAM_NAME_CACHE_FILE");
+	if (name_cache_file) g_app_sam_service->nameCache().loadSnapshot(name_cache_file);
+
+	try {
+		net::signal_set signals(proxy_io_ctx, SIGINT, SIGTERM);
+		signals.async_wait(&app_proxy_signal_handler);
+		SPDLOG_INFO("Socket I/O backend: {}", SAM::SamConnection::ioBackendName());
+		net::co_spawn(proxy_io_ctx,
+			proxy_application_logic("I2PPROXY_" + I2PIdentityUtils::genRandomName(), private_key, sig_type,
+				tcp::endpoint(net::ip::address_v4::loopback(), listen_port)),
+			[](std::exception_ptr p) {
+				if (p) {
+					try { std::rethrow_exception(p); }
+					catch (const std::exception& e) { SPDLOG_ERROR("Proxy coroutine exited with exception: {}", e.what()); }
+				}
+				if (!proxy_io_ctx.stopped()) proxy_io_ctx.stop();
+			});
+		proxy_io_ctx.run();
+	} catch (const std::exception& e) {
+		SPDLOG_ERROR("Unhandled exception during setup or run: {}", e.what());
+		return 1;
+	}
+
+	logStats();
+	if (name_cache_file) g_app_sam_service->nameCache().saveSnapshot(name_cache_file);
+	g_streams.clear();
+	g_app_sam_service = nullptr;
+	SAM::EmbeddedRouter::stop();
+	if (const char* trace_file = std::getenv("SAM_TRACE_FILE")) {
+		SAM::Trace::dumpToFile(trace_file);
+	}
+	SPDLOG_INFO("Program exiting.");
+	return 0;
+}
@@ -0,0 +1,274 @@
+// Replays a SamCapture log (SAM::Capture::start) as a regression benchmark built from real traffic.
+// Usage: i2p_sam_replay <capture.bin> [speed(1)]   (speed 10 runs ten times faster, 0 as fast as possible)
+//
+// Every captured connection gets a socket pair. A fake bridge on one end answers with the captured
+// reply lines and stream chunks; the library on the other end (SamConnection readLine, streamRead,
+// streamWrite) sends the captured commands and chunks. Both follow the capture's timestamps divided
+// by speed, and only ever wait on what the other side sent earlier in the capture, so the replay
+// cannot deadlock. Payload bytes were never captured: chunks are replayed as zeros of the same size.
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <boost/asio.hpp>
+#include "SamConnection.h"
+#include "SamCapture.h"
+#include "SamAsyncUtils.h"
+#include <spdlog/spdlog.h>
+
+namespace {
+
+using SAM::Capture::Record;
+using SAM::Capture::RecordType;
+
+constexpr auto kStepTimeout = std::chrono::minutes(2);
+constexpr std::size_t kChunkMax = 64 * 1024;
+
+net::io_context replay_io_ctx;
+double g_speed = 1.0; // 0: no pacing
+SteadyClock::time_point g_start;
+const std::vector<char> g_zeros(kChunkMax, 0);
+
+struct ReplayStats {
+	std::size_t connections = 0;
+	std::size_t failed = 0;
+	uint64_t bytes_out = 0;
+	uint64_t bytes_in = 0;
+	std::vector<double> send_lag_ms; // Library side: how late each command/chunk went out
+};
+ReplayStats g_replay;
+
+double percentile(std::vector<double> values, double p) {
+	if (values.empty()) return 0.0;
+	std::sort(values.begin(), values.end());
+	const std::size_t index = std::min(values.size() - 1, static_cast<std::size_t>(p / 100.0 * values.size()));
+	return values[index];
+}
+
+SteadyClock::time_point scheduled(uint64_t time_us) {
+	if (g_speed <= 0) return g_start;
+	return g_start + std::chrono::duration_cast<SteadyClock::duration>(std::chrono::duration<double, std::micro>(time_us / g_speed));
+}
+
+net::awaitable<void> waitFor(uint64_t time_us) {
+	const auto at = scheduled(time_us);
+	if (SteadyClock::now() >= at) co_return;
+	net::steady_timer timer(replay_io_ctx, at);
+	co_await timer.async_wait(net::use_awaitable);
+}
+
+double lagMs(uint64_t time_us) {
+	return std::max(0.0, std::chrono::duration<double, std::milli>(SteadyClock::now() - scheduled(time_us)).count());
+}
+
+// Fake bridge end: reads what the library sends, writes what the bridge sent. Owns its copy of the
+// steps, since it may still be pacing a reply after the library end gave up.
+net::awaitable<void> bridgeSide(net::local::stream_protocol::socket socket, std::vector<Record> steps) {
+	net::streambuf buffer;
+	std::vector<char> scratch(kChunkMax);
+	try {
+		for (const Record& step : steps) {
+			switch (step.type) {
+			case RecordType::COMMAND: {
+				std::size_t n = co_await net::async_read_until(socket, buffer, '\n', net::use_awaitable);
+				buffer.consume(n);
+				break;
+			}
+			case RecordType::DATA_OUT: {
+				uint64_t remaining = step.bytes;
+				const std::size_t buffered = static_cast<std::size_t>(std::min<uint64_t>(buffer.size(), remaining));
+				buffer.consume(buffered);
+				remaining -= buffered;
+				while (remaining > 0) {
+					remaining -= co_await socket.async_read_some(
+						net::buffer(scratch.data(), static_cast<std::size_t>(std::min<uint64_t>(remaining, scratch.size()))),
+						net::use_awaitable);
+				}
+				break;
+			}
+			case RecordType::REPLY: {
+				co_await waitFor(step.time_us);
+				const std::string line = step.text + '\n';
+				co_await net::async_write(socket, net::buffer(line), net::use_awaitable);
+				break;
+			}
+			case RecordType::DATA_IN:
+				co_await waitFor(step.time_us);
+				for (uint64_t left = step.bytes; left > 0;) { // One captured chunk, one write
+					const std::size_t n = static_cast<std::size_t>(std::min<uint64_t>(left, g_zeros.size()));
+					co_await net::async_write(socket, net::buffer(g_zeros.data(), n), net::use_awaitable);
+					left -= n;
+				}
+				break;
+			case RecordType::PEER_EOF:
+				co_await waitFor(step.time_us);
+				socket.shutdown(net::socket_base::shutdown_send);
+				break;
+			default:
+				break;
+			}
+		}
+		// Drain until the library closes its end.
+		boost::system::error_code ec;
+		while (!ec) co_await socket.async_read_some(net::buffer(scratch), net::redirect_error(net::use_awaitable, ec));
+	} catch (const boost::system::system_error& e) {
+		SPDLOG_DEBUG("Fake bridge side ended: {}", e.code().message());
+	}
+}
+
+// Library end: the same steps through SamConnection.
+net::awaitable<bool> librarySide(std::shared_ptr<SAM::SamConnection> connection, const std::vector<Record>& steps) {
+	std::vector<char> scratch(kChunkMax);
+	uint64_t in_credit = 0; // Bytes read ahead of the captured chunk boundaries
+	auto enterDataMode = [&connection]() {
+		if (connection->getState() != SAM::SamConnection::ConnectionState::DATA_STREAM_MODE)
+			connection->setState(SAM::SamConnection::ConnectionState::DATA_STREAM_MODE);
+	};
+	RecordType previous = RecordType::OPEN;
+	for (const Record& step : steps) {
+		switch (step.type) {
+		case RecordType::COMMAND: {
+			co_await waitFor(step.time_us);
+			g_replay.send_lag_ms.push_back(lagMs(step.time_us));
+			const std::string line = step.text + '\n';
+			co_await net::async_write(connection->rawSocket(), net::buffer(line), net::use_awaitable);
+			break;
+		}
+		case RecordType::REPLY:
+			co_await connection->readLine(kStepTimeout);
+			break;
+		case RecordType::DATA_OUT: {
+			co_await waitFor(step.time_us);
+			g_replay.send_lag_ms.push_back(lagMs(step.time_us));
+			const bool early_data = previous == RecordType::COMMAND;
+			for (uint64_t left = step.bytes; left > 0;) {
+				const std::size_t n = static_cast<std::size_t>(std::min<uint64_t>(left, g_zeros.size()));
+				if (early_data) { // Behind STREAM CONNECT, before its reply: written raw, as SamService does
+					co_await net::async_write(connection->rawSocket(), net::buffer(g_zeros.data(), n), net::use_awaitable);
+				} else {
+					enterDataMode();
+					co_await connection->streamWrite(net::buffer(g_zeros.data(), n), kStepTimeout);
+				}
+				left -= n;
+			}
+			g_replay.bytes_out += step.bytes;
+			break;
+		}
+		case RecordType::DATA_IN:
+			enterDataMode();
+			while (in_credit < step.bytes) {
+				const std::size_t n = co_await connection->streamRead(net::buffer(scratch), kStepTimeout);
+				if (n == 0) throw boost::system::system_error(net::error::eof);
+				in_credit += n;
+			}
+			in_credit -= step.bytes;
+			g_replay.bytes_in += step.bytes;
+			break;
+		case RecordType::PEER_EOF:
+			enterDataMode();
+			try {
+				while (co_await connection->streamRead(net::buffer(scratch), kStepTimeout) > 0) {}
+			} catch (const boost::system::system_error& e) {
+				if (e.code() != net::error::eof) throw;
+			}
+			break;
+		case RecordType::CLOSE:
+			co_await waitFor(step.time_us);
+			connection->closeSocket();
+			break;
+		default:
+			break;
+		}
+		previous = step.type;
+	}
+	co_return true;
+}
+
+net::awaitable<void> replayConnection(uint32_t id, const std::vector<Record>& steps, SAM::AsyncWaitGroup& done) {
+	net::local::stream_protocol::socket library_end(replay_io_ctx), bridge_end(replay_io_ctx);
+	net::local::connect_pair(library_end, bridge_end);
+	auto connection = std::make_shared<SAM::SamConnection>(replay_io_ctx);
+	connection->adoptSocket(SAM::SamConnection::socket_type(replay_io_ctx,
+		net::generic::stream_protocol(AF_UNIX, 0), library_end.release()));
+	net::co_spawn(replay_io_ctx, bridgeSide(std::move(bridge_end), steps), net::detached);
+
+	bool ok = false;
+	try {
+		ok = co_await librarySide(connection, steps);
+	} catch (const std::exception& e) {
+		SPDLOG_WARN("Connection #{} diverged from the capture: {}", id, e.what());
+	}
+	if (!ok) ++g_replay.failed;
+	if (connection->isOpen()) connection->closeSocket();
+	done.done();
+}
+
+net::awaitable<void> replay(std::map<uint32_t, std::vector<Record>> scripts, uint64_t captured_span_us) {
+	// Connections start at their first record.
+	std::vector<std::pair<uint64_t, uint32_t>> starts;
+	for (const auto& [id, steps] : scripts) starts.emplace_back(steps.front().time_us, id);
+	std::sort(starts.begin(), starts.end());
+
+	SAM::AsyncWaitGroup done(replay_io_ctx.get_executor());
+	g_start = SteadyClock::now();
+	for (const auto& [time_us, id] : starts) {
+		co_await waitFor(time_us);
+		done.add();
+		++g_replay.connections;
+		net::co_spawn(replay_io_ctx, replayConnection(id, scripts[id], done), net::detached);
+	}
+	co_await done.wait();
+	const double elapsed_ms = std::chrono::duration<double, std::milli>(SteadyClock::now() - g_start).count();
+
+	SPDLOG_INFO("Replayed {} connection(s) in {:.1f} ms (captured span {:.1f} ms, speed {}): {} diverged",
+		g_replay.connections, elapsed_ms, captured_span_us / 1000.0, g_speed > 0 ? std::to_string(g_speed) : "max",
+		g_replay.failed);
+	SPDLOG_INFO("Stream bytes: {} out, {} in ({:.3f} MB/s)", g_replay.bytes_out, g_replay.bytes_in,
+		elapsed_ms > 0 ? (g_replay.bytes_out + g_replay.bytes_in) / (elapsed_ms / 1000.0) / (1024.0 * 1024.0) : 0.0);
+	if (g_speed > 0) {
+		SPDLOG_INFO("Library send lag ms: p50 {:.2f}, p99 {:.2f}, max {:.2f}", percentile(g_replay.send_lag_ms, 50),
+			percentile(g_replay.send_lag_ms, 99), percentile(g_replay.send_lag_ms, 100));
+	}
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+	if (argc < 2 || argc > 3) {
+		SPDLOG_ERROR("Usage: {} <capture.bin> [speed(1), 0 = as fast as possible]", argv[0]);
+		return 1;
+	}
+	g_speed = argc > 2 ? std::stod(argv[2]) : 1.0;
+
+	std::vector<Record> records;
+	std::string error_message;
+	if (!SAM::Capture::readFile(argv[1], records, error_message)) {
+		SPDLOG_ERROR("{}", error_message);
+		return 1;
+	}
+	if (!error_message.empty()) SPDLOG_WARN("{}: replaying the records before it", error_message);
+
+	const uint64_t span_us = records.empty() ? 0 : records.back().time_us;
+	std::map<uint32_t, std::vector<Record>> scripts;
+	for (Record& record : records) scripts[record.connection].push_back(std::move(record));
+	if (scripts.empty()) {
+		SPDLOG_WARN("{} holds no connections", argv[1]);
+		return 0;
+	}
+
+	try {
+		net::co_spawn(replay_io_ctx, replay(std::move(scripts), span_us),
+			[](std::exception_ptr p) {
+				if (p) {
+					try { std::rethrow_exception(p); }
+					catch (const std::exception& e) { SPDLOG_ERROR("Replay coroutine exited with exception: {}", e.what()); }
+				}
+			});
+		replay_io_ctx.run();
+	} catch (const std::exception& e) {
+		SPDLOG_ERROR("Unhandled exception during replay: {}", e.what());
+		return 1;
+	}
+	return 0;
+}
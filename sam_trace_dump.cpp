@@ -0,0 +1,92 @@
+// Converts a SamTrace binary dump (SAM::Trace::dumpToFile) to Chrome trace JSON.
+// Usage: i2p_sam_trace_dump <trace.bin> [out.json]   (writes to stdout without out.json)
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include "SamTrace.h"
+
+static const char* stateName(uint64_t state) {
+	static const char* names[] = {
+		"DISCONNECTED", "CONNECTING", "CONNECTED_NO_HELLO", "HELLO_OK",
+		"DATA_STREAM_MODE", "CLOSING", "CLOSED", "ERROR_STATE"
+	};
+	return state < sizeof(names) / sizeof(names[0]) ? names[state] : "?";
+}
+
+static const char* opName(uint64_t op) {
+	switch (static_cast<SAM::Trace::Op>(op)) {
+	case SAM::Trace::Op::CONNECT: return "connect";
+	case SAM::Trace::Op::READ_LINE: return "readLine";
+	case SAM::Trace::Op::STREAM_READ: return "streamRead";
+	case SAM::Trace::Op::STREAM_WRITE: return "streamWrite";
+	}
+	return "?";
+}
+
+int main(int argc, char* argv[]) {
+	if (argc < 2) {
+		std::cerr << "Usage: " << argv[0] << " <trace.bin> [out.json]" << std::endl;
+		return 1;
+	}
+	std::ifstream in(argv[1], std::ios::binary);
+	if (!in) {
+		std::cerr << "Cannot open " << argv[1] << std::endl;
+		return 1;
+	}
+	char magic[8];
+	uint32_t event_size = 0, event_count = 0;
+	in.read(magic, sizeof(magic));
+	in.read(reinterpret_cast<char*>(&event_size), sizeof(event_size));
+	in.read(reinterpret_cast<char*>(&event_count), sizeof(event_count));
+	if (!in || std::memcmp(magic, SAM::Trace::kFileMagic, sizeof(magic)) != 0 || event_size != sizeof(SAM::Trace::Event)) {
+		std::cerr << "Not a SamTrace file (or incompatible version): " << argv[1] << std::endl;
+		return 1;
+	}
+	std::vector<SAM::Trace::Event> events(event_count);
+	in.read(reinterpret_cast<char*>(events.data()), static_cast<std::streamsize>(event_count * sizeof(SAM::Trace::Event)));
+	events.resize(static_cast<std::size_t>(in.gcount()) / sizeof(SAM::Trace::Event));
+
+	std::ofstream file_out;
+	if (argc > 2) {
+		file_out.open(argv[2], std::ios::trunc);
+		if (!file_out) {
+			std::cerr << "Cannot write " << argv[2] << std::endl;
+			return 1;
+		}
+	}
+	std::ostream& out = (argc > 2) ? file_out : std::cout;
+
+	// One lane (tid) per connection so each lifecycle reads left to right; pid groups by OS thread.
+	uint64_t base_ns = events.empty() ? 0 : events.front().timestamp_ns;
+	out << "{\"traceEvents\":[\n";
+	for (std::size_t i = 0; i < events.size(); ++i) {
+		const auto& ev = events[i];
+		std::string name = SAM::Trace::eventTypeName(ev.type);
+		std::string args = "\"arg\":" + std::to_string(ev.arg);
+		switch (static_cast<SAM::Trace::EventType>(ev.type)) {
+		case SAM::Trace::EventType::STATE_CHANGE:
+			name = std::string(stateName(ev.arg >> 8)) + " -> " + stateName(ev.arg & 0xFF);
+			break;
+		case SAM::Trace::EventType::TIMEOUT:
+		case SAM::Trace::EventType::CANCELLED:
+			name += std::string(" ") + opName(ev.arg);
+			break;
+		case SAM::Trace::EventType::BYTES_READ:
+		case SAM::Trace::EventType::BYTES_WRITTEN:
+		case SAM::Trace::EventType::COMMAND_SENT:
+		case SAM::Trace::EventType::REPLY_RECEIVED:
+			args = "\"bytes\":" + std::to_string(ev.arg);
+			break;
+		default:
+			break;
+		}
+		double ts_us = static_cast<double>(ev.timestamp_ns - base_ns) / 1000.0;
+		out << "{\"name\":\"" << name << "\",\"ph\":\"i\",\"s\":\"t\",\"ts\":" << std::fixed << ts_us
+			<< ",\"pid\":" << ev.thread_index << ",\"tid\":" << ev.connection
+			<< ",\"args\":{" << args << "}}" << (i + 1 < events.size() ? ",\n" : "\n");
+	}
+	out << "]}\n";
+	return 0;
+}